@@ -0,0 +1,401 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "config.h"
+
+#include "roger-connection-monitor.h"
+
+#include <string.h>
+
+/*
+ * Connection status monitor
+ *
+ * Windows used to poll the status of their connection four times a second,
+ * each with its own timer, and redraw on every tick. The monitor is the only
+ * place which reads the status of watched connections and emits signals
+ * when something changed:
+ *
+ *   fax-status-changed (RmConnection *, RmFaxStatus *): phase, page or
+ *     progress of a fax transfer changed. The status is %NULL once the
+ *     connection is lost. The transfer is not watched anymore after the
+ *     release phase or a lost connection.
+ *   duration-changed (RmConnection *, const char *duration): the duration
+ *     text of a call or fax changed.
+ *
+ * librm only provides the fax status on request, so it is sampled while fax
+ * transfers are watched. Durations change once a second and are sampled by a
+ * seconds timer which GLib aligns with other wakeups. Without watched
+ * connections no source is running at all. Disconnected connections are
+ * dropped automatically, a fax transfer gets a final %NULL status first.
+ */
+
+#define MONITOR_FAX_INTERVAL 250
+
+typedef struct {
+  RmConnection *connection;
+  RmFax *fax;
+  RmFaxStatus status;
+  char *remote_ident;
+  char *duration;
+} RogerConnectionMonitorEntry;
+
+struct _RogerConnectionMonitor {
+  GObject parent_instance;
+
+  GHashTable *entries;
+  guint faxes;
+  guint fax_timer_id;
+  guint duration_timer_id;
+};
+
+G_DEFINE_TYPE (RogerConnectionMonitor, roger_connection_monitor, G_TYPE_OBJECT)
+
+enum {
+  FAX_STATUS_CHANGED,
+  DURATION_CHANGED,
+  LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL];
+
+static RogerConnectionMonitor *default_monitor = NULL;
+
+static void
+roger_connection_monitor_entry_free (RogerConnectionMonitorEntry *entry)
+{
+  g_free (entry->remote_ident);
+  g_free (entry->duration);
+  g_free (entry);
+}
+
+static void
+roger_connection_monitor_update_timers (RogerConnectionMonitor *self)
+{
+  if (self->faxes == 0)
+    g_clear_handle_id (&self->fax_timer_id, g_source_remove);
+
+  if (g_hash_table_size (self->entries) == 0)
+    g_clear_handle_id (&self->duration_timer_id, g_source_remove);
+}
+
+static void
+roger_connection_monitor_remove (RogerConnectionMonitor *self,
+                                 RmConnection           *connection)
+{
+  RogerConnectionMonitorEntry *entry = g_hash_table_lookup (self->entries, connection);
+
+  if (!entry)
+    return;
+
+  if (entry->fax)
+    self->faxes--;
+
+  g_hash_table_remove (self->entries, connection);
+  roger_connection_monitor_update_timers (self);
+}
+
+static gboolean
+roger_connection_monitor_fax_changed (RogerConnectionMonitorEntry *entry,
+                                      RmFaxStatus                 *status)
+{
+  return entry->status.phase != status->phase ||
+         entry->status.error_code != status->error_code ||
+         entry->status.percentage != status->percentage ||
+         entry->status.pages_transferred != status->pages_transferred ||
+         entry->status.pages_total != status->pages_total;
+}
+
+static gboolean
+roger_connection_monitor_fax_timer_cb (gpointer user_data)
+{
+  RogerConnectionMonitor *self = ROGER_CONNECTION_MONITOR (user_data);
+  g_autoptr (GPtrArray) finished = g_ptr_array_new ();
+  g_autoptr (GPtrArray) changed = g_ptr_array_new ();
+  GHashTableIter iter;
+  gpointer value;
+  guint idx;
+
+  /* Collect first, handlers may watch or unwatch connections */
+  g_hash_table_iter_init (&iter, self->entries);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    RogerConnectionMonitorEntry *entry = value;
+    RmFaxStatus status;
+
+    if (!entry->fax)
+      continue;
+
+    memset (&status, 0, sizeof (RmFaxStatus));
+    if (!rm_fax_get_status (entry->fax, entry->connection, &status)) {
+      g_ptr_array_add (finished, entry->connection);
+      continue;
+    }
+
+    /* The remote ident is only allocated while identifying */
+    if (status.phase == RM_FAX_PHASE_IDENTIFY) {
+      g_free (entry->remote_ident);
+      entry->remote_ident = status.remote_ident;
+    }
+    status.remote_ident = entry->remote_ident;
+
+    if (!roger_connection_monitor_fax_changed (entry, &status))
+      continue;
+
+    entry->status = status;
+    g_ptr_array_add (changed, entry->connection);
+  }
+
+  for (idx = 0; idx < changed->len; idx++) {
+    RmConnection *connection = g_ptr_array_index (changed, idx);
+    RogerConnectionMonitorEntry *entry = g_hash_table_lookup (self->entries, connection);
+    g_autofree char *remote_ident = NULL;
+    RmFaxStatus status;
+
+    if (!entry)
+      continue;
+
+    /* Handlers may unwatch the connection while the signal is emitted */
+    status = entry->status;
+    remote_ident = g_strdup (entry->remote_ident);
+    status.remote_ident = remote_ident;
+    if (status.phase == RM_FAX_PHASE_RELEASE)
+      g_ptr_array_add (finished, connection);
+
+    g_signal_emit (self, signals[FAX_STATUS_CHANGED], 0, connection, &status);
+  }
+
+  for (idx = 0; idx < finished->len; idx++) {
+    RmConnection *connection = g_ptr_array_index (finished, idx);
+    RogerConnectionMonitorEntry *entry = g_hash_table_lookup (self->entries, connection);
+
+    if (!entry)
+      continue;
+
+    if (entry->status.phase != RM_FAX_PHASE_RELEASE)
+      g_signal_emit (self, signals[FAX_STATUS_CHANGED], 0, connection, NULL);
+
+    roger_connection_monitor_remove (self, connection);
+  }
+
+  if (self->faxes == 0) {
+    self->fax_timer_id = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+roger_connection_monitor_duration_timer_cb (gpointer user_data)
+{
+  RogerConnectionMonitor *self = ROGER_CONNECTION_MONITOR (user_data);
+  g_autoptr (GPtrArray) changed = g_ptr_array_new ();
+  GHashTableIter iter;
+  gpointer value;
+  guint idx;
+
+  g_hash_table_iter_init (&iter, self->entries);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    RogerConnectionMonitorEntry *entry = value;
+    g_autofree char *duration = rm_connection_get_duration_time (entry->connection);
+
+    if (!g_strcmp0 (duration, entry->duration))
+      continue;
+
+    g_free (entry->duration);
+    entry->duration = g_steal_pointer (&duration);
+    g_ptr_array_add (changed, entry->connection);
+  }
+
+  for (idx = 0; idx < changed->len; idx++) {
+    RmConnection *connection = g_ptr_array_index (changed, idx);
+    RogerConnectionMonitorEntry *entry = g_hash_table_lookup (self->entries, connection);
+    g_autofree char *duration = NULL;
+
+    if (!entry)
+      continue;
+
+    duration = g_strdup (entry->duration);
+    g_signal_emit (self, signals[DURATION_CHANGED], 0, connection, duration);
+  }
+
+  if (g_hash_table_size (self->entries) == 0) {
+    self->duration_timer_id = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static RogerConnectionMonitorEntry *
+roger_connection_monitor_add (RogerConnectionMonitor *self,
+                              RmConnection           *connection)
+{
+  RogerConnectionMonitorEntry *entry = g_hash_table_lookup (self->entries, connection);
+
+  if (entry)
+    return entry;
+
+  entry = g_new0 (RogerConnectionMonitorEntry, 1);
+  entry->connection = connection;
+  g_hash_table_insert (self->entries, connection, entry);
+
+  if (!self->duration_timer_id)
+    self->duration_timer_id = g_timeout_add_seconds (1, roger_connection_monitor_duration_timer_cb, self);
+
+  return entry;
+}
+
+static void
+roger_connection_monitor_connection_changed_cb (RmObject     *object,
+                                                gint          type,
+                                                RmConnection *connection,
+                                                gpointer      user_data)
+{
+  RogerConnectionMonitor *self = ROGER_CONNECTION_MONITOR (user_data);
+  RogerConnectionMonitorEntry *entry;
+
+  if (!(type & RM_CONNECTION_TYPE_DISCONNECT))
+    return;
+
+  entry = g_hash_table_lookup (self->entries, connection);
+  if (!entry)
+    return;
+
+  /* A fax transfer which did not reach the release phase is reported lost */
+  if (entry->fax && entry->status.phase != RM_FAX_PHASE_RELEASE)
+    g_signal_emit (self, signals[FAX_STATUS_CHANGED], 0, connection, NULL);
+
+  roger_connection_monitor_remove (self, connection);
+}
+
+static void
+roger_connection_monitor_dispose (GObject *object)
+{
+  RogerConnectionMonitor *self = ROGER_CONNECTION_MONITOR (object);
+
+  g_clear_handle_id (&self->fax_timer_id, g_source_remove);
+  g_clear_handle_id (&self->duration_timer_id, g_source_remove);
+  g_clear_pointer (&self->entries, g_hash_table_unref);
+
+  G_OBJECT_CLASS (roger_connection_monitor_parent_class)->dispose (object);
+}
+
+static void
+roger_connection_monitor_class_init (RogerConnectionMonitorClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = roger_connection_monitor_dispose;
+
+  signals[FAX_STATUS_CHANGED] = g_signal_new ("fax-status-changed",
+                                              ROGER_TYPE_CONNECTION_MONITOR,
+                                              G_SIGNAL_RUN_LAST,
+                                              0,
+                                              NULL,
+                                              NULL,
+                                              NULL,
+                                              G_TYPE_NONE,
+                                              2,
+                                              G_TYPE_POINTER,
+                                              G_TYPE_POINTER);
+
+  signals[DURATION_CHANGED] = g_signal_new ("duration-changed",
+                                            ROGER_TYPE_CONNECTION_MONITOR,
+                                            G_SIGNAL_RUN_LAST,
+                                            0,
+                                            NULL,
+                                            NULL,
+                                            NULL,
+                                            G_TYPE_NONE,
+                                            2,
+                                            G_TYPE_POINTER,
+                                            G_TYPE_STRING);
+}
+
+static void
+roger_connection_monitor_init (RogerConnectionMonitor *self)
+{
+  self->entries = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)roger_connection_monitor_entry_free);
+
+  g_signal_connect_object (rm_object, "connection-changed", G_CALLBACK (roger_connection_monitor_connection_changed_cb), self, 0);
+}
+
+/**
+ * roger_connection_monitor_get_default:
+ *
+ * Returns: (transfer none): the connection monitor
+ */
+RogerConnectionMonitor *
+roger_connection_monitor_get_default (void)
+{
+  if (!default_monitor)
+    default_monitor = g_object_new (ROGER_TYPE_CONNECTION_MONITOR, NULL);
+
+  return default_monitor;
+}
+
+/**
+ * roger_connection_monitor_watch_call:
+ * @self: a #RogerConnectionMonitor
+ * @connection: a call connection
+ *
+ * Emits duration-changed for @connection until it is disconnected or
+ * unwatched.
+ */
+void
+roger_connection_monitor_watch_call (RogerConnectionMonitor *self,
+                                     RmConnection           *connection)
+{
+  roger_connection_monitor_add (self, connection);
+}
+
+/**
+ * roger_connection_monitor_watch_fax:
+ * @self: a #RogerConnectionMonitor
+ * @fax: fax device of @connection
+ * @connection: a fax connection
+ *
+ * Emits fax-status-changed and duration-changed for @connection until the
+ * transfer is released.
+ */
+void
+roger_connection_monitor_watch_fax (RogerConnectionMonitor *self,
+                                    RmFax                  *fax,
+                                    RmConnection           *connection)
+{
+  RogerConnectionMonitorEntry *entry = roger_connection_monitor_add (self, connection);
+
+  if (entry->fax)
+    return;
+
+  entry->fax = fax;
+  entry->status.phase = -1;
+  self->faxes++;
+
+  if (!self->fax_timer_id)
+    self->fax_timer_id = g_timeout_add (MONITOR_FAX_INTERVAL, roger_connection_monitor_fax_timer_cb, self);
+}
+
+/**
+ * roger_connection_monitor_unwatch:
+ * @self: a #RogerConnectionMonitor
+ * @connection: a watched connection
+ *
+ * Stops watching @connection, no signal is emitted for it anymore.
+ */
+void
+roger_connection_monitor_unwatch (RogerConnectionMonitor *self,
+                                  RmConnection           *connection)
+{
+  roger_connection_monitor_remove (self, connection);
+}
@@ -0,0 +1,35 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <glib-object.h>
+#include <rm/rm.h>
+
+G_BEGIN_DECLS
+
+#define ROGER_TYPE_CONNECTION_MONITOR (roger_connection_monitor_get_type ())
+
+G_DECLARE_FINAL_TYPE (RogerConnectionMonitor, roger_connection_monitor, ROGER, CONNECTION_MONITOR, GObject)
+
+RogerConnectionMonitor *roger_connection_monitor_get_default (void);
+
+void roger_connection_monitor_watch_call (RogerConnectionMonitor *self,
+                                          RmConnection           *connection);
+void roger_connection_monitor_watch_fax (RogerConnectionMonitor *self,
+                                         RmFax                  *fax,
+                                         RmConnection           *connection);
+void roger_connection_monitor_unwatch (RogerConnectionMonitor *self,
+                                       RmConnection           *connection);
+
+G_END_DECLS
@@ -0,0 +1,296 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "config.h"
+
+#include "roger-fax-cache.h"
+
+#include <errno.h>
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+#include <rm/rm.h>
+#include <stdio.h>
+
+/*
+ * Fax conversion cache
+ *
+ * Converted TIFFs are stored in the user cache dir under the SHA-256 of the
+ * print file contents and the fax resolution, so sending the same document
+ * again skips ghostscript. The modification time of a file is its last use,
+ * the least recently used files are evicted once the cache exceeds its size.
+ * Files handed out by a lookup or insert are pinned and never evicted until
+ * they are released again, they are about to be sent.
+ *
+ * Used from conversion threads, all file operations hold the cache lock.
+ */
+
+#define FAX_CACHE_DIR "fax"
+#define FAX_CACHE_SUFFIX ".tif"
+#define FAX_CACHE_READ_SIZE (64 * 1024)
+
+static GMutex fax_cache_mutex;
+static GHashTable *fax_cache_pinned = NULL;
+
+typedef struct {
+  char *path;
+  gint64 mtime;
+  goffset size;
+} RogerFaxCacheEntry;
+
+static void
+roger_fax_cache_entry_free (RogerFaxCacheEntry *entry)
+{
+  g_free (entry->path);
+  g_free (entry);
+}
+
+static gint
+roger_fax_cache_entry_compare (gconstpointer a,
+                               gconstpointer b)
+{
+  const RogerFaxCacheEntry *entry_a = *(RogerFaxCacheEntry **)a;
+  const RogerFaxCacheEntry *entry_b = *(RogerFaxCacheEntry **)b;
+
+  return entry_a->mtime < entry_b->mtime ? -1 : entry_a->mtime > entry_b->mtime;
+}
+
+static char *
+roger_fax_cache_get_dir (void)
+{
+  char *dir = g_build_filename (rm_get_user_cache_dir (), FAX_CACHE_DIR, NULL);
+
+  g_mkdir_with_parents (dir, 0700);
+
+  return dir;
+}
+
+static char *
+roger_fax_cache_get_path (const char *key)
+{
+  g_autofree char *dir = roger_fax_cache_get_dir ();
+  g_autofree char *name = g_strconcat (key, FAX_CACHE_SUFFIX, NULL);
+
+  return g_build_filename (dir, name, NULL);
+}
+
+static void
+roger_fax_cache_pin (const char *path)
+{
+  guint count;
+
+  if (!fax_cache_pinned)
+    fax_cache_pinned = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  count = GPOINTER_TO_UINT (g_hash_table_lookup (fax_cache_pinned, path));
+  g_hash_table_insert (fax_cache_pinned, g_strdup (path), GUINT_TO_POINTER (count + 1));
+}
+
+static void
+roger_fax_cache_trim (guint64 max_size)
+{
+  g_autofree char *dir_name = roger_fax_cache_get_dir ();
+  g_autoptr (GPtrArray) entries = g_ptr_array_new_with_free_func ((GDestroyNotify)roger_fax_cache_entry_free);
+  g_autoptr (GDir) dir = g_dir_open (dir_name, 0, NULL);
+  const char *name;
+  guint64 total = 0;
+  guint idx;
+
+  if (!dir)
+    return;
+
+  while ((name = g_dir_read_name (dir))) {
+    RogerFaxCacheEntry *entry;
+    GStatBuf buf;
+    char *path;
+
+    /* Skips temporary files of running conversions */
+    if (!g_str_has_suffix (name, FAX_CACHE_SUFFIX))
+      continue;
+
+    path = g_build_filename (dir_name, name, NULL);
+    if (g_stat (path, &buf) != 0) {
+      g_free (path);
+      continue;
+    }
+
+    entry = g_new0 (RogerFaxCacheEntry, 1);
+    entry->path = path;
+    entry->mtime = buf.st_mtime;
+    entry->size = buf.st_size;
+    total += buf.st_size;
+
+    g_ptr_array_add (entries, entry);
+  }
+
+  g_ptr_array_sort (entries, roger_fax_cache_entry_compare);
+
+  for (idx = 0; idx < entries->len && total > max_size; idx++) {
+    RogerFaxCacheEntry *entry = g_ptr_array_index (entries, idx);
+
+    if (g_hash_table_contains (fax_cache_pinned, entry->path))
+      continue;
+
+    g_debug ("%s(): Evicting %s", __FUNCTION__, entry->path);
+    if (g_unlink (entry->path) == 0)
+      total -= entry->size;
+  }
+}
+
+/**
+ * roger_fax_cache_get_key:
+ * @file: print file
+ * @resolution: fax resolution
+ * @cancellable: (nullable): a #GCancellable
+ * @error: return location for a #GError
+ *
+ * Hashes the contents of @file together with @resolution. Blocks, call it
+ * from a worker thread.
+ *
+ * Returns: (transfer full): the cache key or %NULL on error
+ */
+char *
+roger_fax_cache_get_key (const char    *file,
+                         gint           resolution,
+                         GCancellable  *cancellable,
+                         GError       **error)
+{
+  g_autoptr (GChecksum) checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  g_autofree guchar *buffer = g_malloc (FAX_CACHE_READ_SIZE);
+  gsize len;
+  FILE *fp;
+
+  fp = g_fopen (file, "rb");
+  if (!fp) {
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno), _("Could not open %s"), file);
+    return NULL;
+  }
+
+  while ((len = fread (buffer, 1, FAX_CACHE_READ_SIZE, fp)) > 0) {
+    if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+      fclose (fp);
+      return NULL;
+    }
+
+    g_checksum_update (checksum, buffer, len);
+  }
+
+  fclose (fp);
+
+  g_checksum_update (checksum, (guchar *)&resolution, sizeof (resolution));
+
+  return g_strdup (g_checksum_get_string (checksum));
+}
+
+/**
+ * roger_fax_cache_lookup:
+ * @key: cache key
+ *
+ * Looks up a converted file and marks it as recently used. The file is pinned
+ * until roger_fax_cache_release() is called.
+ *
+ * Returns: (transfer full): path of the cached TIFF or %NULL
+ */
+char *
+roger_fax_cache_lookup (const char *key)
+{
+  g_autofree char *path = roger_fax_cache_get_path (key);
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&fax_cache_mutex);
+
+  if (!g_file_test (path, G_FILE_TEST_IS_REGULAR))
+    return NULL;
+
+  g_utime (path, NULL);
+  roger_fax_cache_pin (path);
+
+  return g_steal_pointer (&path);
+}
+
+/**
+ * roger_fax_cache_new_temp_file:
+ * @error: return location for a #GError
+ *
+ * Creates an empty file in the cache dir for a running conversion. It is
+ * not considered by the cache until it is inserted.
+ *
+ * Returns: (transfer full): path of the temporary file or %NULL on error
+ */
+char *
+roger_fax_cache_new_temp_file (GError **error)
+{
+  g_autofree char *dir = roger_fax_cache_get_dir ();
+  g_autofree char *path = g_build_filename (dir, "convert-XXXXXX", NULL);
+  gint fd;
+
+  fd = g_mkstemp (path);
+  if (fd == -1) {
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno), _("Could not create %s"), path);
+    return NULL;
+  }
+
+  g_close (fd, NULL);
+
+  return g_steal_pointer (&path);
+}
+
+/**
+ * roger_fax_cache_insert:
+ * @key: cache key
+ * @file: converted TIFF, moved into the cache
+ * @max_size: cache size in bytes, older files are evicted beyond it
+ * @error: return location for a #GError
+ *
+ * The cached file is pinned until roger_fax_cache_release() is called.
+ *
+ * Returns: (transfer full): path of the cached TIFF or %NULL on error
+ */
+char *
+roger_fax_cache_insert (const char  *key,
+                        const char  *file,
+                        guint64      max_size,
+                        GError     **error)
+{
+  g_autofree char *path = roger_fax_cache_get_path (key);
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&fax_cache_mutex);
+
+  if (g_rename (file, path) != 0) {
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno), _("Could not create %s"), path);
+    return NULL;
+  }
+
+  roger_fax_cache_pin (path);
+  roger_fax_cache_trim (max_size);
+
+  return g_steal_pointer (&path);
+}
+
+/**
+ * roger_fax_cache_release:
+ * @file: path returned by roger_fax_cache_lookup() or roger_fax_cache_insert()
+ *
+ * Unpins @file, it may be evicted afterwards.
+ */
+void
+roger_fax_cache_release (const char *file)
+{
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&fax_cache_mutex);
+  guint count;
+
+  if (!file || !fax_cache_pinned)
+    return;
+
+  count = GPOINTER_TO_UINT (g_hash_table_lookup (fax_cache_pinned, file));
+  if (count > 1)
+    g_hash_table_insert (fax_cache_pinned, g_strdup (file), GUINT_TO_POINTER (count - 1));
+  else
+    g_hash_table_remove (fax_cache_pinned, file);
+}
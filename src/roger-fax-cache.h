@@ -0,0 +1,33 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+char *roger_fax_cache_get_key (const char    *file,
+                               gint           resolution,
+                               GCancellable  *cancellable,
+                               GError       **error);
+
+char *roger_fax_cache_lookup (const char *key);
+char *roger_fax_cache_new_temp_file (GError **error);
+char *roger_fax_cache_insert (const char  *key,
+                              const char  *file,
+                              guint64      max_size,
+                              GError     **error);
+void roger_fax_cache_release (const char *file);
+
+G_END_DECLS
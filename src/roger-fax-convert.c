@@ -0,0 +1,824 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "config.h"
+
+#include "roger-fax-convert.h"
+
+#include "roger-fax-cache.h"
+#include "roger-settings.h"
+
+#include <ghostscript/iapi.h>
+#include <ghostscript/ierrors.h>
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+#include <rm/rm.h>
+#include <stdio.h>
+#include <string.h>
+#include <tiffio.h>
+
+/*
+ * Fax conversion
+ *
+ * Print files are rasterized to a G4 TIFF by a conversion service: worker
+ * threads which each own a ghostscript instance and take jobs from a shared
+ * queue. Instances are initialized once and kept warm between jobs, so a
+ * burst of faxes does not pay for ghostscript startup and resource loading
+ * every time. Each job runs encapsulated in save and restore: it selects the
+ * tiffg4 device with its own output file and resolution and runs the input,
+ * the restore then drops its definitions, page device parameters and
+ * transfer function again and closes the device. File access is granted to
+ * the instance for the duration of the job only. An instance which failed a
+ * job, including its restore, is discarded and recreated for the next one,
+ * idle instances are released after a while.
+ *
+ * The page messages ghostscript writes to stdout are parsed and forwarded to
+ * the main thread as progress, the poll callback aborts the interpreter once
+ * the cancellable is triggered.
+ *
+ * Longer PDF documents are split into page ranges which are rasterized by
+ * several workers in parallel. The G4 strips of the resulting files are
+ * copied into the final multi-page TIFF without decoding them.
+ *
+ * Ghostscript builds without thread safety only allow one instance per
+ * process. This is probed once, such builds run a single worker.
+ *
+ * Results are stored in the fax cache, documents sent before are returned
+ * right away.
+ */
+
+#define CONVERT_MIN_PAGES_PER_RANGE 4
+#define CONVERT_IDLE_TIMEOUT (5 * 60 * G_USEC_PER_SEC)
+
+typedef enum {
+  ROGER_FAX_CONVERT_JOB_COUNT,
+  ROGER_FAX_CONVERT_JOB_RENDER
+} RogerFaxConvertJobType;
+
+typedef struct {
+  char *file;
+  char *out_file;
+  gint resolution;
+  guint64 cache_size;
+
+  GCancellable *cancellable;
+  RogerFaxConvertProgressFunc progress_func;
+  gpointer progress_data;
+
+  gint page;
+  gint pages;
+
+  GMutex mutex;
+  GCond cond;
+  gint pending;
+} RogerFaxConvertData;
+
+typedef struct {
+  RogerFaxConvertData *data;
+  RogerFaxConvertJobType type;
+  char *out_file;
+  gint first_page;
+  gint last_page;
+
+  GString *line;
+  gint pages;
+  GError *error;
+} RogerFaxConvertJob;
+
+typedef struct {
+  void *minst;
+  RogerFaxConvertJob *job;
+} RogerFaxConvertWorker;
+
+typedef struct {
+  GCancellable *cancellable;
+  RogerFaxConvertProgressFunc progress_func;
+  gpointer progress_data;
+  gint page;
+  gint pages;
+} RogerFaxConvertProgress;
+
+static GAsyncQueue *convert_queue = NULL;
+static guint convert_workers = 0;
+
+static void
+roger_fax_convert_data_free (RogerFaxConvertData *data)
+{
+  g_cond_clear (&data->cond);
+  g_mutex_clear (&data->mutex);
+  g_clear_object (&data->cancellable);
+  g_free (data->out_file);
+  g_free (data->file);
+  g_free (data);
+}
+
+static RogerFaxConvertJob *
+roger_fax_convert_job_new (RogerFaxConvertData    *data,
+                           RogerFaxConvertJobType  type)
+{
+  RogerFaxConvertJob *job = g_new0 (RogerFaxConvertJob, 1);
+
+  job->data = data;
+  job->type = type;
+  job->line = g_string_new (NULL);
+
+  return job;
+}
+
+static void
+roger_fax_convert_job_free (RogerFaxConvertJob *job)
+{
+  g_clear_error (&job->error);
+  g_string_free (job->line, TRUE);
+  g_free (job->out_file);
+  g_free (job);
+}
+
+static void
+roger_fax_convert_progress_free (RogerFaxConvertProgress *progress)
+{
+  g_object_unref (progress->cancellable);
+  g_free (progress);
+}
+
+static gboolean
+roger_fax_convert_progress_cb (gpointer user_data)
+{
+  RogerFaxConvertProgress *progress = user_data;
+
+  /* A cancelled conversion must not call back into a closed window */
+  if (!g_cancellable_is_cancelled (progress->cancellable))
+    progress->progress_func (progress->page, progress->pages, progress->progress_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+roger_fax_convert_parse_line (RogerFaxConvertJob *job,
+                              const char         *line)
+{
+  RogerFaxConvertData *data = job->data;
+  RogerFaxConvertProgress *progress;
+  gint first;
+  gint last;
+  gint page;
+
+  if (job->type == ROGER_FAX_CONVERT_JOB_COUNT) {
+    sscanf (line, "%d", &job->pages);
+    return;
+  }
+
+  /* Written by the PDF interpreter, PostScript input reports nothing */
+  if (sscanf (line, "Processing pages %d through %d.", &first, &last) == 2) {
+    /* Split documents know their page count already */
+    if (job->first_page == 0)
+      g_atomic_int_set (&data->pages, last - first + 1);
+    return;
+  }
+
+  if (sscanf (line, "Page %d", &page) != 1)
+    return;
+
+  page = g_atomic_int_add (&data->page, 1) + 1;
+
+  if (!data->progress_func)
+    return;
+
+  progress = g_new0 (RogerFaxConvertProgress, 1);
+  progress->cancellable = g_object_ref (data->cancellable);
+  progress->progress_func = data->progress_func;
+  progress->progress_data = data->progress_data;
+  progress->page = page;
+  progress->pages = g_atomic_int_get (&data->pages);
+
+  g_main_context_invoke_full (NULL,
+                              G_PRIORITY_DEFAULT,
+                              roger_fax_convert_progress_cb,
+                              progress,
+                              (GDestroyNotify)roger_fax_convert_progress_free);
+}
+
+static int GSDLLCALL
+roger_fax_convert_stdout_cb (void       *caller_handle,
+                             const char *str,
+                             int         len)
+{
+  RogerFaxConvertWorker *worker = caller_handle;
+  RogerFaxConvertJob *job = worker->job;
+  char *newline;
+
+  /* Startup banner */
+  if (!job)
+    return len;
+
+  g_string_append_len (job->line, str, len);
+
+  while ((newline = strchr (job->line->str, '\n'))) {
+    *newline = '\0';
+    roger_fax_convert_parse_line (job, job->line->str);
+    g_string_erase (job->line, 0, newline - job->line->str + 1);
+  }
+
+  return len;
+}
+
+static int GSDLLCALL
+roger_fax_convert_stderr_cb (void       *caller_handle,
+                             const char *str,
+                             int         len)
+{
+  g_debug ("%s(): %.*s", __FUNCTION__, len, str);
+
+  return len;
+}
+
+static int GSDLLCALL
+roger_fax_convert_poll_cb (void *caller_handle)
+{
+  RogerFaxConvertWorker *worker = caller_handle;
+
+  if (worker->job && g_cancellable_is_cancelled (worker->job->data->cancellable))
+    return gs_error_interrupt;
+
+  return 0;
+}
+
+static gboolean
+roger_fax_convert_is_pdf (const char *file)
+{
+  char buffer[1024];
+  FILE *fp;
+  gsize len;
+
+  fp = g_fopen (file, "rb");
+  if (!fp)
+    return FALSE;
+
+  len = fread (buffer, 1, sizeof (buffer) - 1, fp);
+  fclose (fp);
+  buffer[len] = '\0';
+
+  /* The header may follow some garbage within the first kilobyte */
+  return g_strstr_len (buffer, len, "%PDF-") != NULL;
+}
+
+static char *
+roger_fax_convert_ps_string (const char *str)
+{
+  GString *escaped = g_string_new ("(");
+
+  for (; *str; str++) {
+    if (*str == '(' || *str == ')' || *str == '\\')
+      g_string_append_c (escaped, '\\');
+    g_string_append_c (escaped, *str);
+  }
+
+  g_string_append_c (escaped, ')');
+
+  return g_string_free (escaped, FALSE);
+}
+
+static char *
+roger_fax_convert_job_get_command (RogerFaxConvertJob *job)
+{
+  RogerFaxConvertData *data = job->data;
+  g_autofree char *file = roger_fax_convert_ps_string (data->file);
+  g_autofree char *out_file = NULL;
+  GString *command = g_string_new (NULL);
+
+  /* Everything the job changes is undone by the restore at the end */
+  g_string_append (command, "/RogerFaxJobSave save def\n");
+
+  if (job->type == ROGER_FAX_CONVERT_JOB_COUNT) {
+    g_string_append_printf (command, "%s (r) file runpdfbegin pdfpagecount = flush runpdfend\n", file);
+    g_string_append (command, "RogerFaxJobSave restore\n");
+    return g_string_free (command, FALSE);
+  }
+
+  /* Page selection of the PDF interpreter */
+  g_string_append (command, "/PDFFitPage true def\n");
+  if (job->first_page > 0)
+    g_string_append_printf (command, "/FirstPage %d def /LastPage %d def\n", job->first_page, job->last_page);
+
+  out_file = roger_fax_convert_ps_string (job->out_file);
+  g_string_append (command, "(tiffg4) selectdevice\n");
+  g_string_append_printf (command, "<< /OutputFile %s /MaxStripSize 0 /HWResolution ", out_file);
+
+  switch (data->resolution) {
+    case 2:
+      /* Super - fine */
+      g_string_append (command, "[204 392]");
+      break;
+    case 1:
+      /* Fine */
+      g_string_append (command, "[204 196]");
+      break;
+    default:
+      /* Standard */
+      g_string_append (command, "[204 98]");
+      break;
+  }
+  g_string_append (command, " >> setpagedevice\n");
+
+  /* improved dithering pattern as proposed in this ghostscript ticket:
+   * https://bugs.ghostscript.com/show_bug.cgi?id=694762#c3
+   */
+  g_string_append (command, "(stocht.ps) runlibfile\n");
+
+  /* set everything below 25% brightness to black and everything above 75% brightness to white. This improves that readability of faxes which contain grayscale or color scans.
+   */
+  g_string_append (command, "{ dup .25 lt { pop 0 } if dup .75 gt { pop 1 } if } settransfer\n");
+
+  /* The device was selected after the save, so the restore drops the last
+   * reference to it and closes the output file
+   */
+  g_string_append_printf (command, "%s run\nRogerFaxJobSave restore\n", file);
+
+  return g_string_free (command, FALSE);
+}
+
+/* Output files are created empty by the fax cache, a closed device leaves a complete TIFF */
+static gboolean
+roger_fax_convert_has_output (const char *file)
+{
+  TIFF *tiff;
+  gboolean ret;
+
+  tiff = TIFFOpen (file, "r");
+  if (!tiff)
+    return FALSE;
+
+  ret = TIFFNumberOfDirectories (tiff) > 0;
+  TIFFClose (tiff);
+
+  return ret;
+}
+
+static void
+roger_fax_convert_worker_stop (RogerFaxConvertWorker *worker)
+{
+  if (!worker->minst)
+    return;
+
+  gsapi_exit (worker->minst);
+  gsapi_delete_instance (worker->minst);
+  worker->minst = NULL;
+}
+
+static gboolean
+roger_fax_convert_worker_start (RogerFaxConvertWorker  *worker,
+                                GError                **error)
+{
+  char *args[] = { "gs", "-dNOPAUSE", "-dSAFER", "-dNODISPLAY", "-Ilib", NULL };
+  gint ret;
+
+  ret = gsapi_new_instance (&worker->minst, worker);
+  if (ret < 0) {
+    worker->minst = NULL;
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, _("Could not start ghostscript (%d)"), ret);
+    return FALSE;
+  }
+
+  gsapi_set_stdio (worker->minst, NULL, roger_fax_convert_stdout_cb, roger_fax_convert_stderr_cb);
+  gsapi_set_poll (worker->minst, roger_fax_convert_poll_cb);
+  gsapi_set_arg_encoding (worker->minst, GS_ARG_ENCODING_UTF8);
+
+  ret = gsapi_init_with_args (worker->minst, G_N_ELEMENTS (args) - 1, args);
+  if (ret < 0) {
+    roger_fax_convert_worker_stop (worker);
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, _("Could not start ghostscript (%d)"), ret);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+roger_fax_convert_worker_run (RogerFaxConvertWorker  *worker,
+                              RogerFaxConvertJob     *job,
+                              GError                **error)
+{
+  RogerFaxConvertData *data = job->data;
+  g_autofree char *command = NULL;
+  gint exit_code;
+  gint ret;
+
+  if (g_cancellable_set_error_if_cancelled (data->cancellable, error))
+    return FALSE;
+
+  if (!worker->minst && !roger_fax_convert_worker_start (worker, error))
+    return FALSE;
+
+  command = roger_fax_convert_job_get_command (job);
+
+  gsapi_add_control_path (worker->minst, GS_PERMIT_FILE_READING, data->file);
+  if (job->out_file)
+    gsapi_add_control_path (worker->minst, GS_PERMIT_FILE_WRITING, job->out_file);
+
+  worker->job = job;
+  ret = gsapi_run_string (worker->minst, command, 0, &exit_code);
+  worker->job = NULL;
+
+  if (job->out_file)
+    gsapi_remove_control_path (worker->minst, GS_PERMIT_FILE_WRITING, job->out_file);
+  gsapi_remove_control_path (worker->minst, GS_PERMIT_FILE_READING, data->file);
+
+  /* The interpreter state is unknown after an error, start over next time */
+  if (ret < 0)
+    roger_fax_convert_worker_stop (worker);
+
+  if (g_cancellable_set_error_if_cancelled (data->cancellable, error))
+    return FALSE;
+
+  if (ret < 0 || (job->out_file && !roger_fax_convert_has_output (job->out_file))) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, _("Error converting print file to FAX format (%d)"), ret);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gpointer
+roger_fax_convert_worker_thread (gpointer user_data)
+{
+  RogerFaxConvertWorker worker = { NULL, NULL };
+
+  while (TRUE) {
+    RogerFaxConvertJob *job;
+    RogerFaxConvertData *data;
+
+    job = g_async_queue_timeout_pop (convert_queue, CONVERT_IDLE_TIMEOUT);
+    if (!job) {
+      roger_fax_convert_worker_stop (&worker);
+      job = g_async_queue_pop (convert_queue);
+    }
+
+    data = job->data;
+    roger_fax_convert_worker_run (&worker, job, &job->error);
+
+    g_mutex_lock (&data->mutex);
+    data->pending--;
+    g_cond_signal (&data->cond);
+    g_mutex_unlock (&data->mutex);
+  }
+
+  return NULL;
+}
+
+static gboolean
+roger_fax_convert_multiple_instances (void)
+{
+  void *first = NULL;
+  void *second = NULL;
+  gboolean supported = FALSE;
+
+  if (gsapi_new_instance (&first, NULL) >= 0) {
+    supported = gsapi_new_instance (&second, NULL) >= 0;
+
+    if (supported)
+      gsapi_delete_instance (second);
+    gsapi_delete_instance (first);
+  }
+
+  return supported;
+}
+
+static void
+roger_fax_convert_service_start (void)
+{
+  static gsize started = 0;
+
+  if (g_once_init_enter (&started)) {
+    guint idx;
+
+    /* Probed before any worker owns an instance */
+    convert_workers = roger_fax_convert_multiple_instances () ? g_get_num_processors () : 1;
+    convert_queue = g_async_queue_new ();
+
+    for (idx = 0; idx < convert_workers; idx++)
+      g_thread_unref (g_thread_new ("fax-convert", roger_fax_convert_worker_thread, NULL));
+
+    g_debug ("%s(): Started %u workers", __FUNCTION__, convert_workers);
+    g_once_init_leave (&started, 1);
+  }
+}
+
+static void
+roger_fax_convert_run_jobs (RogerFaxConvertData *data,
+                            GPtrArray           *jobs)
+{
+  guint idx;
+
+  g_mutex_lock (&data->mutex);
+  data->pending += jobs->len;
+  g_mutex_unlock (&data->mutex);
+
+  for (idx = 0; idx < jobs->len; idx++)
+    g_async_queue_push (convert_queue, g_ptr_array_index (jobs, idx));
+
+  g_mutex_lock (&data->mutex);
+  while (data->pending > 0)
+    g_cond_wait (&data->cond, &data->mutex);
+  g_mutex_unlock (&data->mutex);
+}
+
+static gint
+roger_fax_convert_count_pages (RogerFaxConvertData *data)
+{
+  g_autoptr (GPtrArray) jobs = g_ptr_array_new_with_free_func ((GDestroyNotify)roger_fax_convert_job_free);
+  RogerFaxConvertJob *job = roger_fax_convert_job_new (data, ROGER_FAX_CONVERT_JOB_COUNT);
+
+  g_ptr_array_add (jobs, job);
+  roger_fax_convert_run_jobs (data, jobs);
+
+  return job->error ? 0 : job->pages;
+}
+
+static gboolean
+roger_fax_convert_copy_page (TIFF    *in,
+                             TIFF    *out,
+                             guint16  page,
+                             guint16  pages)
+{
+  static const ttag_t short_tags[] = {
+    TIFFTAG_BITSPERSAMPLE, TIFFTAG_COMPRESSION, TIFFTAG_PHOTOMETRIC, TIFFTAG_FILLORDER,
+    TIFFTAG_ORIENTATION, TIFFTAG_SAMPLESPERPIXEL, TIFFTAG_PLANARCONFIG, TIFFTAG_RESOLUTIONUNIT
+  };
+  static const ttag_t long_tags[] = {
+    TIFFTAG_IMAGEWIDTH, TIFFTAG_IMAGELENGTH, TIFFTAG_ROWSPERSTRIP, TIFFTAG_GROUP4OPTIONS
+  };
+  static const ttag_t float_tags[] = {
+    TIFFTAG_XRESOLUTION, TIFFTAG_YRESOLUTION
+  };
+  g_autofree guint8 *buffer = NULL;
+  tmsize_t buffer_size = 0;
+  tstrip_t strip;
+  guint idx;
+
+  for (idx = 0; idx < G_N_ELEMENTS (short_tags); idx++) {
+    guint16 value;
+
+    if (TIFFGetField (in, short_tags[idx], &value))
+      TIFFSetField (out, short_tags[idx], value);
+  }
+
+  for (idx = 0; idx < G_N_ELEMENTS (long_tags); idx++) {
+    guint32 value;
+
+    if (TIFFGetField (in, long_tags[idx], &value))
+      TIFFSetField (out, long_tags[idx], value);
+  }
+
+  for (idx = 0; idx < G_N_ELEMENTS (float_tags); idx++) {
+    float value;
+
+    if (TIFFGetField (in, float_tags[idx], &value))
+      TIFFSetField (out, float_tags[idx], value);
+  }
+
+  TIFFSetField (out, TIFFTAG_SUBFILETYPE, FILETYPE_PAGE);
+  TIFFSetField (out, TIFFTAG_PAGENUMBER, page, pages);
+
+  /* G4 data is copied as is, no need to decode it */
+  for (strip = 0; strip < TIFFNumberOfStrips (in); strip++) {
+    tmsize_t size = TIFFRawStripSize (in, strip);
+
+    if (size < 0)
+      return FALSE;
+
+    if (size > buffer_size) {
+      buffer = g_realloc (buffer, size);
+      buffer_size = size;
+    }
+
+    if (TIFFReadRawStrip (in, strip, buffer, size) < 0 || TIFFWriteRawStrip (out, strip, buffer, size) < 0)
+      return FALSE;
+  }
+
+  return TIFFWriteDirectory (out);
+}
+
+static gboolean
+roger_fax_convert_merge (RogerFaxConvertData  *data,
+                         GPtrArray            *jobs,
+                         GError              **error)
+{
+  TIFF *out;
+  gboolean ret = TRUE;
+  guint16 page = 0;
+  guint idx;
+
+  out = TIFFOpen (data->out_file, "w");
+  if (!out) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, _("Could not create %s"), data->out_file);
+    return FALSE;
+  }
+
+  for (idx = 0; ret && idx < jobs->len; idx++) {
+    RogerFaxConvertJob *job = g_ptr_array_index (jobs, idx);
+    TIFF *in = TIFFOpen (job->out_file, "r");
+
+    if (!in) {
+      ret = FALSE;
+      break;
+    }
+
+    do {
+      ret = roger_fax_convert_copy_page (in, out, page++, data->pages);
+    } while (ret && TIFFReadDirectory (in));
+
+    TIFFClose (in);
+  }
+
+  TIFFClose (out);
+
+  if (!ret)
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, _("Could not merge fax pages"));
+
+  return ret;
+}
+
+static gboolean
+roger_fax_convert_run (RogerFaxConvertData  *data,
+                       GError              **error)
+{
+  g_autoptr (GPtrArray) jobs = g_ptr_array_new_with_free_func ((GDestroyNotify)roger_fax_convert_job_free);
+  gint count = 1;
+  gboolean ret = TRUE;
+  gint idx;
+
+  roger_fax_convert_service_start ();
+
+  if (convert_workers > 1 && roger_fax_convert_is_pdf (data->file))
+    data->pages = roger_fax_convert_count_pages (data);
+
+  if (data->pages >= 2 * CONVERT_MIN_PAGES_PER_RANGE)
+    count = MIN ((gint)convert_workers, data->pages / CONVERT_MIN_PAGES_PER_RANGE);
+
+  for (idx = 0; idx < count; idx++) {
+    RogerFaxConvertJob *job = roger_fax_convert_job_new (data, ROGER_FAX_CONVERT_JOB_RENDER);
+
+    if (count == 1) {
+      job->out_file = g_strdup (data->out_file);
+    } else {
+      job->out_file = g_strdup_printf ("%s.%d", data->out_file, idx);
+      job->first_page = idx * data->pages / count + 1;
+      job->last_page = (idx + 1) * data->pages / count;
+    }
+
+    g_ptr_array_add (jobs, job);
+  }
+
+  g_debug ("%s(): Converting %d pages in %d ranges", __FUNCTION__, data->pages, count);
+
+  roger_fax_convert_run_jobs (data, jobs);
+
+  for (idx = 0; idx < count; idx++) {
+    RogerFaxConvertJob *job = g_ptr_array_index (jobs, idx);
+
+    if (job->error) {
+      g_propagate_error (error, g_steal_pointer (&job->error));
+      ret = FALSE;
+      break;
+    }
+  }
+
+  if (ret && count > 1)
+    ret = roger_fax_convert_merge (data, jobs, error);
+
+  if (count > 1) {
+    for (idx = 0; idx < count; idx++) {
+      RogerFaxConvertJob *job = g_ptr_array_index (jobs, idx);
+
+      g_unlink (job->out_file);
+    }
+  }
+
+  return ret;
+}
+
+/* A result which is never propagated, e.g. of a cancelled task, gives up its pin */
+static void
+roger_fax_convert_result_free (char *file)
+{
+  roger_fax_cache_release (file);
+  g_free (file);
+}
+
+static void
+roger_fax_convert_thread (GTask        *task,
+                          gpointer      source_object,
+                          gpointer      task_data,
+                          GCancellable *cancellable)
+{
+  RogerFaxConvertData *data = task_data;
+  g_autofree char *key = NULL;
+  char *cached;
+  GError *error = NULL;
+
+  key = roger_fax_cache_get_key (data->file, data->resolution, data->cancellable, &error);
+  if (!key) {
+    g_task_return_error (task, error);
+    return;
+  }
+
+  if (data->cache_size > 0) {
+    cached = roger_fax_cache_lookup (key);
+    if (cached) {
+      g_debug ("%s(): Using cached conversion %s", __FUNCTION__, cached);
+      g_task_return_pointer (task, cached, (GDestroyNotify)roger_fax_convert_result_free);
+      return;
+    }
+  }
+
+  data->out_file = roger_fax_cache_new_temp_file (&error);
+  if (!data->out_file) {
+    g_task_return_error (task, error);
+    return;
+  }
+
+  if (!roger_fax_convert_run (data, &error)) {
+    g_unlink (data->out_file);
+    g_task_return_error (task, error);
+    return;
+  }
+
+  cached = roger_fax_cache_insert (key, data->out_file, data->cache_size, &error);
+  if (!cached) {
+    g_unlink (data->out_file);
+    g_task_return_error (task, error);
+    return;
+  }
+
+  g_task_return_pointer (task, cached, (GDestroyNotify)roger_fax_convert_result_free);
+}
+
+/**
+ * roger_fax_convert_async:
+ * @file: print file (PDF or PostScript)
+ * @resolution: fax resolution, 0 standard, 1 fine, 2 super-fine
+ * @progress_func: (nullable): called on the main thread for every rasterized page
+ * @progress_data: user data for @progress_func
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: called once the conversion is finished
+ * @user_data: user data for @callback
+ *
+ * Converts @file to a G4 TIFF in the fax cache on a worker thread. The
+ * returned file is owned by the cache and must not be removed, release it
+ * with roger_fax_cache_release() once it is not needed anymore. If the
+ * conversion completes after @cancellable was cancelled, the file is released
+ * again when the result is dropped. The
+ * page count passed to @progress_func is 0 if the input does not announce it.
+ * @progress_func is not called anymore once @cancellable is cancelled.
+ */
+void
+roger_fax_convert_async (const char                  *file,
+                         gint                         resolution,
+                         RogerFaxConvertProgressFunc  progress_func,
+                         gpointer                     progress_data,
+                         GCancellable                *cancellable,
+                         GAsyncReadyCallback          callback,
+                         gpointer                     user_data)
+{
+  g_autoptr (GTask) task = g_task_new (NULL, cancellable, callback, user_data);
+  RogerFaxConvertData *data = g_new0 (RogerFaxConvertData, 1);
+
+  data->file = g_strdup (file);
+  data->resolution = resolution;
+  data->cache_size = (guint64)g_settings_get_uint (ROGER_SETTINGS_MAIN, ROGER_PREFS_FAX_CACHE_SIZE) * 1024 * 1024;
+  data->cancellable = cancellable ? g_object_ref (cancellable) : g_cancellable_new ();
+  data->progress_func = progress_func;
+  data->progress_data = progress_data;
+  g_mutex_init (&data->mutex);
+  g_cond_init (&data->cond);
+
+  g_task_set_source_tag (task, roger_fax_convert_async);
+  g_task_set_task_data (task, data, (GDestroyNotify)roger_fax_convert_data_free);
+  g_task_run_in_thread (task, roger_fax_convert_thread);
+}
+
+/**
+ * roger_fax_convert_finish:
+ * @result: a #GAsyncResult
+ * @error: return location for a #GError
+ *
+ * Returns: (transfer full): file name of the converted TIFF or %NULL on error
+ */
+char *
+roger_fax_convert_finish (GAsyncResult  *result,
+                          GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
@@ -0,0 +1,34 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef void (*RogerFaxConvertProgressFunc) (gint     page,
+                                             gint     pages,
+                                             gpointer user_data);
+
+void roger_fax_convert_async (const char                  *file,
+                              gint                         resolution,
+                              RogerFaxConvertProgressFunc  progress_func,
+                              gpointer                     progress_data,
+                              GCancellable                *cancellable,
+                              GAsyncReadyCallback          callback,
+                              gpointer                     user_data);
+char *roger_fax_convert_finish (GAsyncResult  *result,
+                                GError       **error);
+
+G_END_DECLS
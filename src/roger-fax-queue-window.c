@@ -0,0 +1,203 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "config.h"
+
+#include "roger-fax-queue-window.h"
+
+#include "roger-fax-queue.h"
+
+/*
+ * Fax queue window
+ *
+ * Lists the jobs of the fax queue with their state. Rows follow their job on
+ * the next frame, failed jobs can be sent again and every job can be removed.
+ */
+
+#define ROGER_TYPE_FAX_QUEUE_ROW (roger_fax_queue_row_get_type ())
+
+G_DECLARE_FINAL_TYPE (RogerFaxQueueRow, roger_fax_queue_row, ROGER, FAX_QUEUE_ROW, GtkListBoxRow)
+
+struct _RogerFaxQueueRow {
+  GtkListBoxRow parent_instance;
+
+  GtkWidget *number_label;
+  GtkWidget *file_label;
+  GtkWidget *status_label;
+  GtkWidget *retry_button;
+
+  RogerFaxJob *job;
+  guint tick_id;
+};
+
+G_DEFINE_TYPE (RogerFaxQueueRow, roger_fax_queue_row, GTK_TYPE_LIST_BOX_ROW)
+
+struct _RogerFaxQueueWindow {
+  HdyWindow parent_instance;
+
+  GtkWidget *listbox;
+};
+
+G_DEFINE_TYPE (RogerFaxQueueWindow, roger_fax_queue_window, HDY_TYPE_WINDOW)
+
+static void
+roger_fax_queue_row_update (RogerFaxQueueRow *self)
+{
+  g_autofree char *status = roger_fax_job_get_status_text (self->job);
+
+  gtk_label_set_text (GTK_LABEL (self->status_label), status);
+  gtk_widget_set_visible (self->retry_button, roger_fax_job_get_state (self->job) == ROGER_FAX_JOB_STATE_FAILED);
+}
+
+static gboolean
+roger_fax_queue_row_tick_cb (GtkWidget     *widget,
+                             GdkFrameClock *frame_clock,
+                             gpointer       user_data)
+{
+  RogerFaxQueueRow *self = ROGER_FAX_QUEUE_ROW (widget);
+
+  self->tick_id = 0;
+  roger_fax_queue_row_update (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+roger_fax_queue_row_changed_cb (RogerFaxQueueRow *self)
+{
+  /* Job changes are applied once per frame */
+  if (self->tick_id)
+    return;
+
+  self->tick_id = gtk_widget_add_tick_callback (GTK_WIDGET (self), roger_fax_queue_row_tick_cb, NULL, NULL);
+}
+
+static void
+roger_fax_queue_row_retry_clicked_cb (GtkWidget        *button,
+                                      RogerFaxQueueRow *self)
+{
+  roger_fax_queue_retry (roger_fax_queue_get_default (), self->job);
+}
+
+static void
+roger_fax_queue_row_remove_clicked_cb (GtkWidget        *button,
+                                       RogerFaxQueueRow *self)
+{
+  roger_fax_queue_remove (roger_fax_queue_get_default (), self->job);
+}
+
+static void
+roger_fax_queue_row_dispose (GObject *object)
+{
+  RogerFaxQueueRow *self = ROGER_FAX_QUEUE_ROW (object);
+
+  if (self->tick_id) {
+    gtk_widget_remove_tick_callback (GTK_WIDGET (self), self->tick_id);
+    self->tick_id = 0;
+  }
+  g_clear_object (&self->job);
+
+  G_OBJECT_CLASS (roger_fax_queue_row_parent_class)->dispose (object);
+}
+
+static void
+roger_fax_queue_row_class_init (RogerFaxQueueRowClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+
+  object_class->dispose = roger_fax_queue_row_dispose;
+
+  gtk_widget_class_set_template_from_resource (widget_class, "/org/tabos/roger/ui/fax-queue-row.ui");
+
+  gtk_widget_class_bind_template_child (widget_class, RogerFaxQueueRow, number_label);
+  gtk_widget_class_bind_template_child (widget_class, RogerFaxQueueRow, file_label);
+  gtk_widget_class_bind_template_child (widget_class, RogerFaxQueueRow, status_label);
+  gtk_widget_class_bind_template_child (widget_class, RogerFaxQueueRow, retry_button);
+
+  gtk_widget_class_bind_template_callback (widget_class, roger_fax_queue_row_retry_clicked_cb);
+  gtk_widget_class_bind_template_callback (widget_class, roger_fax_queue_row_remove_clicked_cb);
+}
+
+static void
+roger_fax_queue_row_init (RogerFaxQueueRow *self)
+{
+  gtk_widget_init_template (GTK_WIDGET (self));
+}
+
+static GtkWidget *
+roger_fax_queue_row_new (RogerFaxJob *job)
+{
+  RogerFaxQueueRow *self = g_object_new (ROGER_TYPE_FAX_QUEUE_ROW, NULL);
+  g_autofree char *basename = g_path_get_basename (roger_fax_job_get_file (job));
+
+  self->job = g_object_ref (job);
+
+  gtk_label_set_text (GTK_LABEL (self->number_label), roger_fax_job_get_number (job));
+  gtk_label_set_text (GTK_LABEL (self->file_label), basename);
+
+  g_signal_connect_object (job, "changed", G_CALLBACK (roger_fax_queue_row_changed_cb), self, G_CONNECT_SWAPPED);
+  roger_fax_queue_row_update (self);
+
+  return GTK_WIDGET (self);
+}
+
+static GtkWidget *
+roger_fax_queue_window_create_row (gpointer item,
+                                   gpointer user_data)
+{
+  return roger_fax_queue_row_new (ROGER_FAX_JOB (item));
+}
+
+static void
+roger_fax_queue_window_clear_clicked_cb (GtkWidget *button,
+                                         gpointer   user_data)
+{
+  roger_fax_queue_clear_finished (roger_fax_queue_get_default ());
+}
+
+static void
+roger_fax_queue_window_class_init (RogerFaxQueueWindowClass *klass)
+{
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+
+  gtk_widget_class_set_template_from_resource (widget_class, "/org/tabos/roger/ui/fax-queue.ui");
+
+  gtk_widget_class_bind_template_child (widget_class, RogerFaxQueueWindow, listbox);
+
+  gtk_widget_class_bind_template_callback (widget_class, roger_fax_queue_window_clear_clicked_cb);
+}
+
+static void
+roger_fax_queue_window_init (RogerFaxQueueWindow *self)
+{
+  gtk_widget_init_template (GTK_WIDGET (self));
+
+  gtk_list_box_bind_model (GTK_LIST_BOX (self->listbox),
+                           roger_fax_queue_get_jobs (roger_fax_queue_get_default ()),
+                           roger_fax_queue_window_create_row,
+                           NULL,
+                           NULL);
+}
+
+/**
+ * roger_fax_queue_window_new:
+ * @parent: transient parent
+ *
+ * Returns: a new fax queue window
+ */
+GtkWidget *
+roger_fax_queue_window_new (GtkWindow *parent)
+{
+  return g_object_new (ROGER_TYPE_FAX_QUEUE_WINDOW, "transient-for", parent, NULL);
+}
@@ -0,0 +1,563 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "config.h"
+
+#include "roger-fax-queue.h"
+
+#include "roger-connection-monitor.h"
+#include "roger-fax-cache.h"
+#include "roger-fax-convert.h"
+#include "roger-print.h"
+#include "roger-settings.h"
+
+#include <glib/gi18n.h>
+
+/*
+ * Outgoing fax queue
+ *
+ * Faxes are added as print file and number. Jobs are converted ahead of time
+ * in the background, a few at once, and dispatched through rm_fax_send() in
+ * queue order. Per fax device only a configured number of faxes are sent at
+ * the same time. A failed transfer is retried after a delay which doubles on
+ * every attempt, until the configured number of attempts is used up.
+ *
+ * Running transfers are followed through the connection monitor.
+ */
+
+#define FAX_QUEUE_CONVERT_AHEAD 2
+#define FAX_QUEUE_RETRY_DELAY 60
+#define FAX_QUEUE_RETRY_DELAY_MAX (30 * 60)
+
+struct _RogerFaxJob {
+  GObject parent_instance;
+
+  char *file;
+  char *number;
+  char *tiff;
+  RogerFaxJobState state;
+
+  GCancellable *cancellable;
+  RmFax *fax;
+  RmConnection *connection;
+  gint pages_transferred;
+  gint pages_total;
+
+  guint attempts;
+  gint64 retry_time;
+  guint retry_id;
+};
+
+G_DEFINE_TYPE (RogerFaxJob, roger_fax_job, G_TYPE_OBJECT)
+
+enum {
+  JOB_CHANGED,
+  JOB_LAST_SIGNAL
+};
+
+static guint job_signals[JOB_LAST_SIGNAL];
+
+struct _RogerFaxQueue {
+  GObject parent_instance;
+
+  GListStore *jobs;
+  GHashTable *active;
+  guint converting;
+};
+
+G_DEFINE_TYPE (RogerFaxQueue, roger_fax_queue, G_TYPE_OBJECT)
+
+static RogerFaxQueue *default_queue = NULL;
+
+static void roger_fax_queue_update (RogerFaxQueue *self);
+
+static void
+roger_fax_job_finalize (GObject *object)
+{
+  RogerFaxJob *self = ROGER_FAX_JOB (object);
+
+  g_clear_handle_id (&self->retry_id, g_source_remove);
+  g_clear_object (&self->cancellable);
+  roger_fax_cache_release (self->tiff);
+  g_free (self->tiff);
+  g_free (self->number);
+  g_free (self->file);
+
+  G_OBJECT_CLASS (roger_fax_job_parent_class)->finalize (object);
+}
+
+static void
+roger_fax_job_class_init (RogerFaxJobClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = roger_fax_job_finalize;
+
+  job_signals[JOB_CHANGED] = g_signal_new ("changed",
+                                           ROGER_TYPE_FAX_JOB,
+                                           G_SIGNAL_RUN_LAST,
+                                           0,
+                                           NULL,
+                                           NULL,
+                                           NULL,
+                                           G_TYPE_NONE,
+                                           0);
+}
+
+static void
+roger_fax_job_init (RogerFaxJob *self)
+{
+}
+
+static void
+roger_fax_job_set_state (RogerFaxJob      *self,
+                         RogerFaxJobState  state)
+{
+  self->state = state;
+
+  g_signal_emit (self, job_signals[JOB_CHANGED], 0);
+}
+
+const char *
+roger_fax_job_get_file (RogerFaxJob *self)
+{
+  return self->file;
+}
+
+const char *
+roger_fax_job_get_number (RogerFaxJob *self)
+{
+  return self->number;
+}
+
+RogerFaxJobState
+roger_fax_job_get_state (RogerFaxJob *self)
+{
+  return self->state;
+}
+
+/**
+ * roger_fax_job_get_status_text:
+ * @self: a #RogerFaxJob
+ *
+ * Returns: (transfer full): a human readable status of @self
+ */
+char *
+roger_fax_job_get_status_text (RogerFaxJob *self)
+{
+  switch (self->state) {
+    case ROGER_FAX_JOB_STATE_PREPARING:
+      return g_strdup (self->cancellable ? _("Preparing document…") : _("Waiting for preparation"));
+    case ROGER_FAX_JOB_STATE_QUEUED:
+      return g_strdup (_("Queued"));
+    case ROGER_FAX_JOB_STATE_SENDING:
+      if (self->pages_total > 0)
+        return g_strdup_printf (_("Transferred %d of %d"), self->pages_transferred, self->pages_total);
+      return g_strdup (_("Connecting…"));
+    case ROGER_FAX_JOB_STATE_WAITING: {
+      g_autoptr (GDateTime) retry = g_date_time_new_from_unix_local (self->retry_time);
+      g_autofree char *time = g_date_time_format (retry, "%X");
+
+      return g_strdup_printf (_("Attempt %u failed, retry at %s"), self->attempts, time);
+    }
+    case ROGER_FAX_JOB_STATE_DONE:
+      return g_strdup (_("Fax transfer successful"));
+    case ROGER_FAX_JOB_STATE_FAILED:
+      if (!self->tiff)
+        return g_strdup (_("Could not prepare document"));
+      return g_strdup_printf (ngettext ("Fax transfer failed after %u attempt", "Fax transfer failed after %u attempts", self->attempts), self->attempts);
+  }
+
+  return NULL;
+}
+
+static guint
+roger_fax_queue_get_active (RogerFaxQueue *self,
+                            RmFax         *fax)
+{
+  return GPOINTER_TO_UINT (g_hash_table_lookup (self->active, fax));
+}
+
+static void
+roger_fax_queue_set_active (RogerFaxQueue *self,
+                            RmFax         *fax,
+                            guint          active)
+{
+  if (active)
+    g_hash_table_insert (self->active, fax, GUINT_TO_POINTER (active));
+  else
+    g_hash_table_remove (self->active, fax);
+}
+
+static void
+roger_fax_queue_job_release (RogerFaxQueue *self,
+                             RogerFaxJob   *job)
+{
+  roger_fax_queue_set_active (self, job->fax, roger_fax_queue_get_active (self, job->fax) - 1);
+  job->fax = NULL;
+  job->connection = NULL;
+}
+
+static gboolean
+roger_fax_queue_retry_cb (gpointer user_data)
+{
+  RogerFaxJob *job = ROGER_FAX_JOB (user_data);
+
+  job->retry_id = 0;
+  roger_fax_job_set_state (job, ROGER_FAX_JOB_STATE_QUEUED);
+  roger_fax_queue_update (default_queue);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+roger_fax_queue_job_failed (RogerFaxQueue *self,
+                            RogerFaxJob   *job)
+{
+  guint retries = g_settings_get_uint (ROGER_SETTINGS_MAIN, ROGER_PREFS_FAX_QUEUE_RETRIES);
+  guint delay;
+
+  job->attempts++;
+
+  if (job->attempts > retries) {
+    g_debug ("%s(): Giving up on %s after %u attempts", __FUNCTION__, job->number, job->attempts);
+    roger_fax_job_set_state (job, ROGER_FAX_JOB_STATE_FAILED);
+    return;
+  }
+
+  delay = MIN (FAX_QUEUE_RETRY_DELAY << (job->attempts - 1), FAX_QUEUE_RETRY_DELAY_MAX);
+  job->retry_time = g_get_real_time () / G_USEC_PER_SEC + delay;
+  job->retry_id = g_timeout_add_seconds_full (G_PRIORITY_DEFAULT,
+                                              delay,
+                                              roger_fax_queue_retry_cb,
+                                              g_object_ref (job),
+                                              g_object_unref);
+
+  g_debug ("%s(): Retrying %s in %u seconds", __FUNCTION__, job->number, delay);
+  roger_fax_job_set_state (job, ROGER_FAX_JOB_STATE_WAITING);
+}
+
+static RogerFaxJob *
+roger_fax_queue_find_connection (RogerFaxQueue *self,
+                                 RmConnection  *connection)
+{
+  guint n_items = g_list_model_get_n_items (G_LIST_MODEL (self->jobs));
+  guint idx;
+
+  for (idx = 0; idx < n_items; idx++) {
+    g_autoptr (RogerFaxJob) job = g_list_model_get_item (G_LIST_MODEL (self->jobs), idx);
+
+    if (job->state == ROGER_FAX_JOB_STATE_SENDING && job->connection == connection)
+      return job;
+  }
+
+  return NULL;
+}
+
+static void
+roger_fax_queue_status_changed_cb (RogerConnectionMonitor *monitor,
+                                   RmConnection           *connection,
+                                   RmFaxStatus            *status,
+                                   gpointer                user_data)
+{
+  RogerFaxQueue *self = ROGER_FAX_QUEUE (user_data);
+  RogerFaxJob *job = roger_fax_queue_find_connection (self, connection);
+  RmProfile *profile = rm_profile_get_active ();
+
+  if (!job)
+    return;
+
+  /* Connection lost */
+  if (!status) {
+    roger_fax_queue_job_release (self, job);
+    roger_fax_queue_job_failed (self, job);
+    roger_fax_queue_update (self);
+    return;
+  }
+
+  switch (status->phase) {
+    case RM_FAX_PHASE_IDENTIFY:
+    case RM_FAX_PHASE_SIGNALLING:
+      if (job->pages_transferred != status->pages_transferred || job->pages_total != status->pages_total) {
+        job->pages_transferred = status->pages_transferred;
+        job->pages_total = status->pages_total;
+        roger_fax_job_set_state (job, ROGER_FAX_JOB_STATE_SENDING);
+      }
+      break;
+    case RM_FAX_PHASE_RELEASE:
+      rm_fax_hangup (job->fax, job->connection);
+      roger_fax_queue_job_release (self, job);
+
+      if (status->error_code) {
+        roger_fax_queue_job_failed (self, job);
+      } else {
+        if (g_settings_get_boolean (profile->settings, "fax-report")) {
+          g_autofree char *report_dir = g_settings_get_string (profile->settings, "fax-report-dir");
+
+          print_fax_report (status, job->tiff, report_dir);
+        }
+
+        roger_fax_job_set_state (job, ROGER_FAX_JOB_STATE_DONE);
+      }
+
+      /* Free slots are filled right away */
+      roger_fax_queue_update (self);
+      break;
+    default:
+      break;
+  }
+}
+
+static void
+roger_fax_queue_send (RogerFaxQueue *self,
+                      RogerFaxJob   *job,
+                      RmFax         *fax)
+{
+  RmProfile *profile = rm_profile_get_active ();
+
+  job->connection = rm_fax_send (fax, job->tiff, job->number, rm_router_get_suppress_state (profile));
+  if (!job->connection) {
+    roger_fax_queue_job_failed (self, job);
+    return;
+  }
+
+  job->fax = fax;
+  job->pages_transferred = 0;
+  job->pages_total = 0;
+  roger_fax_queue_set_active (self, fax, roger_fax_queue_get_active (self, fax) + 1);
+  roger_fax_job_set_state (job, ROGER_FAX_JOB_STATE_SENDING);
+
+  roger_connection_monitor_watch_fax (roger_connection_monitor_get_default (), fax, job->connection);
+}
+
+static void
+roger_fax_queue_convert_ready_cb (GObject      *source_object,
+                                  GAsyncResult *result,
+                                  gpointer      user_data)
+{
+  g_autoptr (RogerFaxJob) job = ROGER_FAX_JOB (user_data);
+  g_autoptr (GError) error = NULL;
+  RogerFaxQueue *self = default_queue;
+
+  job->tiff = roger_fax_convert_finish (result, &error);
+  g_clear_object (&job->cancellable);
+  self->converting--;
+
+  if (!job->tiff) {
+    /* Removed from the queue, the next job may be prepared now */
+    if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      roger_fax_queue_update (self);
+      return;
+    }
+
+    g_warning ("%s(): %s", __FUNCTION__, error->message);
+    roger_fax_job_set_state (job, ROGER_FAX_JOB_STATE_FAILED);
+  } else {
+    roger_fax_job_set_state (job, ROGER_FAX_JOB_STATE_QUEUED);
+  }
+
+  roger_fax_queue_update (self);
+}
+
+static void
+roger_fax_queue_convert (RogerFaxQueue *self,
+                         RogerFaxJob   *job)
+{
+  RmProfile *profile = rm_profile_get_active ();
+
+  job->cancellable = g_cancellable_new ();
+  self->converting++;
+
+  roger_fax_convert_async (job->file,
+                           g_settings_get_int (profile->settings, "fax-resolution"),
+                           NULL,
+                           NULL,
+                           job->cancellable,
+                           roger_fax_queue_convert_ready_cb,
+                           g_object_ref (job));
+  roger_fax_job_set_state (job, ROGER_FAX_JOB_STATE_PREPARING);
+}
+
+static void
+roger_fax_queue_update (RogerFaxQueue *self)
+{
+  RmProfile *profile = rm_profile_get_active ();
+  RmFax *fax = profile ? rm_profile_get_fax (profile) : NULL;
+  guint concurrency = g_settings_get_uint (ROGER_SETTINGS_MAIN, ROGER_PREFS_FAX_QUEUE_CONCURRENCY);
+  guint n_items = g_list_model_get_n_items (G_LIST_MODEL (self->jobs));
+  guint idx;
+
+  for (idx = 0; idx < n_items; idx++) {
+    g_autoptr (RogerFaxJob) job = g_list_model_get_item (G_LIST_MODEL (self->jobs), idx);
+
+    switch (job->state) {
+      case ROGER_FAX_JOB_STATE_PREPARING:
+        if (!job->cancellable && self->converting < FAX_QUEUE_CONVERT_AHEAD)
+          roger_fax_queue_convert (self, job);
+        break;
+      case ROGER_FAX_JOB_STATE_QUEUED:
+        if (fax && roger_fax_queue_get_active (self, fax) < MAX (concurrency, 1))
+          roger_fax_queue_send (self, job, fax);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+static void
+roger_fax_queue_dispose (GObject *object)
+{
+  RogerFaxQueue *self = ROGER_FAX_QUEUE (object);
+
+  g_clear_pointer (&self->active, g_hash_table_unref);
+  g_clear_object (&self->jobs);
+
+  G_OBJECT_CLASS (roger_fax_queue_parent_class)->dispose (object);
+}
+
+static void
+roger_fax_queue_class_init (RogerFaxQueueClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = roger_fax_queue_dispose;
+}
+
+static void
+roger_fax_queue_init (RogerFaxQueue *self)
+{
+  self->jobs = g_list_store_new (ROGER_TYPE_FAX_JOB);
+  self->active = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  g_signal_connect_object (roger_connection_monitor_get_default (), "fax-status-changed", G_CALLBACK (roger_fax_queue_status_changed_cb), self, 0);
+}
+
+/**
+ * roger_fax_queue_get_default:
+ *
+ * Returns: (transfer none): the fax queue
+ */
+RogerFaxQueue *
+roger_fax_queue_get_default (void)
+{
+  if (!default_queue)
+    default_queue = g_object_new (ROGER_TYPE_FAX_QUEUE, NULL);
+
+  return default_queue;
+}
+
+/**
+ * roger_fax_queue_get_jobs:
+ * @self: a #RogerFaxQueue
+ *
+ * Returns: (transfer none): list model of #RogerFaxJob in queue order
+ */
+GListModel *
+roger_fax_queue_get_jobs (RogerFaxQueue *self)
+{
+  return G_LIST_MODEL (self->jobs);
+}
+
+/**
+ * roger_fax_queue_add:
+ * @self: a #RogerFaxQueue
+ * @file: print file (PDF or PostScript)
+ * @number: fax number
+ *
+ * Adds a fax to the end of the queue. It is prepared in the background and
+ * sent as soon as a line is free.
+ */
+void
+roger_fax_queue_add (RogerFaxQueue *self,
+                     const char    *file,
+                     const char    *number)
+{
+  g_autoptr (RogerFaxJob) job = g_object_new (ROGER_TYPE_FAX_JOB, NULL);
+
+  job->file = g_strdup (file);
+  job->number = g_strdup (number);
+  job->state = ROGER_FAX_JOB_STATE_PREPARING;
+
+  g_list_store_append (self->jobs, job);
+  roger_fax_queue_update (self);
+}
+
+/**
+ * roger_fax_queue_remove:
+ * @self: a #RogerFaxQueue
+ * @job: a #RogerFaxJob
+ *
+ * Removes @job from the queue, a running transfer is hung up.
+ */
+void
+roger_fax_queue_remove (RogerFaxQueue *self,
+                        RogerFaxJob   *job)
+{
+  guint position;
+
+  if (!g_list_store_find (self->jobs, job, &position))
+    return;
+
+  g_clear_handle_id (&job->retry_id, g_source_remove);
+
+  if (job->cancellable)
+    g_cancellable_cancel (job->cancellable);
+
+  if (job->state == ROGER_FAX_JOB_STATE_SENDING) {
+    roger_connection_monitor_unwatch (roger_connection_monitor_get_default (), job->connection);
+    rm_fax_hangup (job->fax, job->connection);
+    roger_fax_queue_job_release (self, job);
+  }
+
+  g_list_store_remove (self->jobs, position);
+  roger_fax_queue_update (self);
+}
+
+/**
+ * roger_fax_queue_retry:
+ * @self: a #RogerFaxQueue
+ * @job: a failed #RogerFaxJob
+ *
+ * Queues a failed job again with a fresh number of attempts.
+ */
+void
+roger_fax_queue_retry (RogerFaxQueue *self,
+                       RogerFaxJob   *job)
+{
+  if (job->state != ROGER_FAX_JOB_STATE_FAILED)
+    return;
+
+  job->attempts = 0;
+  roger_fax_job_set_state (job, job->tiff ? ROGER_FAX_JOB_STATE_QUEUED : ROGER_FAX_JOB_STATE_PREPARING);
+  roger_fax_queue_update (self);
+}
+
+/**
+ * roger_fax_queue_clear_finished:
+ * @self: a #RogerFaxQueue
+ *
+ * Removes all sent and failed jobs.
+ */
+void
+roger_fax_queue_clear_finished (RogerFaxQueue *self)
+{
+  guint idx = g_list_model_get_n_items (G_LIST_MODEL (self->jobs));
+
+  while (idx-- > 0) {
+    g_autoptr (RogerFaxJob) job = g_list_model_get_item (G_LIST_MODEL (self->jobs), idx);
+
+    if (job->state == ROGER_FAX_JOB_STATE_DONE || job->state == ROGER_FAX_JOB_STATE_FAILED)
+      g_list_store_remove (self->jobs, idx);
+  }
+}
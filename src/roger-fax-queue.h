@@ -0,0 +1,56 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <gio/gio.h>
+#include <rm/rm.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+  ROGER_FAX_JOB_STATE_PREPARING,
+  ROGER_FAX_JOB_STATE_QUEUED,
+  ROGER_FAX_JOB_STATE_SENDING,
+  ROGER_FAX_JOB_STATE_WAITING,
+  ROGER_FAX_JOB_STATE_DONE,
+  ROGER_FAX_JOB_STATE_FAILED
+} RogerFaxJobState;
+
+#define ROGER_TYPE_FAX_JOB (roger_fax_job_get_type ())
+
+G_DECLARE_FINAL_TYPE (RogerFaxJob, roger_fax_job, ROGER, FAX_JOB, GObject)
+
+const char *roger_fax_job_get_file (RogerFaxJob *self);
+const char *roger_fax_job_get_number (RogerFaxJob *self);
+RogerFaxJobState roger_fax_job_get_state (RogerFaxJob *self);
+char *roger_fax_job_get_status_text (RogerFaxJob *self);
+
+#define ROGER_TYPE_FAX_QUEUE (roger_fax_queue_get_type ())
+
+G_DECLARE_FINAL_TYPE (RogerFaxQueue, roger_fax_queue, ROGER, FAX_QUEUE, GObject)
+
+RogerFaxQueue *roger_fax_queue_get_default (void);
+
+GListModel *roger_fax_queue_get_jobs (RogerFaxQueue *self);
+
+void roger_fax_queue_add (RogerFaxQueue *self,
+                          const char    *file,
+                          const char    *number);
+void roger_fax_queue_remove (RogerFaxQueue *self,
+                             RogerFaxJob   *job);
+void roger_fax_queue_retry (RogerFaxQueue *self,
+                            RogerFaxJob   *job);
+void roger_fax_queue_clear_finished (RogerFaxQueue *self);
+
+G_END_DECLS
@@ -15,16 +15,17 @@
 #include "roger-fax.h"
 
 #include "contacts.h"
+#include "roger-connection-monitor.h"
 #include "roger-contactsearch.h"
+#include "roger-fax-cache.h"
+#include "roger-fax-convert.h"
+#include "roger-fax-queue.h"
 #include "roger-journal.h"
 #include "roger-print.h"
 
 #include <ctype.h>
-#include <ghostscript/iapi.h>
-#include <ghostscript/ierrors.h>
 #include <glib/gi18n.h>
 #include <gtk/gtk.h>
-#include <glib/gstdio.h>
 #include <rm/rm.h>
 
 struct _RogerFax {
@@ -37,89 +38,125 @@ struct _RogerFax {
   GtkWidget *receiver_label;
   GtkWidget *progress_bar;
   GtkWidget *hangup_button;
+  GtkWidget *dial_button;
+  GtkWidget *convert_progress_bar;
 
   RmConnection *connection;
   RmFaxStatus status;
+  char *source_file;
   char *file;
-  gint status_timer_id;
+  char *remote_ident;
+  char *duration;
+  guint tick_id;
+  GCancellable *convert_cancellable;
 };
 
 G_DEFINE_TYPE (RogerFax, roger_fax, HDY_TYPE_WINDOW)
 
-gboolean
-roger_fax_status_timer_cb (gpointer user_data)
+static gboolean
+roger_fax_tick_cb (GtkWidget     *widget,
+                   GdkFrameClock *frame_clock,
+                   gpointer       user_data)
 {
-  RogerFax *self = ROGER_FAX (user_data);
-  RmFaxStatus fax_status;
-  RmFax *fax = rm_profile_get_fax (rm_profile_get_active ());
-  g_autofree char *time_diff = NULL;
-  char buffer[256];
-  static gdouble old_percent = 0.0f;
-
-  g_assert (fax);
-
-  memset (&fax_status, 0, sizeof (RmFaxStatus));
-  if (!rm_fax_get_status (fax, self->connection, &fax_status)) {
-    self->status_timer_id = 0;
-    return G_SOURCE_REMOVE;
-  }
+  RogerFax *self = ROGER_FAX (widget);
+  g_autofree char *text = NULL;
 
-  if (old_percent != fax_status.percentage) {
-    old_percent = fax_status.percentage;
+  self->tick_id = 0;
 
-    gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (self->progress_bar), fax_status.percentage);
-  }
+  gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (self->progress_bar), self->status.percentage);
+
+  if (self->remote_ident)
+    gtk_label_set_text (GTK_LABEL (self->receiver_label), self->remote_ident);
 
   /* Update status information */
-  switch (fax_status.phase) {
+  switch (self->status.phase) {
     case RM_FAX_PHASE_IDENTIFY:
-      gtk_label_set_text (GTK_LABEL (self->receiver_label), fax_status.remote_ident);
-      g_free (fax_status.remote_ident);
-
-    /* Fall through */
     case RM_FAX_PHASE_SIGNALLING:
-      snprintf (buffer, sizeof (buffer), _("Transferred %d of %d"), fax_status.pages_transferred, fax_status.pages_total);
-      gtk_progress_bar_set_text (GTK_PROGRESS_BAR (self->progress_bar), buffer);
+      text = g_strdup_printf (_("Transferred %d of %d"), self->status.pages_transferred, self->status.pages_total);
       break;
     case RM_FAX_PHASE_RELEASE:
-      if (!fax_status.error_code)
-        gtk_progress_bar_set_text (GTK_PROGRESS_BAR (self->progress_bar), _("Fax transfer successful"));
+      if (!self->status.error_code)
+        text = g_strdup (_("Fax transfer successful"));
       else
-        gtk_progress_bar_set_text (GTK_PROGRESS_BAR (self->progress_bar), _("Fax transfer failed"));
-
-      if (self->status_timer_id && g_settings_get_boolean (rm_profile_get_active ()->settings, "fax-report"))
-        print_fax_report (&fax_status, self->file, g_settings_get_string (rm_profile_get_active ()->settings, "fax-report-dir"));
-
-      rm_fax_hangup (fax, self->connection);
-      self->status_timer_id = 0;
-
-      return G_SOURCE_REMOVE;
+        text = g_strdup (_("Fax transfer failed"));
+      break;
     case RM_FAX_PHASE_CALL:
-      gtk_progress_bar_set_text (GTK_PROGRESS_BAR (self->progress_bar), _("Connecting…"));
+      text = g_strdup (_("Connecting…"));
       break;
     default:
-      g_debug ("%s: Unhandled phase (%d)", __FUNCTION__, fax_status.phase);
-      gtk_progress_bar_set_text (GTK_PROGRESS_BAR (self->progress_bar), "");
+      g_debug ("%s: Unhandled phase (%d)", __FUNCTION__, self->status.phase);
       break;
   }
 
-  time_diff = rm_connection_get_duration_time (self->connection);
-  hdy_header_bar_set_subtitle (HDY_HEADER_BAR (self->header_bar), time_diff);
+  gtk_progress_bar_set_text (GTK_PROGRESS_BAR (self->progress_bar), text ? text : "");
+  hdy_header_bar_set_subtitle (HDY_HEADER_BAR (self->header_bar), self->duration ? self->duration : "");
 
-  return G_SOURCE_CONTINUE;
+  return G_SOURCE_REMOVE;
 }
 
 static void
-roger_fax_start_status_timer (RogerFax *self)
+roger_fax_queue_draw (RogerFax *self)
 {
-  g_clear_handle_id (&self->status_timer_id, g_source_remove);
-  self->status_timer_id = g_timeout_add (250, roger_fax_status_timer_cb, self);
+  /* Status changes are applied once per frame */
+  if (!self->tick_id)
+    self->tick_id = gtk_widget_add_tick_callback (GTK_WIDGET (self), roger_fax_tick_cb, NULL, NULL);
 }
 
 static void
-roger_fax_remove_status_timer (RogerFax *self)
+roger_fax_status_changed_cb (RogerConnectionMonitor *monitor,
+                             RmConnection           *connection,
+                             RmFaxStatus            *status,
+                             gpointer                user_data)
 {
-  g_clear_handle_id (&self->status_timer_id, g_source_remove);
+  RogerFax *self = ROGER_FAX (user_data);
+  RmProfile *profile = rm_profile_get_active ();
+
+  if (self->connection != connection || !status)
+    return;
+
+  self->status = *status;
+  self->status.remote_ident = NULL;
+  if (status->remote_ident && g_strcmp0 (status->remote_ident, self->remote_ident)) {
+    g_free (self->remote_ident);
+    self->remote_ident = g_strdup (status->remote_ident);
+  }
+
+  if (status->phase == RM_FAX_PHASE_RELEASE) {
+    if (g_settings_get_boolean (profile->settings, "fax-report")) {
+      g_autofree char *report_dir = g_settings_get_string (profile->settings, "fax-report-dir");
+
+      print_fax_report (status, self->file, report_dir);
+    }
+
+    rm_fax_hangup (rm_profile_get_fax (profile), self->connection);
+  }
+
+  roger_fax_queue_draw (self);
+}
+
+static void
+roger_fax_duration_changed_cb (RogerConnectionMonitor *monitor,
+                               RmConnection           *connection,
+                               const char             *duration,
+                               gpointer                user_data)
+{
+  RogerFax *self = ROGER_FAX (user_data);
+
+  if (self->connection != connection)
+    return;
+
+  g_free (self->duration);
+  self->duration = g_strdup (duration);
+
+  roger_fax_queue_draw (self);
+}
+
+static void
+roger_fax_unwatch (RogerFax *self)
+{
+  roger_connection_monitor_unwatch (roger_connection_monitor_get_default (), self->connection);
+
+  g_clear_pointer (&self->duration, g_free);
   hdy_header_bar_set_subtitle (HDY_HEADER_BAR (self->header_bar), "");
 
   gtk_widget_set_sensitive (self->hangup_button, FALSE);
@@ -142,7 +179,7 @@ fax_connection_changed_cb (RmObject     *object,
   if (!(type & RM_CONNECTION_TYPE_DISCONNECT))
     return;
 
-  roger_fax_remove_status_timer (self);
+  roger_fax_unwatch (self);
   self->connection = NULL;
 }
 
@@ -153,98 +190,86 @@ roger_fax_delete_event_cb (GtkWidget *window,
 {
   RogerFax *self = ROGER_FAX (window);
 
-  if (self->file) {
-    g_unlink (self->file);
-    g_clear_pointer (&self->file, g_free);
-  }
+  g_cancellable_cancel (self->convert_cancellable);
+
+  /* The converted file belongs to the fax cache */
+  roger_fax_cache_release (self->file);
+  g_clear_pointer (&self->file, g_free);
 
   return FALSE;
 }
 
-char *
-convert_to_fax (const char *file_name)
+static void
+roger_fax_convert_progress_cb (gint     page,
+                               gint     pages,
+                               gpointer user_data)
 {
-  char *args[17];
-  char *output;
-  char *out_file;
-  RmProfile *profile = rm_profile_get_active ();
-  gint ret;
-  void *minst = NULL;
-
-  /* convert ps to fax */
-  args[0] = "gs";
-  args[1] = "-q";
-  args[2] = "-dNOPAUSE";
-  args[3] = "-dSAFER";
-  args[4] = "-dBATCH";
-
-  {
-    char *ofile = g_strdup_printf ("%s.tif", g_path_get_basename (file_name));
-    args[5] = "-sDEVICE=tiffg4";
-    out_file = g_build_filename (rm_get_user_cache_dir (), ofile, NULL);
-    g_free (ofile);
+  RogerFax *self = ROGER_FAX (user_data);
+  g_autofree char *text = NULL;
+
+  if (pages > 0) {
+    gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (self->convert_progress_bar), (gdouble)page / pages);
+    text = g_strdup_printf (_("Preparing page %d of %d"), page, pages);
+  } else {
+    gtk_progress_bar_pulse (GTK_PROGRESS_BAR (self->convert_progress_bar));
+    text = g_strdup_printf (_("Preparing page %d"), page);
   }
 
-  args[6] = "-dPDFFitPage";
-  args[7] = "-dMaxStripSize=0";
-  switch (g_settings_get_int (profile->settings, "fax-resolution")) {
-    case 2:
-      /* Super - fine */
-      args[8] = "-r204x392";
-      break;
-    case 1:
-      /* Fine */
-      args[8] = "-r204x196";
-      break;
-    default:
-      /* Standard */
-      args[8] = "-r204x98";
-      break;
-  }
-  output = g_strdup_printf ("-sOutputFile=%s", out_file);
-  args[9] = output;
-
-  /* improved dithering pattern as proposed in this ghostscript ticket:
-   * https://bugs.ghostscript.com/show_bug.cgi?id=694762#c3
-   */
-  args[10] = "-Ilib";
-  args[11] = "stocht.ps";
-
-  /* set everything below 25% brightness to black and everything above 75% brightness to white. This improves that readability of faxes which contain grayscale or color scans.
-   */
-  args[12] = "-c";
-  args[13] = "{ dup .25 lt { pop 0 } if dup .75 gt { pop 1 } if } settransfer";
-
-  args[14] = "-f";
-  args[15] = (char *)file_name;
-  args[16] = NULL;
-
-  ret = gsapi_new_instance (&minst, NULL);
-  if (ret < 0) {
-    return NULL;
-  }
-  gsapi_set_arg_encoding (minst, GS_ARG_ENCODING_UTF8);
-  gsapi_init_with_args (minst, 16, args);
+  gtk_progress_bar_set_text (GTK_PROGRESS_BAR (self->convert_progress_bar), text);
+}
 
-  gsapi_exit (minst);
+static void
+roger_fax_convert_ready_cb (GObject      *source_object,
+                            GAsyncResult *result,
+                            gpointer      user_data)
+{
+  RogerFax *self;
+  g_autoptr (GError) error = NULL;
+  char *file;
 
-  gsapi_delete_instance (minst);
+  file = roger_fax_convert_finish (result, &error);
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return;
 
-  if (!g_file_test (out_file, G_FILE_TEST_EXISTS)) {
-    g_warning ("%s(): Error converting print file to FAX format!", __FUNCTION__);
-    g_free (out_file);
+  self = ROGER_FAX (user_data);
+  g_clear_object (&self->convert_cancellable);
 
-    return NULL;
+  if (!file) {
+    g_warning ("%s(): %s", __FUNCTION__, error->message);
+    gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (self->convert_progress_bar), 0.0f);
+    gtk_progress_bar_set_text (GTK_PROGRESS_BAR (self->convert_progress_bar), _("Could not prepare document"));
+    return;
   }
 
-  return out_file;
+  self->file = file;
+
+  gtk_widget_hide (self->convert_progress_bar);
+  gtk_widget_set_sensitive (self->dial_button, TRUE);
 }
 
 void
 roger_fax_set_transfer_file (RogerFax   *self,
                              const char *file)
 {
-  self->file = convert_to_fax (file);
+  RmProfile *profile = rm_profile_get_active ();
+
+  g_assert (!self->file && !self->convert_cancellable);
+
+  self->source_file = g_strdup (file);
+
+  gtk_widget_set_sensitive (self->dial_button, FALSE);
+  gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (self->convert_progress_bar), 0.0f);
+  gtk_progress_bar_set_text (GTK_PROGRESS_BAR (self->convert_progress_bar), _("Preparing document…"));
+  gtk_widget_show (self->convert_progress_bar);
+
+  self->convert_cancellable = g_cancellable_new ();
+  roger_fax_convert_async (file,
+                           g_settings_get_int (profile->settings, "fax-resolution"),
+                           roger_fax_convert_progress_cb,
+                           self,
+                           self->convert_cancellable,
+                           roger_fax_convert_ready_cb,
+                           self);
 }
 
 static void
@@ -258,13 +283,13 @@ roger_fax_dial_button_clicked_cb (GtkWidget *button,
   g_assert (!self->connection);
 
   number = gtk_entry_get_text (GTK_ENTRY (self->search_entry));
-  if (RM_EMPTY_STRING (number))
+  if (!self->file || RM_EMPTY_STRING (number))
     return;
 
   self->connection = rm_fax_send (rm_profile_get_fax (profile), self->file, number, rm_router_get_suppress_state (profile));
   if (self->connection) {
     hdy_deck_set_visible_child_name (HDY_DECK (self->deck), "transfer");
-    roger_fax_start_status_timer (self);
+    roger_connection_monitor_watch_fax (roger_connection_monitor_get_default (), rm_profile_get_fax (profile), self->connection);
   }
 }
 
@@ -316,7 +341,26 @@ roger_fax_dispose (GObject *object)
 {
   RogerFax *self = ROGER_FAX (object);
 
-  g_clear_handle_id (&self->status_timer_id, g_source_remove);
+  if (self->tick_id) {
+    gtk_widget_remove_tick_callback (GTK_WIDGET (self), self->tick_id);
+    self->tick_id = 0;
+  }
+
+  if (self->connection) {
+    roger_connection_monitor_unwatch (roger_connection_monitor_get_default (), self->connection);
+    self->connection = NULL;
+  }
+
+  if (self->convert_cancellable) {
+    g_cancellable_cancel (self->convert_cancellable);
+    g_clear_object (&self->convert_cancellable);
+  }
+
+  roger_fax_cache_release (self->file);
+  g_clear_pointer (&self->file, g_free);
+  g_clear_pointer (&self->source_file, g_free);
+  g_clear_pointer (&self->remote_ident, g_free);
+  g_clear_pointer (&self->duration, g_free);
 
   G_OBJECT_CLASS (roger_fax_parent_class)->dispose (object);
 }
@@ -338,6 +382,8 @@ roger_fax_class_init (RogerFaxClass *klass)
   gtk_widget_class_bind_template_child (widget_class, RogerFax, receiver_label);
   gtk_widget_class_bind_template_child (widget_class, RogerFax, progress_bar);
   gtk_widget_class_bind_template_child (widget_class, RogerFax, hangup_button);
+  gtk_widget_class_bind_template_child (widget_class, RogerFax, dial_button);
+  gtk_widget_class_bind_template_child (widget_class, RogerFax, convert_progress_bar);
 
   gtk_widget_class_bind_template_callback (widget_class, roger_fax_number_button_clicked_cb);
   gtk_widget_class_bind_template_callback (widget_class, roger_fax_dial_button_clicked_cb);
@@ -354,8 +400,24 @@ roger_fax_set_suppression (GSimpleAction *action,
   g_simple_action_set_state (action, value);
 }
 
+static void
+roger_fax_add_to_queue (GSimpleAction *action,
+                        GVariant      *parameter,
+                        gpointer       user_data)
+{
+  RogerFax *self = ROGER_FAX (user_data);
+  const char *number = gtk_entry_get_text (GTK_ENTRY (self->search_entry));
+
+  if (!self->source_file || RM_EMPTY_STRING (number))
+    return;
+
+  roger_fax_queue_add (roger_fax_queue_get_default (), self->source_file, number);
+  gtk_widget_destroy (GTK_WIDGET (self));
+}
+
 static const GActionEntry fax_actions [] = {
   {"set-suppression", NULL, NULL, "false", roger_fax_set_suppression},
+  {"queue", roger_fax_add_to_queue},
 };
 
 static void
@@ -380,6 +442,8 @@ roger_fax_init (RogerFax *self)
   gtk_label_set_text (GTK_LABEL (self->sender_label), g_settings_get_string (profile->settings, "fax-header"));
 
   g_signal_connect_object (rm_object, "connection-changed", G_CALLBACK (fax_connection_changed_cb), self, 0);
+  g_signal_connect_object (roger_connection_monitor_get_default (), "fax-status-changed", G_CALLBACK (roger_fax_status_changed_cb), self, 0);
+  g_signal_connect_object (roger_connection_monitor_get_default (), "duration-changed", G_CALLBACK (roger_fax_duration_changed_cb), self, 0);
 }
 
 GtkWidget *
@@ -0,0 +1,483 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "roger-journal-archive.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Local journal archive
+ *
+ * The last known journal of a profile is kept in the user cache directory, so
+ * it can be shown before the router answers. The file is a header followed by
+ * append-only segments. Each segment stores its rows column by column:
+ *
+ *   segment header
+ *   guint32 string ids[N_STRING_COLUMNS][n_rows]
+ *   guint8  types[n_rows]
+ *   strings introduced by this segment, NUL terminated
+ *
+ * String ids are global to the file, id 0 is the empty string. Newer calls are
+ * appended as a new segment which only adds strings not seen before, so the
+ * journal order is the segments in reverse. If the stored rows are no longer
+ * the tail of the journal, the archive is rewritten as a single segment.
+ *
+ * Writes are done in order on a single background thread. If a write fails,
+ * later appends are skipped and the next store rewrites the whole archive.
+ */
+
+#define ARCHIVE_MAGIC 0x52414a52
+#define ARCHIVE_VERSION 2
+#define ARCHIVE_SEGMENT_MAGIC 0x31474553
+
+typedef enum {
+  ARCHIVE_COLUMN_DATE_TIME,
+  ARCHIVE_COLUMN_DURATION,
+  ARCHIVE_COLUMN_REMOTE_NAME,
+  ARCHIVE_COLUMN_REMOTE_NUMBER,
+  ARCHIVE_COLUMN_LOCAL_NAME,
+  ARCHIVE_COLUMN_LOCAL_NUMBER,
+  ARCHIVE_COLUMN_PRIV,
+  ARCHIVE_N_STRING_COLUMNS
+} RogerJournalArchiveColumn;
+
+typedef struct {
+  guint32 magic;
+  guint32 version;
+  guint64 reserved;
+} RogerJournalArchiveHeader;
+
+typedef struct {
+  guint32 magic;
+  guint32 n_rows;
+  guint32 n_strings;
+  guint32 strings_size;
+} RogerJournalArchiveSegment;
+
+/* Shared with queued writes, which may outlive the archive */
+typedef struct {
+  gint ref_count;
+  gint failed;
+} RogerJournalArchiveStatus;
+
+typedef struct {
+  char *path;
+  GBytes *bytes;
+  gboolean append;
+  RogerJournalArchiveStatus *status;
+} RogerJournalArchiveWrite;
+
+struct _RogerJournalArchive {
+  RmProfile *profile;
+  char *path;
+  RogerJournalArchiveStatus *status;
+
+  GHashTable *string_ids;
+  guint32 n_strings;
+  GPtrArray *keys;
+};
+
+static GThreadPool *archive_writer = NULL;
+
+static RogerJournalArchiveStatus *
+roger_journal_archive_status_ref (RogerJournalArchiveStatus *status)
+{
+  g_atomic_int_inc (&status->ref_count);
+
+  return status;
+}
+
+static void
+roger_journal_archive_status_unref (RogerJournalArchiveStatus *status)
+{
+  if (g_atomic_int_dec_and_test (&status->ref_count))
+    g_free (status);
+}
+
+static char *
+roger_journal_archive_get_key (RmCallEntry *call)
+{
+  return g_strdup_printf ("%d|%s|%s|%s",
+                          call->type,
+                          call->date_time ? call->date_time : "",
+                          call->remote->number ? call->remote->number : "",
+                          call->duration ? call->duration : "");
+}
+
+static inline gsize
+roger_journal_archive_segment_size (guint32 n_rows,
+                                    guint32 strings_size)
+{
+  gsize size = sizeof (RogerJournalArchiveSegment);
+
+  size += (gsize)n_rows * (ARCHIVE_N_STRING_COLUMNS * sizeof (guint32) + sizeof (guint8));
+  size += strings_size;
+
+  return (size + 7) & ~(gsize)7;
+}
+
+static void
+roger_journal_archive_reset (RogerJournalArchive *self)
+{
+  g_hash_table_remove_all (self->string_ids);
+  self->n_strings = 1;
+  g_ptr_array_set_size (self->keys, 0);
+}
+
+RogerJournalArchive *
+roger_journal_archive_new (RmProfile *profile)
+{
+  RogerJournalArchive *self = g_new0 (RogerJournalArchive, 1);
+  g_autofree char *checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, profile->name, -1);
+  g_autofree char *file = g_strdup_printf ("journal-%s.archive", checksum);
+
+  self->profile = profile;
+  self->path = g_build_filename (rm_get_user_cache_dir (), file, NULL);
+  self->string_ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  self->keys = g_ptr_array_new_with_free_func (g_free);
+  self->n_strings = 1;
+  self->status = g_new0 (RogerJournalArchiveStatus, 1);
+  self->status->ref_count = 1;
+
+  return self;
+}
+
+void
+roger_journal_archive_free (RogerJournalArchive *self)
+{
+  if (!self)
+    return;
+
+  g_hash_table_unref (self->string_ids);
+  g_ptr_array_unref (self->keys);
+  roger_journal_archive_status_unref (self->status);
+  g_free (self->path);
+  g_free (self);
+}
+
+RmProfile *
+roger_journal_archive_get_profile (RogerJournalArchive *self)
+{
+  return self->profile;
+}
+
+static GList *
+roger_journal_archive_load_segment (RogerJournalArchive        *self,
+                                    RogerJournalArchiveSegment *segment,
+                                    GPtrArray                  *strings)
+{
+  const guint32 *ids = (const guint32 *)(segment + 1);
+  const guint8 *types = (const guint8 *)(ids + ARCHIVE_N_STRING_COLUMNS * segment->n_rows);
+  const char *str = (const char *)(types + segment->n_rows);
+  const char *end = str + segment->strings_size;
+  GList *list = NULL;
+  guint32 idx;
+  guint32 row;
+
+  for (idx = 0; idx < segment->n_strings; idx++) {
+    const char *nul = memchr (str, '\0', end - str);
+
+    if (!nul)
+      return NULL;
+
+    g_ptr_array_add (strings, (char *)str);
+    g_hash_table_insert (self->string_ids, g_strdup (str), GUINT_TO_POINTER (strings->len - 1));
+    str = nul + 1;
+  }
+
+  for (idx = 0; idx < ARCHIVE_N_STRING_COLUMNS * segment->n_rows; idx++) {
+    if (ids[idx] >= strings->len)
+      return NULL;
+  }
+
+  /* Built back to front, so prepending keeps the row order */
+  for (row = segment->n_rows; row-- > 0;) {
+    const char *values[ARCHIVE_N_STRING_COLUMNS];
+    RmCallEntry *call;
+    guint column;
+
+    for (column = 0; column < ARCHIVE_N_STRING_COLUMNS; column++)
+      values[column] = g_ptr_array_index (strings, ids[column * segment->n_rows + row]);
+
+    call = rm_call_entry_new (types[row],
+                              values[ARCHIVE_COLUMN_DATE_TIME],
+                              values[ARCHIVE_COLUMN_REMOTE_NAME],
+                              values[ARCHIVE_COLUMN_REMOTE_NUMBER],
+                              values[ARCHIVE_COLUMN_LOCAL_NAME],
+                              values[ARCHIVE_COLUMN_LOCAL_NUMBER],
+                              values[ARCHIVE_COLUMN_DURATION],
+                              *values[ARCHIVE_COLUMN_PRIV] ? g_strdup (values[ARCHIVE_COLUMN_PRIV]) : NULL);
+    list = g_list_prepend (list, call);
+  }
+
+  return list;
+}
+
+/**
+ * roger_journal_archive_load:
+ * @self: a #RogerJournalArchive
+ *
+ * Reads the archived journal. The archive is mapped and the call entries are
+ * built straight from the columns.
+ *
+ * Returns: (transfer full): the archived journal, or %NULL
+ */
+GList *
+roger_journal_archive_load (RogerJournalArchive *self)
+{
+  g_autoptr (GMappedFile) mapped = NULL;
+  g_autoptr (GPtrArray) strings = g_ptr_array_new ();
+  g_autoptr (GError) error = NULL;
+  RogerJournalArchiveHeader *header;
+  GList *journal = NULL;
+  GList *list;
+  const char *data;
+  gsize offset;
+  gsize len;
+
+  roger_journal_archive_reset (self);
+
+  mapped = g_mapped_file_new (self->path, FALSE, &error);
+  if (!mapped) {
+    if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+      g_warning ("%s(): Could not map journal archive: %s", __FUNCTION__, error->message);
+    return NULL;
+  }
+
+  data = g_mapped_file_get_contents (mapped);
+  len = g_mapped_file_get_length (mapped);
+  header = (RogerJournalArchiveHeader *)data;
+  if (!data || len < sizeof (RogerJournalArchiveHeader) || header->magic != ARCHIVE_MAGIC || header->version != ARCHIVE_VERSION) {
+    g_debug ("%s(): Ignoring invalid journal archive", __FUNCTION__);
+    return NULL;
+  }
+
+  g_ptr_array_add (strings, "");
+
+  for (offset = sizeof (RogerJournalArchiveHeader); offset + sizeof (RogerJournalArchiveSegment) <= len;) {
+    RogerJournalArchiveSegment *segment = (RogerJournalArchiveSegment *)(data + offset);
+    GList *rows;
+    gsize size;
+
+    if (segment->magic != ARCHIVE_SEGMENT_MAGIC || segment->n_rows > len || segment->strings_size > len)
+      break;
+
+    size = roger_journal_archive_segment_size (segment->n_rows, segment->strings_size);
+    if (size > len - offset)
+      break;
+
+    rows = roger_journal_archive_load_segment (self, segment, strings);
+    if (!rows && segment->n_rows)
+      break;
+
+    /* Later segments hold newer calls */
+    journal = g_list_concat (rows, journal);
+    offset += size;
+  }
+
+  self->n_strings = strings->len;
+
+  /* A damaged tail is dropped, the next store rewrites the archive */
+  if (offset != len) {
+    g_debug ("%s(): Journal archive is truncated", __FUNCTION__);
+    g_ptr_array_set_size (self->keys, 0);
+    return journal;
+  }
+
+  for (list = journal; list != NULL; list = list->next)
+    g_ptr_array_add (self->keys, roger_journal_archive_get_key (list->data));
+
+  g_debug ("%s(): Loaded %u archived calls", __FUNCTION__, self->keys->len);
+
+  return journal;
+}
+
+static guint32
+roger_journal_archive_intern (RogerJournalArchive        *self,
+                              GByteArray                 *strings,
+                              const char                 *str,
+                              RogerJournalArchiveSegment *segment)
+{
+  gpointer id;
+
+  if (RM_EMPTY_STRING (str))
+    return 0;
+
+  id = g_hash_table_lookup (self->string_ids, str);
+  if (id)
+    return GPOINTER_TO_UINT (id);
+
+  g_hash_table_insert (self->string_ids, g_strdup (str), GUINT_TO_POINTER (self->n_strings));
+  g_byte_array_append (strings, (const guint8 *)str, strlen (str) + 1);
+  segment->n_strings++;
+
+  return self->n_strings++;
+}
+
+static void
+roger_journal_archive_add_segment (RogerJournalArchive *self,
+                                   GByteArray          *buffer,
+                                   GList               *journal,
+                                   guint                n_rows)
+{
+  RogerJournalArchiveSegment segment = { ARCHIVE_SEGMENT_MAGIC, n_rows, 0, 0 };
+  g_autoptr (GByteArray) strings = g_byte_array_new ();
+  g_autofree guint32 *ids = g_new (guint32, ARCHIVE_N_STRING_COLUMNS * n_rows);
+  g_autofree guint8 *types = g_new (guint8, n_rows);
+  static const guint8 padding[8] = { 0 };
+  GList *list = journal;
+  gsize size;
+  guint row;
+
+  for (row = 0; row < n_rows; row++, list = list->next) {
+    RmCallEntry *call = list->data;
+    const char *values[ARCHIVE_N_STRING_COLUMNS] = {
+      call->date_time,
+      call->duration,
+      /* Looked up names are cached separately and may change */
+      call->remote->lookup ? NULL : call->remote->name,
+      call->remote->number,
+      call->local->name,
+      call->local->number,
+      call->priv,
+    };
+    guint column;
+
+    types[row] = call->type;
+
+    for (column = 0; column < ARCHIVE_N_STRING_COLUMNS; column++)
+      ids[column * n_rows + row] = roger_journal_archive_intern (self, strings, values[column], &segment);
+  }
+
+  segment.strings_size = strings->len;
+  size = roger_journal_archive_segment_size (n_rows, segment.strings_size);
+
+  g_byte_array_append (buffer, (const guint8 *)&segment, sizeof (segment));
+  g_byte_array_append (buffer, (const guint8 *)ids, ARCHIVE_N_STRING_COLUMNS * n_rows * sizeof (guint32));
+  g_byte_array_append (buffer, types, n_rows);
+  g_byte_array_append (buffer, strings->data, strings->len);
+  g_byte_array_append (buffer, padding, size - (sizeof (segment) + n_rows * (ARCHIVE_N_STRING_COLUMNS * sizeof (guint32) + 1) + strings->len));
+}
+
+static void
+roger_journal_archive_write_thread_cb (gpointer data,
+                                       gpointer user_data)
+{
+  RogerJournalArchiveWrite *write = data;
+  g_autoptr (GError) error = NULL;
+  gsize len;
+  const char *contents = g_bytes_get_data (write->bytes, &len);
+
+  if (write->append) {
+    /* Appends only extend an intact archive, a missing file is not created */
+    FILE *file = g_atomic_int_get (&write->status->failed) ? NULL : g_fopen (write->path, "r+b");
+    gboolean written = file && fseek (file, 0, SEEK_END) == 0 && fwrite (contents, 1, len, file) == len;
+
+    if (file && fclose (file) != 0)
+      written = FALSE;
+
+    if (!written && !g_atomic_int_get (&write->status->failed)) {
+      g_warning ("%s(): Could not append to journal archive", __FUNCTION__);
+      /* A broken archive is worse than none, it is rebuilt next time */
+      g_unlink (write->path);
+      g_atomic_int_set (&write->status->failed, TRUE);
+    }
+  } else if (g_file_set_contents (write->path, contents, len, &error)) {
+    g_atomic_int_set (&write->status->failed, FALSE);
+  } else {
+    g_warning ("%s(): Could not write journal archive: %s", __FUNCTION__, error->message);
+    g_unlink (write->path);
+    g_atomic_int_set (&write->status->failed, TRUE);
+  }
+
+  roger_journal_archive_status_unref (write->status);
+  g_bytes_unref (write->bytes);
+  g_free (write->path);
+  g_free (write);
+}
+
+/**
+ * roger_journal_archive_store:
+ * @self: a #RogerJournalArchive
+ * @journal: journal list of #RmCallEntry
+ *
+ * Stores @journal. If the archived calls are the tail of @journal, only the
+ * new calls are appended.
+ */
+void
+roger_journal_archive_store (RogerJournalArchive *self,
+                             GList               *journal)
+{
+  RogerJournalArchiveWrite *write;
+  GByteArray *buffer = g_byte_array_new ();
+  GPtrArray *keys;
+  guint n_rows = g_list_length (journal);
+  guint n_new = n_rows;
+  gboolean append = FALSE;
+  GList *list;
+  guint idx;
+
+  /* The archived rows are unknown after a failed write */
+  if (g_atomic_int_get (&self->status->failed))
+    roger_journal_archive_reset (self);
+
+  if (self->keys->len > 0 && self->keys->len <= n_rows) {
+    append = TRUE;
+
+    for (list = g_list_nth (journal, n_rows - self->keys->len), idx = 0; list != NULL && append; list = list->next, idx++) {
+      g_autofree char *key = roger_journal_archive_get_key (list->data);
+
+      append = !strcmp (key, g_ptr_array_index (self->keys, idx));
+    }
+  }
+
+  if (append) {
+    n_new = n_rows - self->keys->len;
+    if (n_new == 0) {
+      g_byte_array_unref (buffer);
+      return;
+    }
+  } else {
+    RogerJournalArchiveHeader header = { ARCHIVE_MAGIC, ARCHIVE_VERSION, 0 };
+
+    roger_journal_archive_reset (self);
+    g_byte_array_append (buffer, (const guint8 *)&header, sizeof (header));
+  }
+
+  roger_journal_archive_add_segment (self, buffer, journal, n_new);
+
+  /* New calls are in front of the archived ones */
+  keys = g_ptr_array_new_full (n_rows, g_free);
+  for (list = journal, idx = 0; idx < n_new; list = list->next, idx++)
+    g_ptr_array_add (keys, roger_journal_archive_get_key (list->data));
+  for (idx = 0; idx < self->keys->len; idx++)
+    g_ptr_array_add (keys, g_strdup (g_ptr_array_index (self->keys, idx)));
+  g_ptr_array_unref (self->keys);
+  self->keys = keys;
+
+  g_debug ("%s(): %s %u calls", __FUNCTION__, append ? "Appending" : "Writing", n_new);
+
+  write = g_new0 (RogerJournalArchiveWrite, 1);
+  write->path = g_strdup (self->path);
+  write->bytes = g_byte_array_free_to_bytes (buffer);
+  write->append = append;
+  write->status = roger_journal_archive_status_ref (self->status);
+
+  if (!archive_writer)
+    archive_writer = g_thread_pool_new (roger_journal_archive_write_thread_cb, NULL, 1, FALSE, NULL);
+
+  g_thread_pool_push (archive_writer, write, NULL);
+}
@@ -0,0 +1,33 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <rm/rm.h>
+
+G_BEGIN_DECLS
+
+typedef struct _RogerJournalArchive RogerJournalArchive;
+
+RogerJournalArchive *roger_journal_archive_new (RmProfile *profile);
+void roger_journal_archive_free (RogerJournalArchive *self);
+
+RmProfile *roger_journal_archive_get_profile (RogerJournalArchive *self);
+
+GList *roger_journal_archive_load (RogerJournalArchive *self);
+void roger_journal_archive_store (RogerJournalArchive *self,
+                                  GList               *journal);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (RogerJournalArchive, roger_journal_archive_free)
+
+G_END_DECLS
@@ -0,0 +1,356 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "roger-journal-export.h"
+
+#include <string.h>
+
+/*
+ * Streaming journal export
+ *
+ * The journal is written in chunks as CSV or JSON Lines. A chunk of entries
+ * is formatted on the main thread, where the call entries are owned, and
+ * written asynchronously through a buffered output stream. The next chunk is
+ * formatted once the previous one is written, so memory use does not depend
+ * on the journal size and the main loop keeps running in between.
+ *
+ * The filter is applied while walking the journal list. The list must not be
+ * changed until the export is finished, callers cancel the export instead.
+ *
+ * The destination is written through g_file_replace (), so it is only replaced
+ * once the export is complete. A cancelled or failed export closes the stream
+ * with a cancelled cancellable, which discards the new content.
+ */
+
+#define EXPORT_CHUNK_ENTRIES 1024
+#define EXPORT_BUFFER_SIZE (64 * 1024)
+
+typedef struct {
+  GList *position;
+  guint done;
+  guint total;
+
+  RogerJournalExportFormat format;
+  RogerJournalExportFilterFunc filter_func;
+  RogerJournalExportProgressFunc progress_func;
+  gpointer func_data;
+
+  GOutputStream *stream;
+  GString *chunk;
+} RogerJournalExportData;
+
+static void roger_journal_export_write_chunk (GTask *task);
+
+static void
+roger_journal_export_data_free (RogerJournalExportData *data)
+{
+  if (data->stream && !g_output_stream_is_closed (data->stream)) {
+    g_autoptr (GCancellable) cancelled = g_cancellable_new ();
+
+    g_cancellable_cancel (cancelled);
+    g_output_stream_close (data->stream, cancelled, NULL);
+  }
+
+  g_clear_object (&data->stream);
+  g_string_free (data->chunk, TRUE);
+  g_free (data);
+}
+
+static const char *
+roger_journal_export_type_name (RmCallEntryTypes type)
+{
+  switch (type) {
+    case RM_CALL_ENTRY_TYPE_INCOMING:
+      return "incoming";
+    case RM_CALL_ENTRY_TYPE_MISSED:
+      return "missed";
+    case RM_CALL_ENTRY_TYPE_OUTGOING:
+      return "outgoing";
+    case RM_CALL_ENTRY_TYPE_FAX:
+      return "fax";
+    case RM_CALL_ENTRY_TYPE_FAX_REPORT:
+      return "fax-report";
+    case RM_CALL_ENTRY_TYPE_VOICE:
+      return "voice";
+    case RM_CALL_ENTRY_TYPE_RECORD:
+      return "record";
+    case RM_CALL_ENTRY_TYPE_BLOCKED:
+      return "blocked";
+    default:
+      break;
+  }
+
+  return "unknown";
+}
+
+/**
+ * roger_journal_export_append_csv:
+ * @chunk: string to append to
+ * @value: (nullable): field value
+ * @last: whether @value ends the line
+ *
+ * Appends @value as one field of a ';' separated line. Values containing a
+ * separator, quote or line break are quoted, %NULL is an empty field.
+ */
+void
+roger_journal_export_append_csv (GString    *chunk,
+                                 const char *value,
+                                 gboolean    last)
+{
+  if (value && strpbrk (value, ";\"\r\n")) {
+    const char *ptr;
+
+    g_string_append_c (chunk, '"');
+    for (ptr = value; *ptr; ptr++) {
+      if (*ptr == '"')
+        g_string_append_c (chunk, '"');
+      g_string_append_c (chunk, *ptr);
+    }
+    g_string_append_c (chunk, '"');
+  } else if (value) {
+    g_string_append (chunk, value);
+  }
+
+  g_string_append_c (chunk, last ? '\n' : ';');
+}
+
+static void
+roger_journal_export_append_json (GString    *chunk,
+                                  const char *name,
+                                  const char *value,
+                                  gboolean    last)
+{
+  const char *ptr;
+
+  g_string_append_printf (chunk, "\"%s\":\"", name);
+
+  for (ptr = value ? value : ""; *ptr; ptr++) {
+    switch (*ptr) {
+      case '"':
+        g_string_append (chunk, "\\\"");
+        break;
+      case '\\':
+        g_string_append (chunk, "\\\\");
+        break;
+      case '\n':
+        g_string_append (chunk, "\\n");
+        break;
+      case '\r':
+        g_string_append (chunk, "\\r");
+        break;
+      case '\t':
+        g_string_append (chunk, "\\t");
+        break;
+      default:
+        if ((guchar)*ptr < 0x20)
+          g_string_append_printf (chunk, "\\u%04x", (guchar)*ptr);
+        else
+          g_string_append_c (chunk, *ptr);
+        break;
+    }
+  }
+
+  g_string_append (chunk, last ? "\"}\n" : "\",");
+}
+
+static void
+roger_journal_export_append_call (RogerJournalExportData *data,
+                                  RmCallEntry            *call)
+{
+  const char *type = roger_journal_export_type_name (call->type);
+
+  if (data->format == ROGER_JOURNAL_EXPORT_FORMAT_CSV) {
+    roger_journal_export_append_csv (data->chunk, type, FALSE);
+    roger_journal_export_append_csv (data->chunk, call->date_time, FALSE);
+    roger_journal_export_append_csv (data->chunk, call->remote->name, FALSE);
+    roger_journal_export_append_csv (data->chunk, call->remote->company, FALSE);
+    roger_journal_export_append_csv (data->chunk, call->remote->number, FALSE);
+    roger_journal_export_append_csv (data->chunk, call->remote->city, FALSE);
+    roger_journal_export_append_csv (data->chunk, call->local->name, FALSE);
+    roger_journal_export_append_csv (data->chunk, call->local->number, FALSE);
+    roger_journal_export_append_csv (data->chunk, call->duration, TRUE);
+  } else {
+    g_string_append_c (data->chunk, '{');
+    roger_journal_export_append_json (data->chunk, "type", type, FALSE);
+    roger_journal_export_append_json (data->chunk, "date", call->date_time, FALSE);
+    roger_journal_export_append_json (data->chunk, "name", call->remote->name, FALSE);
+    roger_journal_export_append_json (data->chunk, "company", call->remote->company, FALSE);
+    roger_journal_export_append_json (data->chunk, "number", call->remote->number, FALSE);
+    roger_journal_export_append_json (data->chunk, "city", call->remote->city, FALSE);
+    roger_journal_export_append_json (data->chunk, "extension", call->local->name, FALSE);
+    roger_journal_export_append_json (data->chunk, "line", call->local->number, FALSE);
+    roger_journal_export_append_json (data->chunk, "duration", call->duration, TRUE);
+  }
+}
+
+static void
+roger_journal_export_close_cb (GObject      *source,
+                               GAsyncResult *res,
+                               gpointer      user_data)
+{
+  g_autoptr (GTask) task = user_data;
+  GError *error = NULL;
+
+  if (!g_output_stream_close_finish (G_OUTPUT_STREAM (source), res, &error)) {
+    g_task_return_error (task, error);
+    return;
+  }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static void
+roger_journal_export_write_cb (GObject      *source,
+                               GAsyncResult *res,
+                               gpointer      user_data)
+{
+  g_autoptr (GTask) task = user_data;
+  RogerJournalExportData *data = g_task_get_task_data (task);
+  GError *error = NULL;
+
+  if (!g_output_stream_write_all_finish (G_OUTPUT_STREAM (source), res, NULL, &error)) {
+    g_task_return_error (task, error);
+    return;
+  }
+
+  if (data->progress_func)
+    data->progress_func (data->done, data->total, data->func_data);
+
+  roger_journal_export_write_chunk (g_steal_pointer (&task));
+}
+
+static void
+roger_journal_export_write_chunk (GTask *task)
+{
+  RogerJournalExportData *data = g_task_get_task_data (task);
+  GCancellable *cancellable = g_task_get_cancellable (task);
+  guint count;
+
+  if (g_task_return_error_if_cancelled (task)) {
+    g_object_unref (task);
+    return;
+  }
+
+  if (!data->position) {
+    g_output_stream_close_async (data->stream, G_PRIORITY_DEFAULT, cancellable, roger_journal_export_close_cb, task);
+    return;
+  }
+
+  g_string_truncate (data->chunk, 0);
+  for (count = 0; count < EXPORT_CHUNK_ENTRIES && data->position; count++, data->position = data->position->next) {
+    RmCallEntry *call = data->position->data;
+
+    data->done++;
+
+    if (data->filter_func && !data->filter_func (call, data->func_data))
+      continue;
+
+    roger_journal_export_append_call (data, call);
+  }
+
+  g_output_stream_write_all_async (data->stream,
+                                   data->chunk->str,
+                                   data->chunk->len,
+                                   G_PRIORITY_DEFAULT,
+                                   cancellable,
+                                   roger_journal_export_write_cb,
+                                   task);
+}
+
+static void
+roger_journal_export_replace_cb (GObject      *source,
+                                 GAsyncResult *res,
+                                 gpointer      user_data)
+{
+  GTask *task = user_data;
+  RogerJournalExportData *data = g_task_get_task_data (task);
+  g_autoptr (GFileOutputStream) stream = NULL;
+  GError *error = NULL;
+
+  stream = g_file_replace_finish (G_FILE (source), res, &error);
+  if (!stream) {
+    g_task_return_error (task, error);
+    g_object_unref (task);
+    return;
+  }
+
+  data->stream = g_buffered_output_stream_new_sized (G_OUTPUT_STREAM (stream), EXPORT_BUFFER_SIZE);
+
+  if (data->format == ROGER_JOURNAL_EXPORT_FORMAT_CSV) {
+    /* The header is written with the first chunk */
+    g_string_append (data->chunk, "Type;Date;Name;Company;Number;City;Extension;Line;Duration\n");
+    g_output_stream_write_all_async (data->stream,
+                                     data->chunk->str,
+                                     data->chunk->len,
+                                     G_PRIORITY_DEFAULT,
+                                     g_task_get_cancellable (task),
+                                     roger_journal_export_write_cb,
+                                     task);
+    return;
+  }
+
+  roger_journal_export_write_chunk (task);
+}
+
+/**
+ * roger_journal_export_async:
+ * @journal: journal list of #RmCallEntry
+ * @file: destination file
+ * @format: a #RogerJournalExportFormat
+ * @filter_func: (nullable): only calls it returns %TRUE for are exported
+ * @progress_func: (nullable): called after every written chunk
+ * @func_data: user data for @filter_func and @progress_func
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: called when the export is done
+ * @user_data: user data for @callback
+ *
+ * Exports @journal to @file. @journal must stay unchanged until @callback is
+ * called, cancel the export if it is replaced.
+ */
+void
+roger_journal_export_async (GList                          *journal,
+                            GFile                          *file,
+                            RogerJournalExportFormat        format,
+                            RogerJournalExportFilterFunc    filter_func,
+                            RogerJournalExportProgressFunc  progress_func,
+                            gpointer                        func_data,
+                            GCancellable                   *cancellable,
+                            GAsyncReadyCallback             callback,
+                            gpointer                        user_data)
+{
+  GTask *task = g_task_new (NULL, cancellable, callback, user_data);
+  RogerJournalExportData *data = g_new0 (RogerJournalExportData, 1);
+
+  data->position = journal;
+  data->total = g_list_length (journal);
+  data->format = format;
+  data->filter_func = filter_func;
+  data->progress_func = progress_func;
+  data->func_data = func_data;
+  data->chunk = g_string_sized_new (EXPORT_BUFFER_SIZE);
+
+  g_task_set_source_tag (task, roger_journal_export_async);
+  g_task_set_task_data (task, data, (GDestroyNotify)roger_journal_export_data_free);
+
+  g_file_replace_async (file, NULL, FALSE, G_FILE_CREATE_REPLACE_DESTINATION, G_PRIORITY_DEFAULT, cancellable, roger_journal_export_replace_cb, task);
+}
+
+gboolean
+roger_journal_export_finish (GAsyncResult  *result,
+                             GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, NULL), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
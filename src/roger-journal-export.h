@@ -0,0 +1,47 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+#include <rm/rm.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+  ROGER_JOURNAL_EXPORT_FORMAT_CSV,
+  ROGER_JOURNAL_EXPORT_FORMAT_JSONL
+} RogerJournalExportFormat;
+
+typedef gboolean (*RogerJournalExportFilterFunc) (RmCallEntry *call,
+                                                  gpointer     user_data);
+typedef void (*RogerJournalExportProgressFunc) (guint    done,
+                                                guint    total,
+                                                gpointer user_data);
+
+void roger_journal_export_async (GList                          *journal,
+                                 GFile                          *file,
+                                 RogerJournalExportFormat        format,
+                                 RogerJournalExportFilterFunc    filter_func,
+                                 RogerJournalExportProgressFunc  progress_func,
+                                 gpointer                        func_data,
+                                 GCancellable                   *cancellable,
+                                 GAsyncReadyCallback             callback,
+                                 gpointer                        user_data);
+gboolean roger_journal_export_finish (GAsyncResult  *result,
+                                      GError       **error);
+
+void roger_journal_export_append_csv (GString    *chunk,
+                                      const char *value,
+                                      gboolean    last);
+
+G_END_DECLS
@@ -0,0 +1,466 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "roger-journal-filter.h"
+
+#include "roger-journal-time.h"
+
+#include <string.h>
+
+/*
+ * Precompiled journal filter
+ *
+ * rm_filter_rule_match () interprets the rule list of a filter for every call
+ * entry. A journal filter is compiled once into a flat list of operations which
+ * are evaluated in a tight loop, a call has to pass all of them:
+ *
+ *  - The call type rules are reduced to a bitmask of matching types. The mask
+ *    is computed by probing librm once per type, so the result is identical
+ *    to rm_filter_rule_match ().
+ *  - Remote name/number rules become string operations with a pre-normalized
+ *    needle, matched case-insensitively. librm's string semantics are not
+ *    documented, so each compiled rule is probed against librm once with
+ *    case and position variants of its entry. Rules on which both disagree
+ *    stay with librm.
+ *  - Date rules naming a full day ("dd.mm.yy") or minute ("dd.mm.yy hh:mm")
+ *    become a range of unix times, compared against the parsed call date.
+ *
+ * Any other rule is handed over to rm_filter_rule_match () on its own.
+ */
+
+#define TYPE_MASK_BITS 32
+
+#define DATE_FORMAT_LEN 8
+#define DATE_TIME_FORMAT_LEN 14
+
+typedef enum {
+  ROGER_JOURNAL_FILTER_OP_TYPE_MASK,
+  ROGER_JOURNAL_FILTER_OP_STRING,
+  ROGER_JOURNAL_FILTER_OP_DATE,
+  ROGER_JOURNAL_FILTER_OP_RULE,
+} RogerJournalFilterOpcode;
+
+typedef struct {
+  RogerJournalFilterOpcode opcode;
+
+  /* Rules of this operation, for calls it cannot decide itself */
+  RmFilter *rules;
+
+  guint32 type_mask;
+
+  gint field;
+  gint sub_type;
+  char *needle;
+  gsize needle_len;
+  gboolean ascii;
+
+  gint64 start;
+  gint64 end;
+  gboolean negate;
+} RogerJournalFilterOp;
+
+struct _RogerJournalFilter {
+  GArray *ops;
+  gboolean needs_time;
+};
+
+static void
+roger_journal_filter_op_clear (gpointer data)
+{
+  RogerJournalFilterOp *op = data;
+
+  g_clear_pointer (&op->needle, g_free);
+
+  if (op->rules) {
+    /* The rules themselves belong to the compiled filter */
+    g_slist_free (op->rules->rules);
+    g_clear_pointer (&op->rules, g_free);
+  }
+}
+
+static RmFilter *
+roger_journal_filter_rules_new (GSList *rules)
+{
+  RmFilter *filter = g_new0 (RmFilter, 1);
+
+  filter->rules = rules;
+
+  return filter;
+}
+
+static char *
+roger_journal_filter_normalize (const char *str)
+{
+  g_autofree char *normalized = g_utf8_normalize (str, -1, G_NORMALIZE_ALL);
+
+  return g_utf8_casefold (normalized ? normalized : str, -1);
+}
+
+static void
+roger_journal_filter_compile_type_mask (RogerJournalFilter *self,
+                                        RmFilter           *filter)
+{
+  RogerJournalFilterOp op = { 0 };
+  RmContact contact = { 0 };
+  RmCallEntry probe = { 0 };
+  GSList *type_rules = NULL;
+  GSList *list;
+  guint type;
+
+  for (list = filter->rules; list != NULL; list = list->next) {
+    RmFilterRule *rule = list->data;
+
+    if (rule->type == RM_FILTER_CALL_TYPE)
+      type_rules = g_slist_append (type_rules, rule);
+  }
+
+  if (!type_rules)
+    return;
+
+  probe.remote = &contact;
+  probe.local = &contact;
+
+  op.opcode = ROGER_JOURNAL_FILTER_OP_TYPE_MASK;
+  op.rules = roger_journal_filter_rules_new (type_rules);
+  for (type = 0; type < TYPE_MASK_BITS; type++) {
+    probe.type = type;
+
+    if (rm_filter_rule_match (op.rules, &probe))
+      op.type_mask |= 1u << type;
+  }
+
+  g_array_append_val (self->ops, op);
+}
+
+static gboolean roger_journal_filter_match_string (RogerJournalFilterOp *op,
+                                                   RmCallEntry          *call);
+
+static char *
+roger_journal_filter_swap_case (const char *str)
+{
+  char *swapped = g_strdup (str);
+  char *ptr;
+
+  for (ptr = swapped; *ptr != '\0'; ptr++)
+    *ptr = g_ascii_isupper (*ptr) ? g_ascii_tolower (*ptr) : g_ascii_toupper (*ptr);
+
+  return swapped;
+}
+
+/* Checks that @op decides like librm on variants of its own entry */
+static gboolean
+roger_journal_filter_probe_string (RogerJournalFilterOp *op,
+                                   const char           *entry)
+{
+  g_autofree char *upper = g_utf8_strup (entry, -1);
+  g_autofree char *lower = g_utf8_strdown (entry, -1);
+  g_autofree char *swapped = roger_journal_filter_swap_case (entry);
+  g_autofree char *prefixed = g_strconcat ("x", entry, NULL);
+  g_autofree char *suffixed = g_strconcat (entry, "x", NULL);
+  g_autofree char *truncated = g_utf8_substring (entry, 0, MAX (g_utf8_strlen (entry, -1) - 1, 0));
+  const char *probes[] = { entry, upper, lower, swapped, prefixed, suffixed, truncated, "" };
+  RmContact contact = { 0 };
+  RmCallEntry probe = { 0 };
+  guint idx;
+
+  probe.remote = &contact;
+  probe.local = &contact;
+
+  for (idx = 0; idx < G_N_ELEMENTS (probes); idx++) {
+    contact.name = (char *)probes[idx];
+    contact.number = (char *)probes[idx];
+
+    if (!rm_filter_rule_match (op->rules, &probe) != !roger_journal_filter_match_string (op, &probe))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+roger_journal_filter_compile_string (RogerJournalFilter *self,
+                                     RmFilterRule       *rule)
+{
+  RogerJournalFilterOp op = { 0 };
+
+  if (rule->type != RM_FILTER_REMOTE_NAME && rule->type != RM_FILTER_REMOTE_NUMBER)
+    return FALSE;
+
+  switch (rule->sub_type) {
+    case RM_FILTER_IS:
+    case RM_FILTER_IS_NOT:
+    case RM_FILTER_BEGINS_WITH:
+    case RM_FILTER_CONTAINS:
+      break;
+    default:
+      return FALSE;
+  }
+
+  op.opcode = ROGER_JOURNAL_FILTER_OP_STRING;
+  op.field = rule->type;
+  op.sub_type = rule->sub_type;
+  op.ascii = g_str_is_ascii (rule->entry ? rule->entry : "");
+  op.needle = op.ascii ? g_ascii_strdown (rule->entry ? rule->entry : "", -1) : roger_journal_filter_normalize (rule->entry);
+  op.needle_len = strlen (op.needle);
+  op.rules = roger_journal_filter_rules_new (g_slist_append (NULL, rule));
+
+  if (!roger_journal_filter_probe_string (&op, rule->entry ? rule->entry : "")) {
+    roger_journal_filter_op_clear (&op);
+    return FALSE;
+  }
+
+  g_array_append_val (self->ops, op);
+
+  return TRUE;
+}
+
+static gint64
+roger_journal_filter_add_day (gint64 time)
+{
+  g_autoptr (GDateTime) date = g_date_time_new_from_unix_local (time);
+  g_autoptr (GDateTime) next = g_date_time_add_days (date, 1);
+
+  return g_date_time_to_unix (next);
+}
+
+static gboolean
+roger_journal_filter_compile_date (RogerJournalFilter *self,
+                                   RmFilterRule       *rule)
+{
+  RogerJournalFilterOp op = { 0 };
+  g_autofree char *date_time = NULL;
+  const char *entry = rule->entry ? rule->entry : "";
+  gsize len = strlen (entry);
+
+  if (rule->type != RM_FILTER_DATE_TIME)
+    return FALSE;
+
+  /* Only full dates or minutes map onto a range of the parsed call times */
+  if (len == DATE_FORMAT_LEN)
+    date_time = g_strconcat (entry, " 00:00", NULL);
+  else if (len == DATE_TIME_FORMAT_LEN)
+    date_time = g_strdup (entry);
+  else
+    return FALSE;
+
+  op.start = roger_journal_time_parse_date (date_time);
+  if (op.start == 0)
+    return FALSE;
+
+  switch (rule->sub_type) {
+    case RM_FILTER_IS:
+      if (len != DATE_TIME_FORMAT_LEN)
+        return FALSE;
+      break;
+    case RM_FILTER_IS_NOT:
+      if (len != DATE_TIME_FORMAT_LEN)
+        return FALSE;
+      op.negate = TRUE;
+      break;
+    case RM_FILTER_BEGINS_WITH:
+    case RM_FILTER_CONTAINS:
+      /* A full date can only occur at the start of the journal date */
+      break;
+    default:
+      return FALSE;
+  }
+
+  op.opcode = ROGER_JOURNAL_FILTER_OP_DATE;
+  op.end = len == DATE_FORMAT_LEN ? roger_journal_filter_add_day (op.start) : op.start + 60;
+  op.rules = roger_journal_filter_rules_new (g_slist_append (NULL, rule));
+
+  g_array_append_val (self->ops, op);
+  self->needs_time = TRUE;
+
+  return TRUE;
+}
+
+static void
+roger_journal_filter_compile_rule (RogerJournalFilter *self,
+                                   RmFilterRule       *rule)
+{
+  RogerJournalFilterOp op = { 0 };
+
+  op.opcode = ROGER_JOURNAL_FILTER_OP_RULE;
+  op.rules = roger_journal_filter_rules_new (g_slist_append (NULL, rule));
+
+  g_array_append_val (self->ops, op);
+}
+
+/**
+ * roger_journal_filter_compile:
+ * @filter: (nullable): a #RmFilter
+ *
+ * Compiles @filter into a predicate program. The filter rules must stay valid
+ * as long as the program is used.
+ *
+ * Returns: a new #RogerJournalFilter, free with roger_journal_filter_free()
+ */
+RogerJournalFilter *
+roger_journal_filter_compile (RmFilter *filter)
+{
+  RogerJournalFilter *self = g_new0 (RogerJournalFilter, 1);
+  GSList *list;
+
+  self->ops = g_array_new (FALSE, TRUE, sizeof (RogerJournalFilterOp));
+  g_array_set_clear_func (self->ops, roger_journal_filter_op_clear);
+
+  if (!filter)
+    return self;
+
+  roger_journal_filter_compile_type_mask (self, filter);
+
+  for (list = filter->rules; list != NULL; list = list->next) {
+    RmFilterRule *rule = list->data;
+
+    if (rule->type == RM_FILTER_CALL_TYPE)
+      continue;
+
+    if (roger_journal_filter_compile_string (self, rule) || roger_journal_filter_compile_date (self, rule))
+      continue;
+
+    g_debug ("%s(): Rule %d of filter '%s' is evaluated by librm", __FUNCTION__, rule->type, filter->name);
+    roger_journal_filter_compile_rule (self, rule);
+  }
+
+  return self;
+}
+
+void
+roger_journal_filter_free (RogerJournalFilter *self)
+{
+  if (!self)
+    return;
+
+  g_array_unref (self->ops);
+  g_free (self);
+}
+
+static gboolean
+roger_journal_filter_ascii_contains (const char *haystack,
+                                     const char *needle,
+                                     gsize       needle_len)
+{
+  char lower;
+  char upper;
+
+  if (needle_len == 0)
+    return TRUE;
+
+  lower = needle[0];
+  upper = g_ascii_toupper (lower);
+
+  for (; *haystack != '\0'; haystack++) {
+    if (*haystack != lower && *haystack != upper)
+      continue;
+
+    if (g_ascii_strncasecmp (haystack, needle, needle_len) == 0)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+static gboolean
+roger_journal_filter_match_string (RogerJournalFilterOp *op,
+                                   RmCallEntry          *call)
+{
+  const char *haystack = op->field == RM_FILTER_REMOTE_NAME ? call->remote->name : call->remote->number;
+  g_autofree char *normalized = NULL;
+
+  if (!haystack)
+    haystack = "";
+
+  if (op->ascii) {
+    switch (op->sub_type) {
+      case RM_FILTER_IS:
+        return g_ascii_strcasecmp (haystack, op->needle) == 0;
+      case RM_FILTER_IS_NOT:
+        return g_ascii_strcasecmp (haystack, op->needle) != 0;
+      case RM_FILTER_BEGINS_WITH:
+        return g_ascii_strncasecmp (haystack, op->needle, op->needle_len) == 0;
+      default:
+        return roger_journal_filter_ascii_contains (haystack, op->needle, op->needle_len);
+    }
+  }
+
+  normalized = roger_journal_filter_normalize (haystack);
+
+  switch (op->sub_type) {
+    case RM_FILTER_IS:
+      return strcmp (normalized, op->needle) == 0;
+    case RM_FILTER_IS_NOT:
+      return strcmp (normalized, op->needle) != 0;
+    case RM_FILTER_BEGINS_WITH:
+      return strncmp (normalized, op->needle, op->needle_len) == 0;
+    default:
+      return strstr (normalized, op->needle) != NULL;
+  }
+}
+
+/**
+ * roger_journal_filter_match:
+ * @self: (nullable): a #RogerJournalFilter
+ * @call: a #RmCallEntry
+ * @time: parsed date of @call, or 0 to parse it when needed
+ *
+ * Returns: %TRUE if @call passes the filter, a %NULL program matches all calls
+ */
+gboolean
+roger_journal_filter_match (RogerJournalFilter *self,
+                            RmCallEntry        *call,
+                            gint64              time)
+{
+  guint idx;
+
+  if (!self)
+    return TRUE;
+
+  if (self->needs_time && time == 0)
+    time = roger_journal_time_parse_date (call->date_time);
+
+  for (idx = 0; idx < self->ops->len; idx++) {
+    RogerJournalFilterOp *op = &g_array_index (self->ops, RogerJournalFilterOp, idx);
+
+    switch (op->opcode) {
+      case ROGER_JOURNAL_FILTER_OP_TYPE_MASK:
+        if ((guint)call->type >= TYPE_MASK_BITS) {
+          if (!rm_filter_rule_match (op->rules, call))
+            return FALSE;
+        } else if (!(op->type_mask & (1u << call->type))) {
+          return FALSE;
+        }
+        break;
+      case ROGER_JOURNAL_FILTER_OP_STRING:
+        if (!roger_journal_filter_match_string (op, call))
+          return FALSE;
+        break;
+      case ROGER_JOURNAL_FILTER_OP_DATE:
+        /* Dates the journal parser does not understand are left to librm */
+        if (time == 0) {
+          if (!rm_filter_rule_match (op->rules, call))
+            return FALSE;
+        } else if ((time >= op->start && time < op->end) == op->negate) {
+          return FALSE;
+        }
+        break;
+      case ROGER_JOURNAL_FILTER_OP_RULE:
+        if (!rm_filter_rule_match (op->rules, call))
+          return FALSE;
+        break;
+    }
+  }
+
+  return TRUE;
+}
@@ -0,0 +1,446 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "roger-journal-index.h"
+
+#include <string.h>
+
+/*
+ * Journal search index
+ *
+ * For every journal entry the remote name, number, company and city are
+ * normalized into one search text. Each byte trigram of that text points to an
+ * ascending list of entry ids. A query is answered by intersecting the posting
+ * lists of its trigrams and verifying the remaining candidates with a
+ * substring compare. Queries shorter than a trigram scan the candidates
+ * directly.
+ *
+ * If a query extends the previous one, only the previous matches are
+ * considered, so typing refines the result set instead of starting over.
+ *
+ * Searches may run in a worker thread while entries are updated from the main
+ * thread, the index is guarded by a reader/writer lock.
+ */
+
+#define FIELD_SEPARATOR '\n'
+#define CANCEL_CHECK_INTERVAL 4096
+
+struct _RogerJournalIndex {
+  gint ref_count;
+  GRWLock lock;
+
+  GPtrArray *entries;
+  GPtrArray *texts;
+  GHashTable *ids;
+  GHashTable *trigrams;
+};
+
+struct _RogerJournalIndexResult {
+  gint ref_count;
+  RogerJournalIndex *index;
+  char *query;
+  GArray *ids;
+  guint32 *bits;
+};
+
+static char *
+roger_journal_index_normalize (const char *str)
+{
+  g_autofree char *normalized = NULL;
+
+  if (g_str_is_ascii (str))
+    return g_ascii_strdown (str, -1);
+
+  normalized = g_utf8_normalize (str, -1, G_NORMALIZE_ALL);
+
+  return g_utf8_casefold (normalized ? normalized : str, -1);
+}
+
+static char *
+roger_journal_index_build_text (RmCallEntry *call)
+{
+  const char *fields[] = {
+    call->remote->name,
+    call->remote->number,
+    call->remote->company,
+    call->remote->city,
+  };
+  GString *text = g_string_new (NULL);
+  guint idx;
+
+  for (idx = 0; idx < G_N_ELEMENTS (fields); idx++) {
+    g_autofree char *field = NULL;
+
+    if (RM_EMPTY_STRING (fields[idx]))
+      continue;
+
+    field = roger_journal_index_normalize (fields[idx]);
+    if (text->len)
+      g_string_append_c (text, FIELD_SEPARATOR);
+    g_string_append (text, field);
+  }
+
+  return g_string_free (text, FALSE);
+}
+
+static inline guint32
+roger_journal_index_trigram (const char *str)
+{
+  return (guint8)str[0] | ((guint8)str[1] << 8) | ((guint8)str[2] << 16);
+}
+
+static inline gboolean
+roger_journal_index_is_trigram (const char *str)
+{
+  return str[0] != FIELD_SEPARATOR && str[1] != FIELD_SEPARATOR && str[2] != FIELD_SEPARATOR;
+}
+
+static GArray *
+roger_journal_index_get_postings (RogerJournalIndex *self,
+                                  guint32            trigram,
+                                  gboolean           create)
+{
+  GArray *postings = g_hash_table_lookup (self->trigrams, GUINT_TO_POINTER (trigram));
+
+  if (!postings && create) {
+    postings = g_array_new (FALSE, FALSE, sizeof (guint));
+    g_hash_table_insert (self->trigrams, GUINT_TO_POINTER (trigram), postings);
+  }
+
+  return postings;
+}
+
+static void
+roger_journal_index_add_postings (RogerJournalIndex *self,
+                                  guint              id,
+                                  const char        *text)
+{
+  gsize len = strlen (text);
+  gsize pos;
+
+  for (pos = 0; pos + 3 <= len; pos++) {
+    GArray *postings;
+    guint lower = 0;
+    guint upper;
+
+    if (!roger_journal_index_is_trigram (text + pos))
+      continue;
+
+    postings = roger_journal_index_get_postings (self, roger_journal_index_trigram (text + pos), TRUE);
+
+    /* Entries are indexed in ascending order, so this is usually an append */
+    upper = postings->len;
+    if (upper > 0 && g_array_index (postings, guint, upper - 1) < id) {
+      g_array_append_val (postings, id);
+      continue;
+    }
+
+    while (lower < upper) {
+      guint mid = lower + (upper - lower) / 2;
+
+      if (g_array_index (postings, guint, mid) < id)
+        lower = mid + 1;
+      else
+        upper = mid;
+    }
+
+    if (lower < postings->len && g_array_index (postings, guint, lower) == id)
+      continue;
+
+    g_array_insert_val (postings, lower, id);
+  }
+}
+
+/**
+ * roger_journal_index_new:
+ * @journal: journal list of #RmCallEntry
+ *
+ * Builds a search index for @journal. The entries must stay valid as long as
+ * the index is used.
+ *
+ * Returns: a new #RogerJournalIndex
+ */
+RogerJournalIndex *
+roger_journal_index_new (GList *journal)
+{
+  RogerJournalIndex *self = g_new0 (RogerJournalIndex, 1);
+  GList *list;
+
+  self->ref_count = 1;
+  g_rw_lock_init (&self->lock);
+  self->entries = g_ptr_array_new ();
+  self->texts = g_ptr_array_new_with_free_func (g_free);
+  self->ids = g_hash_table_new (g_direct_hash, g_direct_equal);
+  self->trigrams = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_array_unref);
+
+  for (list = journal; list != NULL; list = list->next) {
+    RmCallEntry *call = list->data;
+    guint id = self->entries->len;
+    char *text = roger_journal_index_build_text (call);
+
+    g_ptr_array_add (self->entries, call);
+    g_ptr_array_add (self->texts, text);
+    g_hash_table_insert (self->ids, call, GUINT_TO_POINTER (id + 1));
+
+    roger_journal_index_add_postings (self, id, text);
+  }
+
+  return self;
+}
+
+RogerJournalIndex *
+roger_journal_index_ref (RogerJournalIndex *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  g_atomic_int_inc (&self->ref_count);
+
+  return self;
+}
+
+void
+roger_journal_index_unref (RogerJournalIndex *self)
+{
+  if (!self || !g_atomic_int_dec_and_test (&self->ref_count))
+    return;
+
+  g_ptr_array_unref (self->entries);
+  g_ptr_array_unref (self->texts);
+  g_hash_table_unref (self->ids);
+  g_hash_table_unref (self->trigrams);
+  g_rw_lock_clear (&self->lock);
+  g_free (self);
+}
+
+/**
+ * roger_journal_index_update:
+ * @self: a #RogerJournalIndex
+ * @call: a #RmCallEntry of the indexed journal
+ *
+ * Re-indexes @call after its remote contact changed, e.g. by a reverse lookup.
+ */
+void
+roger_journal_index_update (RogerJournalIndex *self,
+                            RmCallEntry       *call)
+{
+  gpointer id = g_hash_table_lookup (self->ids, call);
+  char *text;
+
+  if (!id)
+    return;
+
+  /* Stale postings are harmless, candidates are verified against the new text */
+  text = roger_journal_index_build_text (call);
+
+  g_rw_lock_writer_lock (&self->lock);
+  g_free (g_ptr_array_index (self->texts, GPOINTER_TO_UINT (id) - 1));
+  g_ptr_array_index (self->texts, GPOINTER_TO_UINT (id) - 1) = text;
+
+  roger_journal_index_add_postings (self, GPOINTER_TO_UINT (id) - 1, text);
+  g_rw_lock_writer_unlock (&self->lock);
+}
+
+static GArray *
+roger_journal_index_intersect (GArray *a,
+                               GArray *b)
+{
+  GArray *result = g_array_sized_new (FALSE, FALSE, sizeof (guint), MIN (a->len, b->len));
+  guint idx_a = 0;
+  guint idx_b = 0;
+
+  while (idx_a < a->len && idx_b < b->len) {
+    guint id_a = g_array_index (a, guint, idx_a);
+    guint id_b = g_array_index (b, guint, idx_b);
+
+    if (id_a < id_b) {
+      idx_a++;
+    } else if (id_a > id_b) {
+      idx_b++;
+    } else {
+      g_array_append_val (result, id_a);
+      idx_a++;
+      idx_b++;
+    }
+  }
+
+  return result;
+}
+
+static gint
+roger_journal_index_compare_postings (gconstpointer a,
+                                      gconstpointer b)
+{
+  const GArray *postings_a = *(const GArray **)a;
+  const GArray *postings_b = *(const GArray **)b;
+
+  return postings_a->len < postings_b->len ? -1 : postings_a->len > postings_b->len ? 1 : 0;
+}
+
+static GArray *
+roger_journal_index_get_candidates (RogerJournalIndex *self,
+                                    const char        *query,
+                                    GArray            *previous)
+{
+  g_autoptr (GPtrArray) lists = g_ptr_array_new ();
+  gsize len = strlen (query);
+  GArray *candidates = NULL;
+  gsize pos;
+  guint idx;
+
+  for (pos = 0; pos + 3 <= len; pos++) {
+    GArray *postings = roger_journal_index_get_postings (self, roger_journal_index_trigram (query + pos), FALSE);
+
+    if (!postings)
+      return g_array_new (FALSE, FALSE, sizeof (guint));
+
+    g_ptr_array_add (lists, postings);
+  }
+
+  if (previous)
+    g_ptr_array_add (lists, previous);
+
+  if (lists->len == 0) {
+    /* Query is shorter than a trigram, every entry is a candidate */
+    candidates = g_array_sized_new (FALSE, FALSE, sizeof (guint), self->entries->len);
+    for (idx = 0; idx < self->entries->len; idx++)
+      g_array_append_val (candidates, idx);
+
+    return candidates;
+  }
+
+  /* Start with the shortest list to keep intermediate results small */
+  g_ptr_array_sort (lists, roger_journal_index_compare_postings);
+
+  candidates = g_array_ref (g_ptr_array_index (lists, 0));
+  for (idx = 1; idx < lists->len && candidates->len > 0; idx++) {
+    GArray *next = roger_journal_index_intersect (candidates, g_ptr_array_index (lists, idx));
+
+    g_array_unref (candidates);
+    candidates = next;
+  }
+
+  return candidates;
+}
+
+/**
+ * roger_journal_index_search:
+ * @self: a #RogerJournalIndex
+ * @query: search text
+ * @previous: (nullable): result of the previous search
+ * @cancellable: (nullable): a #GCancellable
+ *
+ * Searches the remote name, number, company and city of all indexed entries.
+ * If @query contains the query of @previous, only its matches are checked.
+ * Can be called from any thread.
+ *
+ * Returns: (nullable): a new #RogerJournalIndexResult, or %NULL for an empty
+ * query or if the search was cancelled
+ */
+RogerJournalIndexResult *
+roger_journal_index_search (RogerJournalIndex       *self,
+                            const char              *query,
+                            RogerJournalIndexResult *previous,
+                            GCancellable            *cancellable)
+{
+  RogerJournalIndexResult *result;
+  g_autoptr (GArray) candidates = NULL;
+  GArray *refine = NULL;
+  guint idx;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  if (RM_EMPTY_STRING (query))
+    return NULL;
+
+  result = g_new0 (RogerJournalIndexResult, 1);
+  result->ref_count = 1;
+  result->index = roger_journal_index_ref (self);
+  result->query = roger_journal_index_normalize (query);
+  result->ids = g_array_new (FALSE, FALSE, sizeof (guint));
+  result->bits = g_new0 (guint32, self->entries->len / 32 + 1);
+
+  if (previous && previous->index == self && strstr (result->query, previous->query))
+    refine = previous->ids;
+
+  g_rw_lock_reader_lock (&self->lock);
+
+  candidates = roger_journal_index_get_candidates (self, result->query, refine);
+
+  for (idx = 0; idx < candidates->len; idx++) {
+    guint id = g_array_index (candidates, guint, idx);
+
+    if (idx % CANCEL_CHECK_INTERVAL == 0 && g_cancellable_is_cancelled (cancellable))
+      break;
+
+    if (!strstr (g_ptr_array_index (self->texts, id), result->query))
+      continue;
+
+    g_array_append_val (result->ids, id);
+    result->bits[id / 32] |= 1u << (id % 32);
+  }
+
+  g_rw_lock_reader_unlock (&self->lock);
+
+  if (g_cancellable_is_cancelled (cancellable))
+    g_clear_pointer (&result, roger_journal_index_result_unref);
+
+  return result;
+}
+
+gboolean
+roger_journal_index_result_contains (RogerJournalIndexResult *result,
+                                     RmCallEntry             *call)
+{
+  guint id;
+
+  if (!result)
+    return TRUE;
+
+  id = GPOINTER_TO_UINT (g_hash_table_lookup (result->index->ids, call));
+  if (!id)
+    return FALSE;
+
+  id--;
+
+  return (result->bits[id / 32] & (1u << (id % 32))) != 0;
+}
+
+guint
+roger_journal_index_result_get_n_matches (RogerJournalIndexResult *result)
+{
+  return result ? result->ids->len : 0;
+}
+
+RogerJournalIndexResult *
+roger_journal_index_result_ref (RogerJournalIndexResult *result)
+{
+  g_return_val_if_fail (result != NULL, NULL);
+
+  g_atomic_int_inc (&result->ref_count);
+
+  return result;
+}
+
+void
+roger_journal_index_result_unref (RogerJournalIndexResult *result)
+{
+  if (!result || !g_atomic_int_dec_and_test (&result->ref_count))
+    return;
+
+  roger_journal_index_unref (result->index);
+  g_array_unref (result->ids);
+  g_free (result->query);
+  g_free (result->bits);
+  g_free (result);
+}
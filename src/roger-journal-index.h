@@ -0,0 +1,45 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <rm/rm.h>
+
+G_BEGIN_DECLS
+
+typedef struct _RogerJournalIndex RogerJournalIndex;
+typedef struct _RogerJournalIndexResult RogerJournalIndexResult;
+
+RogerJournalIndex *roger_journal_index_new (GList *journal);
+RogerJournalIndex *roger_journal_index_ref (RogerJournalIndex *self);
+void roger_journal_index_unref (RogerJournalIndex *self);
+
+void roger_journal_index_update (RogerJournalIndex *self,
+                                 RmCallEntry       *call);
+
+RogerJournalIndexResult *roger_journal_index_search (RogerJournalIndex       *self,
+                                                     const char              *query,
+                                                     RogerJournalIndexResult *previous,
+                                                     GCancellable            *cancellable);
+
+gboolean roger_journal_index_result_contains (RogerJournalIndexResult *result,
+                                              RmCallEntry             *call);
+guint roger_journal_index_result_get_n_matches (RogerJournalIndexResult *result);
+RogerJournalIndexResult *roger_journal_index_result_ref (RogerJournalIndexResult *result);
+void roger_journal_index_result_unref (RogerJournalIndexResult *result);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (RogerJournalIndex, roger_journal_index_unref)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (RogerJournalIndexResult, roger_journal_index_result_unref)
+
+G_END_DECLS
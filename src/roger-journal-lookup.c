@@ -0,0 +1,302 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "roger-journal-lookup.h"
+
+#include "roger-journal-strings.h"
+#include "roger-lookup-cache.h"
+
+/*
+ * Journal reverse lookup scheduler
+ *
+ * Calls without a remote name are grouped by number, so every number is
+ * looked up once. The lookups run on a shared worker thread against a private
+ * copy of the contact. librm lookup plugins are not known to be thread safe,
+ * so the worker runs them one after another. Finished lookups are collected
+ * and applied to all calls of that number on the main thread in batches, so
+ * the journal fills in progressively.
+ *
+ * Numbers with a valid entry in the lookup cache are not looked up again,
+ * new results are added to the cache.
+ */
+
+#define LOOKUP_BATCH_INTERVAL_MS 100
+
+struct _RogerJournalLookup {
+  gint ref_count;
+
+  GMutex mutex;
+  gint cancelled;
+  guint remaining;
+  guint flush_id;
+  GPtrArray *finished;
+
+  RogerJournalLookupBatchFunc batch_func;
+  RogerJournalLookupDoneFunc done_func;
+  gpointer user_data;
+};
+
+typedef struct {
+  RogerJournalLookup *lookup;
+  char *number;
+  RmContact *contact;
+  GPtrArray *calls;
+  gboolean found;
+  gboolean cached;
+} RogerJournalLookupJob;
+
+static GThreadPool *lookup_pool = NULL;
+
+static RogerJournalLookup *
+roger_journal_lookup_ref (RogerJournalLookup *self)
+{
+  g_atomic_int_inc (&self->ref_count);
+
+  return self;
+}
+
+static void
+roger_journal_lookup_unref (RogerJournalLookup *self)
+{
+  if (!g_atomic_int_dec_and_test (&self->ref_count))
+    return;
+
+  g_ptr_array_unref (self->finished);
+  g_mutex_clear (&self->mutex);
+  g_free (self);
+}
+
+static void
+roger_journal_lookup_job_free (RogerJournalLookupJob *job)
+{
+  roger_journal_lookup_unref (job->lookup);
+  rm_contact_free (job->contact);
+  g_ptr_array_unref (job->calls);
+  g_free (job->number);
+  g_free (job);
+}
+
+static gboolean
+roger_journal_lookup_flush_cb (gpointer user_data)
+{
+  RogerJournalLookup *self = user_data;
+  g_autoptr (GPtrArray) jobs = NULL;
+  g_autoptr (GPtrArray) batch = g_ptr_array_new ();
+  RogerLookupCache *cache = roger_lookup_cache_get_default ();
+  gboolean done;
+  guint idx;
+
+  g_mutex_lock (&self->mutex);
+  self->flush_id = 0;
+  jobs = g_steal_pointer (&self->finished);
+  self->finished = g_ptr_array_new_with_free_func ((GDestroyNotify)roger_journal_lookup_job_free);
+  self->remaining -= jobs->len;
+  done = self->remaining == 0;
+  g_mutex_unlock (&self->mutex);
+
+  for (idx = 0; idx < jobs->len; idx++) {
+    RogerJournalLookupJob *job = g_ptr_array_index (jobs, idx);
+    guint call_idx;
+
+    if (!job->cached)
+      roger_lookup_cache_insert (cache, job->number, job->found ? job->contact->name : NULL, job->found ? job->contact->city : NULL);
+
+    if (!job->found)
+      continue;
+
+    for (call_idx = 0; call_idx < job->calls->len; call_idx++) {
+      RmCallEntry *call = g_ptr_array_index (job->calls, call_idx);
+
+      /* librm replaces the fields, interned ones must not be freed by it */
+      roger_journal_strings_release_contact (call->remote);
+      rm_contact_copy (job->contact, call->remote);
+      roger_journal_strings_intern_contact (call->remote);
+      call->remote->lookup = TRUE;
+      g_ptr_array_add (batch, call);
+    }
+  }
+
+  if (batch->len)
+    self->batch_func (batch, self->user_data);
+
+  if (done) {
+    roger_lookup_cache_save (cache);
+
+    if (self->done_func)
+      self->done_func (self->user_data);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+roger_journal_lookup_schedule_flush (RogerJournalLookup *self)
+{
+  if (self->cancelled || self->flush_id)
+    return;
+
+  self->flush_id = g_timeout_add_full (G_PRIORITY_DEFAULT,
+                                       LOOKUP_BATCH_INTERVAL_MS,
+                                       roger_journal_lookup_flush_cb,
+                                       roger_journal_lookup_ref (self),
+                                       (GDestroyNotify)roger_journal_lookup_unref);
+}
+
+static void
+roger_journal_lookup_thread_cb (gpointer data,
+                                gpointer user_data)
+{
+  RogerJournalLookupJob *job = data;
+  RogerJournalLookup *self = job->lookup;
+
+  if (!g_atomic_int_get (&self->cancelled))
+    job->found = rm_lookup_search (job->number, job->contact);
+
+  g_mutex_lock (&self->mutex);
+  if (self->cancelled) {
+    g_mutex_unlock (&self->mutex);
+    roger_journal_lookup_job_free (job);
+    return;
+  }
+
+  g_ptr_array_add (self->finished, job);
+  roger_journal_lookup_schedule_flush (self);
+  g_mutex_unlock (&self->mutex);
+}
+
+/**
+ * roger_journal_lookup_new:
+ * @journal: journal list of #RmCallEntry
+ * @batch_func: called on the main thread with calls which got a name
+ * @done_func: (nullable): called on the main thread once all lookups finished
+ * @user_data: user data for @batch_func and @done_func
+ *
+ * Starts reverse lookups for all calls of @journal without a remote name. The
+ * journal must stay valid until roger_journal_lookup_free() is called.
+ *
+ * Returns: a new #RogerJournalLookup
+ */
+RogerJournalLookup *
+roger_journal_lookup_new (GList                       *journal,
+                          RogerJournalLookupBatchFunc  batch_func,
+                          RogerJournalLookupDoneFunc   done_func,
+                          gpointer                     user_data)
+{
+  RogerJournalLookup *self = g_new0 (RogerJournalLookup, 1);
+  RogerLookupCache *cache = roger_lookup_cache_get_default ();
+  g_autoptr (GHashTable) numbers = g_hash_table_new (g_direct_hash, g_direct_equal);
+  g_autoptr (GPtrArray) jobs = g_ptr_array_new ();
+  GList *list;
+  guint idx;
+
+  self->ref_count = 1;
+  g_mutex_init (&self->mutex);
+  self->finished = g_ptr_array_new_with_free_func ((GDestroyNotify)roger_journal_lookup_job_free);
+  self->batch_func = batch_func;
+  self->done_func = done_func;
+  self->user_data = user_data;
+
+  for (list = journal; list != NULL; list = list->next) {
+    RmCallEntry *call = list->data;
+    RogerJournalLookupJob *job;
+
+    if (!RM_EMPTY_STRING (call->remote->name) || RM_EMPTY_STRING (call->remote->number))
+      continue;
+
+    /* Remote numbers are interned, equal numbers share one pointer */
+    job = g_hash_table_lookup (numbers, call->remote->number);
+    if (!job) {
+      job = g_new0 (RogerJournalLookupJob, 1);
+      job->lookup = roger_journal_lookup_ref (self);
+      job->number = g_strdup (call->remote->number);
+      job->contact = rm_contact_dup (call->remote);
+      job->calls = g_ptr_array_new ();
+
+      g_hash_table_insert (numbers, call->remote->number, job);
+      g_ptr_array_add (jobs, job);
+    }
+
+    g_ptr_array_add (job->calls, call);
+  }
+
+  self->remaining = jobs->len;
+
+  g_mutex_lock (&self->mutex);
+
+  /* Cached numbers are finished right away and applied with the first batch */
+  for (idx = 0; idx < jobs->len; idx++) {
+    RogerJournalLookupJob *job = g_ptr_array_index (jobs, idx);
+    const char *name;
+    const char *city;
+
+    if (!roger_lookup_cache_lookup (cache, job->number, &name, &city))
+      continue;
+
+    job->cached = TRUE;
+    if (!RM_EMPTY_STRING (name)) {
+      g_free (job->contact->name);
+      job->contact->name = g_strdup (name);
+      g_free (job->contact->city);
+      job->contact->city = g_strdup (city);
+      job->found = TRUE;
+    }
+
+    g_ptr_array_add (self->finished, job);
+  }
+
+  if (self->finished->len > 0 || jobs->len == 0)
+    roger_journal_lookup_schedule_flush (self);
+
+  g_mutex_unlock (&self->mutex);
+
+  g_debug ("%s(): %u numbers to look up, %u cached", __FUNCTION__, jobs->len - self->finished->len, self->finished->len);
+
+  if (!lookup_pool)
+    lookup_pool = g_thread_pool_new (roger_journal_lookup_thread_cb, NULL, 1, FALSE, NULL);
+
+  /* Jobs are queued in journal order, so recent calls are resolved first */
+  for (idx = 0; idx < jobs->len; idx++) {
+    RogerJournalLookupJob *job = g_ptr_array_index (jobs, idx);
+
+    if (!job->cached)
+      g_thread_pool_push (lookup_pool, job, NULL);
+  }
+
+  return self;
+}
+
+/**
+ * roger_journal_lookup_free:
+ * @self: a #RogerJournalLookup
+ *
+ * Cancels all pending lookups. No callback is invoked afterwards, lookups
+ * already running finish in the background and are discarded.
+ */
+void
+roger_journal_lookup_free (RogerJournalLookup *self)
+{
+  g_autoptr (GPtrArray) jobs = NULL;
+
+  if (!self)
+    return;
+
+  g_mutex_lock (&self->mutex);
+  g_atomic_int_set (&self->cancelled, TRUE);
+  g_clear_handle_id (&self->flush_id, g_source_remove);
+  jobs = g_steal_pointer (&self->finished);
+  self->finished = g_ptr_array_new_with_free_func ((GDestroyNotify)roger_journal_lookup_job_free);
+  g_mutex_unlock (&self->mutex);
+
+  roger_journal_lookup_unref (self);
+}
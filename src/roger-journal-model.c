@@ -0,0 +1,1280 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "roger-journal-model.h"
+
+#include "roger-journal.h"
+#include "roger-journal-time.h"
+
+#include <string.h>
+
+/*
+ * Journal tree model
+ *
+ * Rows are not copied into the model. The model keeps the journal entries in a
+ * contiguous array and the visible (filtered and sorted) view as a vector of
+ * indices into that array. Column values are read from the call entry when the
+ * tree view asks for them, so only visible rows are ever materialized.
+ *
+ * An iter stores the entry index, a path the position within the visible rows.
+ * Changed entries are mapped back to their row through a call to index table,
+ * which is built on first use.
+ *
+ * Date and duration of every entry are parsed once into arrays parallel to the
+ * entries, so sorting by them and summing durations are integer operations.
+ *
+ * The entries passing the filter function are kept in sort order as the base
+ * rows, the visible rows are the base rows matching the search result. A
+ * search snapshot shares the base rows and entries with a worker thread, which
+ * narrows them down to the rows of a new search result. Entries and base rows
+ * are never changed in place, only replaced, so snapshots stay valid.
+ */
+
+#define CANCEL_CHECK_INTERVAL 4096
+
+#define ROW_HIDDEN G_MAXUINT
+
+/* Merging more new entries than this rebuilds all rows instead */
+#define MERGE_MAX_INSERTS 512
+
+typedef struct {
+  GtkTreeIterCompareFunc func;
+  gpointer data;
+  GDestroyNotify destroy;
+} RogerJournalModelSortHeader;
+
+struct _RogerJournalModel {
+  GObject parent_instance;
+
+  GPtrArray *entries;
+  GArray *base;
+  GArray *rows;
+  GArray *positions;
+  GHashTable *indices;
+  GArray *times;
+  GArray *durations;
+  gint stamp;
+
+  RogerJournalModelFilterFunc filter_func;
+  gpointer filter_data;
+  RogerJournalIndexResult *search_result;
+
+  gint sort_column_id;
+  GtkSortType sort_order;
+  RogerJournalModelSortHeader sort_headers[JOURNAL_N_COLUMNS];
+  RogerJournalModelSortHeader default_sort;
+};
+
+struct _RogerJournalModelSearch {
+  GPtrArray *entries;
+  GArray *base;
+  GArray *rows;
+  RogerJournalIndexResult *result;
+};
+
+static void roger_journal_model_tree_model_init (GtkTreeModelIface *iface);
+static void roger_journal_model_tree_sortable_init (GtkTreeSortableIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (RogerJournalModel, roger_journal_model, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL, roger_journal_model_tree_model_init)
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_SORTABLE, roger_journal_model_tree_sortable_init))
+
+static inline gint64
+roger_journal_model_time (RogerJournalModel *self,
+                          guint              index)
+{
+  return g_array_index (self->times, gint64, index);
+}
+
+static inline gint
+roger_journal_model_duration (RogerJournalModel *self,
+                              guint              index)
+{
+  return g_array_index (self->durations, gint, index);
+}
+
+static inline RmCallEntry *
+roger_journal_model_entry (RogerJournalModel *self,
+                           guint              index)
+{
+  return g_ptr_array_index (self->entries, index);
+}
+
+static inline guint
+roger_journal_model_row (RogerJournalModel *self,
+                         guint              position)
+{
+  return g_array_index (self->rows, guint, position);
+}
+
+static inline guint
+roger_journal_model_position (RogerJournalModel *self,
+                              guint              index)
+{
+  return g_array_index (self->positions, guint, index);
+}
+
+static inline void
+roger_journal_model_set_iter (RogerJournalModel *self,
+                              GtkTreeIter       *iter,
+                              guint              index)
+{
+  iter->stamp = self->stamp;
+  iter->user_data = GUINT_TO_POINTER (index);
+  iter->user_data2 = NULL;
+  iter->user_data3 = NULL;
+}
+
+static inline guint
+roger_journal_model_iter_index (GtkTreeIter *iter)
+{
+  return GPOINTER_TO_UINT (iter->user_data);
+}
+
+static gboolean
+roger_journal_model_iter_is_valid (RogerJournalModel *self,
+                                   GtkTreeIter       *iter)
+{
+  guint index;
+
+  if (!iter || iter->stamp != self->stamp)
+    return FALSE;
+
+  index = roger_journal_model_iter_index (iter);
+
+  return index < self->entries->len && roger_journal_model_position (self, index) != ROW_HIDDEN;
+}
+
+static const char *
+roger_journal_model_get_string (RmCallEntry *call,
+                                gint         column)
+{
+  switch (column) {
+    case JOURNAL_COL_DATETIME:
+      return call->date_time;
+    case JOURNAL_COL_NAME:
+      return call->remote->name;
+    case JOURNAL_COL_COMPANY:
+      return call->remote->company;
+    case JOURNAL_COL_NUMBER:
+      return call->remote->number;
+    case JOURNAL_COL_CITY:
+      return call->remote->city;
+    case JOURNAL_COL_EXTENSION:
+      return call->local->name;
+    case JOURNAL_COL_LINE:
+      return call->local->number;
+    case JOURNAL_COL_DURATION:
+      return call->duration;
+    default:
+      break;
+  }
+
+  return NULL;
+}
+
+static GtkTreeModelFlags
+roger_journal_model_get_flags (GtkTreeModel *model)
+{
+  return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint
+roger_journal_model_get_n_columns (GtkTreeModel *model)
+{
+  return JOURNAL_N_COLUMNS;
+}
+
+static GType
+roger_journal_model_get_column_type (GtkTreeModel *model,
+                                     gint          column)
+{
+  switch (column) {
+    case JOURNAL_COL_TYPE:
+      return GDK_TYPE_PIXBUF;
+    case JOURNAL_COL_CALL_PTR:
+      return G_TYPE_POINTER;
+    default:
+      break;
+  }
+
+  return G_TYPE_STRING;
+}
+
+static gboolean
+roger_journal_model_get_iter (GtkTreeModel *model,
+                              GtkTreeIter  *iter,
+                              GtkTreePath  *path)
+{
+  RogerJournalModel *self = ROGER_JOURNAL_MODEL (model);
+  gint position;
+
+  if (gtk_tree_path_get_depth (path) != 1)
+    return FALSE;
+
+  position = gtk_tree_path_get_indices (path)[0];
+  if (position < 0 || (guint)position >= self->rows->len)
+    return FALSE;
+
+  roger_journal_model_set_iter (self, iter, roger_journal_model_row (self, position));
+
+  return TRUE;
+}
+
+static GtkTreePath *
+roger_journal_model_get_path (GtkTreeModel *model,
+                              GtkTreeIter  *iter)
+{
+  RogerJournalModel *self = ROGER_JOURNAL_MODEL (model);
+
+  g_return_val_if_fail (roger_journal_model_iter_is_valid (self, iter), NULL);
+
+  return gtk_tree_path_new_from_indices (roger_journal_model_position (self, roger_journal_model_iter_index (iter)), -1);
+}
+
+static void
+roger_journal_model_get_value (GtkTreeModel *model,
+                               GtkTreeIter  *iter,
+                               gint          column,
+                               GValue       *value)
+{
+  RogerJournalModel *self = ROGER_JOURNAL_MODEL (model);
+  RmCallEntry *call;
+
+  g_return_if_fail (roger_journal_model_iter_is_valid (self, iter));
+
+  call = roger_journal_model_entry (self, roger_journal_model_iter_index (iter));
+
+  g_value_init (value, roger_journal_model_get_column_type (model, column));
+
+  switch (column) {
+    case JOURNAL_COL_TYPE:
+      g_value_set_object (value, roger_journal_get_call_icon (call->type));
+      break;
+    case JOURNAL_COL_CALL_PTR:
+      g_value_set_pointer (value, call);
+      break;
+    default:
+      g_value_set_string (value, roger_journal_model_get_string (call, column));
+      break;
+  }
+}
+
+static gboolean
+roger_journal_model_iter_next (GtkTreeModel *model,
+                               GtkTreeIter  *iter)
+{
+  RogerJournalModel *self = ROGER_JOURNAL_MODEL (model);
+  guint position;
+
+  if (!roger_journal_model_iter_is_valid (self, iter))
+    return FALSE;
+
+  position = roger_journal_model_position (self, roger_journal_model_iter_index (iter)) + 1;
+  if (position >= self->rows->len) {
+    iter->stamp = 0;
+    return FALSE;
+  }
+
+  roger_journal_model_set_iter (self, iter, roger_journal_model_row (self, position));
+
+  return TRUE;
+}
+
+static gboolean
+roger_journal_model_iter_previous (GtkTreeModel *model,
+                                   GtkTreeIter  *iter)
+{
+  RogerJournalModel *self = ROGER_JOURNAL_MODEL (model);
+  guint position;
+
+  if (!roger_journal_model_iter_is_valid (self, iter))
+    return FALSE;
+
+  position = roger_journal_model_position (self, roger_journal_model_iter_index (iter));
+  if (position == 0) {
+    iter->stamp = 0;
+    return FALSE;
+  }
+
+  roger_journal_model_set_iter (self, iter, roger_journal_model_row (self, position - 1));
+
+  return TRUE;
+}
+
+static gboolean
+roger_journal_model_iter_nth_child (GtkTreeModel *model,
+                                    GtkTreeIter  *iter,
+                                    GtkTreeIter  *parent,
+                                    gint          n)
+{
+  RogerJournalModel *self = ROGER_JOURNAL_MODEL (model);
+
+  if (parent || n < 0 || (guint)n >= self->rows->len)
+    return FALSE;
+
+  roger_journal_model_set_iter (self, iter, roger_journal_model_row (self, n));
+
+  return TRUE;
+}
+
+static gboolean
+roger_journal_model_iter_children (GtkTreeModel *model,
+                                   GtkTreeIter  *iter,
+                                   GtkTreeIter  *parent)
+{
+  return roger_journal_model_iter_nth_child (model, iter, parent, 0);
+}
+
+static gboolean
+roger_journal_model_iter_has_child (GtkTreeModel *model,
+                                    GtkTreeIter  *iter)
+{
+  return FALSE;
+}
+
+static gint
+roger_journal_model_iter_n_children (GtkTreeModel *model,
+                                     GtkTreeIter  *iter)
+{
+  RogerJournalModel *self = ROGER_JOURNAL_MODEL (model);
+
+  if (iter)
+    return 0;
+
+  return self->rows->len;
+}
+
+static gboolean
+roger_journal_model_iter_parent (GtkTreeModel *model,
+                                 GtkTreeIter  *iter,
+                                 GtkTreeIter  *child)
+{
+  return FALSE;
+}
+
+static void
+roger_journal_model_tree_model_init (GtkTreeModelIface *iface)
+{
+  iface->get_flags = roger_journal_model_get_flags;
+  iface->get_n_columns = roger_journal_model_get_n_columns;
+  iface->get_column_type = roger_journal_model_get_column_type;
+  iface->get_iter = roger_journal_model_get_iter;
+  iface->get_path = roger_journal_model_get_path;
+  iface->get_value = roger_journal_model_get_value;
+  iface->iter_next = roger_journal_model_iter_next;
+  iface->iter_previous = roger_journal_model_iter_previous;
+  iface->iter_children = roger_journal_model_iter_children;
+  iface->iter_has_child = roger_journal_model_iter_has_child;
+  iface->iter_n_children = roger_journal_model_iter_n_children;
+  iface->iter_nth_child = roger_journal_model_iter_nth_child;
+  iface->iter_parent = roger_journal_model_iter_parent;
+}
+
+static gint
+roger_journal_model_compare_rows (gconstpointer a,
+                                  gconstpointer b,
+                                  gpointer      user_data)
+{
+  RogerJournalModel *self = ROGER_JOURNAL_MODEL (user_data);
+  guint index_a = *(const guint *)a;
+  guint index_b = *(const guint *)b;
+  RogerJournalModelSortHeader *header;
+  gint retval;
+
+  if (self->sort_column_id == GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID)
+    header = &self->default_sort;
+  else
+    header = &self->sort_headers[self->sort_column_id];
+
+  if (header->func) {
+    GtkTreeIter iter_a;
+    GtkTreeIter iter_b;
+
+    roger_journal_model_set_iter (self, &iter_a, index_a);
+    roger_journal_model_set_iter (self, &iter_b, index_b);
+
+    retval = header->func (GTK_TREE_MODEL (self), &iter_a, &iter_b, header->data);
+  } else if (self->sort_column_id == JOURNAL_COL_DATETIME) {
+    gint64 time_a = roger_journal_model_time (self, index_a);
+    gint64 time_b = roger_journal_model_time (self, index_b);
+
+    /* Newest call first, like the router journal */
+    retval = time_a > time_b ? -1 : time_a < time_b ? 1 : 0;
+  } else if (self->sort_column_id == JOURNAL_COL_DURATION) {
+    gint duration_a = roger_journal_model_duration (self, index_a);
+    gint duration_b = roger_journal_model_duration (self, index_b);
+
+    retval = duration_a < duration_b ? -1 : duration_a > duration_b ? 1 : 0;
+  } else {
+    const char *str_a = roger_journal_model_get_string (roger_journal_model_entry (self, index_a), self->sort_column_id);
+    const char *str_b = roger_journal_model_get_string (roger_journal_model_entry (self, index_b), self->sort_column_id);
+
+    if (!str_a || !str_b)
+      retval = str_a ? 1 : str_b ? -1 : 0;
+    else
+      retval = g_utf8_collate (str_a, str_b);
+  }
+
+  if (self->sort_order == GTK_SORT_DESCENDING)
+    retval = -retval;
+
+  /* Keep journal order for equal rows */
+  if (retval == 0)
+    retval = index_a < index_b ? -1 : index_a > index_b ? 1 : 0;
+
+  return retval;
+}
+
+static gboolean
+roger_journal_model_is_sorted (RogerJournalModel *self)
+{
+  if (self->sort_column_id == GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID)
+    return FALSE;
+
+  if (self->sort_column_id == GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID)
+    return self->default_sort.func != NULL;
+
+  return TRUE;
+}
+
+static void
+roger_journal_model_update_positions (RogerJournalModel *self)
+{
+  guint position;
+
+  for (position = 0; position < self->rows->len; position++)
+    g_array_index (self->positions, guint, roger_journal_model_row (self, position)) = position;
+}
+
+static void
+roger_journal_model_sort (RogerJournalModel *self)
+{
+  g_autofree gint *new_order = NULL;
+  GtkTreePath *path;
+  guint position;
+
+  /* Base rows are shared with searches, they are sorted again when needed */
+  g_clear_pointer (&self->base, g_array_unref);
+
+  if (self->rows->len <= 1)
+    return;
+
+  if (roger_journal_model_is_sorted (self)) {
+    g_array_sort_with_data (self->rows, roger_journal_model_compare_rows, self);
+  } else {
+    /* Unsorted means journal order, which is ascending entry index */
+    guint index;
+
+    g_array_set_size (self->rows, 0);
+    for (index = 0; index < self->entries->len; index++) {
+      if (roger_journal_model_position (self, index) != ROW_HIDDEN)
+        g_array_append_val (self->rows, index);
+    }
+  }
+
+  new_order = g_new (gint, self->rows->len);
+  for (position = 0; position < self->rows->len; position++)
+    new_order[position] = roger_journal_model_position (self, roger_journal_model_row (self, position));
+
+  roger_journal_model_update_positions (self);
+
+  path = gtk_tree_path_new ();
+  gtk_tree_model_rows_reordered (GTK_TREE_MODEL (self), path, NULL, new_order);
+  gtk_tree_path_free (path);
+}
+
+static gboolean
+roger_journal_model_get_sort_column_id (GtkTreeSortable *sortable,
+                                        gint            *sort_column_id,
+                                        GtkSortType     *order)
+{
+  RogerJournalModel *self = ROGER_JOURNAL_MODEL (sortable);
+
+  if (sort_column_id)
+    *sort_column_id = self->sort_column_id;
+
+  if (order)
+    *order = self->sort_order;
+
+  return self->sort_column_id != GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID &&
+         self->sort_column_id != GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
+}
+
+static void
+roger_journal_model_set_sort_column_id (GtkTreeSortable *sortable,
+                                        gint             sort_column_id,
+                                        GtkSortType      order)
+{
+  RogerJournalModel *self = ROGER_JOURNAL_MODEL (sortable);
+
+  g_return_if_fail (sort_column_id < JOURNAL_N_COLUMNS);
+
+  if (self->sort_column_id == sort_column_id && self->sort_order == order)
+    return;
+
+  self->sort_column_id = sort_column_id;
+  self->sort_order = order;
+
+  gtk_tree_sortable_sort_column_changed (sortable);
+  roger_journal_model_sort (self);
+}
+
+static void
+roger_journal_model_sort_header_clear (RogerJournalModelSortHeader *header)
+{
+  if (header->destroy)
+    header->destroy (header->data);
+
+  header->func = NULL;
+  header->data = NULL;
+  header->destroy = NULL;
+}
+
+static void
+roger_journal_model_set_sort_func (GtkTreeSortable        *sortable,
+                                   gint                    sort_column_id,
+                                   GtkTreeIterCompareFunc  func,
+                                   gpointer                data,
+                                   GDestroyNotify          destroy)
+{
+  RogerJournalModel *self = ROGER_JOURNAL_MODEL (sortable);
+  RogerJournalModelSortHeader *header;
+
+  g_return_if_fail (sort_column_id >= 0 && sort_column_id < JOURNAL_N_COLUMNS);
+
+  header = &self->sort_headers[sort_column_id];
+  roger_journal_model_sort_header_clear (header);
+  header->func = func;
+  header->data = data;
+  header->destroy = destroy;
+
+  if (self->sort_column_id == sort_column_id)
+    roger_journal_model_sort (self);
+}
+
+static void
+roger_journal_model_set_default_sort_func (GtkTreeSortable        *sortable,
+                                           GtkTreeIterCompareFunc  func,
+                                           gpointer                data,
+                                           GDestroyNotify          destroy)
+{
+  RogerJournalModel *self = ROGER_JOURNAL_MODEL (sortable);
+
+  roger_journal_model_sort_header_clear (&self->default_sort);
+  self->default_sort.func = func;
+  self->default_sort.data = data;
+  self->default_sort.destroy = destroy;
+
+  if (self->sort_column_id == GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID)
+    roger_journal_model_sort (self);
+}
+
+static gboolean
+roger_journal_model_has_default_sort_func (GtkTreeSortable *sortable)
+{
+  RogerJournalModel *self = ROGER_JOURNAL_MODEL (sortable);
+
+  return self->default_sort.func != NULL;
+}
+
+static void
+roger_journal_model_tree_sortable_init (GtkTreeSortableIface *iface)
+{
+  iface->get_sort_column_id = roger_journal_model_get_sort_column_id;
+  iface->set_sort_column_id = roger_journal_model_set_sort_column_id;
+  iface->set_sort_func = roger_journal_model_set_sort_func;
+  iface->set_default_sort_func = roger_journal_model_set_default_sort_func;
+  iface->has_default_sort_func = roger_journal_model_has_default_sort_func;
+}
+
+static void
+roger_journal_model_remove_rows (RogerJournalModel *self)
+{
+  GtkTreePath *path;
+  guint index;
+
+  if (self->rows->len == 0)
+    return;
+
+  /* Remove from the end, so the view does not need to shift its rows */
+  path = gtk_tree_path_new_from_indices (self->rows->len, -1);
+  while (self->rows->len > 0) {
+    g_array_set_size (self->rows, self->rows->len - 1);
+    gtk_tree_path_prev (path);
+    gtk_tree_model_row_deleted (GTK_TREE_MODEL (self), path);
+  }
+  gtk_tree_path_free (path);
+
+  for (index = 0; index < self->positions->len; index++)
+    g_array_index (self->positions, guint, index) = ROW_HIDDEN;
+}
+
+/* Entries found in @known take their values from the old arrays */
+static void
+roger_journal_model_parse_entries (RogerJournalModel *self,
+                                   GHashTable        *known,
+                                   GArray            *old_times,
+                                   GArray            *old_durations)
+{
+  guint index;
+
+  g_array_set_size (self->times, self->entries->len);
+  g_array_set_size (self->durations, self->entries->len);
+
+  for (index = 0; index < self->entries->len; index++) {
+    RmCallEntry *call = roger_journal_model_entry (self, index);
+    guint old_index = known ? GPOINTER_TO_UINT (g_hash_table_lookup (known, call)) : 0;
+
+    if (old_index) {
+      g_array_index (self->times, gint64, index) = g_array_index (old_times, gint64, old_index - 1);
+      g_array_index (self->durations, gint, index) = g_array_index (old_durations, gint, old_index - 1);
+    } else {
+      g_array_index (self->times, gint64, index) = roger_journal_time_parse_date (call->date_time);
+      g_array_index (self->durations, gint, index) = roger_journal_time_parse_duration (call->duration);
+    }
+  }
+}
+
+/**
+ * roger_journal_model_set_journal:
+ * @self: a #RogerJournalModel
+ * @journal: journal list of #RmCallEntry, owned by the caller
+ *
+ * Replaces the journal backing the model. All rows are removed, call
+ * roger_journal_model_refilter() to build the visible rows.
+ */
+void
+roger_journal_model_set_journal (RogerJournalModel *self,
+                                 GList             *journal)
+{
+  GList *list;
+
+  g_return_if_fail (ROGER_IS_JOURNAL_MODEL (self));
+
+  roger_journal_model_remove_rows (self);
+
+  self->stamp++;
+  g_ptr_array_unref (self->entries);
+  self->entries = g_ptr_array_new ();
+  g_clear_pointer (&self->base, g_array_unref);
+  g_clear_pointer (&self->indices, g_hash_table_unref);
+
+  for (list = journal; list != NULL; list = list->next)
+    g_ptr_array_add (self->entries, list->data);
+
+  roger_journal_model_parse_entries (self, NULL, NULL, NULL);
+
+  g_array_set_size (self->positions, self->entries->len);
+  memset (self->positions->data, 0xff, self->positions->len * sizeof (guint));
+}
+
+void
+roger_journal_model_set_filter_func (RogerJournalModel           *self,
+                                     RogerJournalModelFilterFunc  func,
+                                     gpointer                     user_data)
+{
+  g_return_if_fail (ROGER_IS_JOURNAL_MODEL (self));
+
+  self->filter_func = func;
+  self->filter_data = user_data;
+  g_clear_pointer (&self->base, g_array_unref);
+}
+
+static GArray *
+roger_journal_model_get_base (RogerJournalModel *self)
+{
+  guint index;
+
+  if (self->base)
+    return self->base;
+
+  self->base = g_array_sized_new (FALSE, FALSE, sizeof (guint), self->entries->len);
+  for (index = 0; index < self->entries->len; index++) {
+    if (self->filter_func && !self->filter_func (roger_journal_model_entry (self, index), roger_journal_model_time (self, index), self->filter_data))
+      continue;
+
+    g_array_append_val (self->base, index);
+  }
+
+  if (roger_journal_model_is_sorted (self))
+    g_array_sort_with_data (self->base, roger_journal_model_compare_rows, self);
+
+  return self->base;
+}
+
+static GArray *
+roger_journal_model_search_rows (GPtrArray               *entries,
+                                 GArray                  *base,
+                                 RogerJournalIndexResult *result,
+                                 GCancellable            *cancellable)
+{
+  GArray *rows;
+  guint position;
+
+  if (!result) {
+    rows = g_array_sized_new (FALSE, FALSE, sizeof (guint), base->len);
+    g_array_append_vals (rows, base->data, base->len);
+    return rows;
+  }
+
+  rows = g_array_sized_new (FALSE, FALSE, sizeof (guint), roger_journal_index_result_get_n_matches (result));
+  for (position = 0; position < base->len; position++) {
+    guint index = g_array_index (base, guint, position);
+
+    if (position % CANCEL_CHECK_INTERVAL == 0 && g_cancellable_is_cancelled (cancellable))
+      break;
+
+    if (roger_journal_index_result_contains (result, g_ptr_array_index (entries, index)))
+      g_array_append_val (rows, index);
+  }
+
+  return rows;
+}
+
+/**
+ * roger_journal_model_set_search_result:
+ * @self: a #RogerJournalModel
+ * @result: (nullable): a #RogerJournalIndexResult
+ *
+ * Sets the search result visible rows have to match. Call
+ * roger_journal_model_refilter() to build the visible rows.
+ */
+void
+roger_journal_model_set_search_result (RogerJournalModel       *self,
+                                       RogerJournalIndexResult *result)
+{
+  g_return_if_fail (ROGER_IS_JOURNAL_MODEL (self));
+
+  if (result)
+    roger_journal_index_result_ref (result);
+
+  g_clear_pointer (&self->search_result, roger_journal_index_result_unref);
+  self->search_result = result;
+}
+
+/**
+ * roger_journal_model_search_new:
+ * @self: a #RogerJournalModel
+ *
+ * Takes a snapshot of the entries and base rows of @self, which can be
+ * narrowed down to a search result in a worker thread with
+ * roger_journal_model_search_run().
+ *
+ * Returns: a new #RogerJournalModelSearch
+ */
+RogerJournalModelSearch *
+roger_journal_model_search_new (RogerJournalModel *self)
+{
+  RogerJournalModelSearch *search;
+
+  g_return_val_if_fail (ROGER_IS_JOURNAL_MODEL (self), NULL);
+
+  search = g_new0 (RogerJournalModelSearch, 1);
+  search->entries = g_ptr_array_ref (self->entries);
+  search->base = g_array_ref (roger_journal_model_get_base (self));
+
+  return search;
+}
+
+/**
+ * roger_journal_model_search_run:
+ * @search: a #RogerJournalModelSearch
+ * @result: (nullable): a #RogerJournalIndexResult
+ * @cancellable: (nullable): a #GCancellable
+ *
+ * Builds the rows of @result from the snapshot. May be called from any thread.
+ */
+void
+roger_journal_model_search_run (RogerJournalModelSearch *search,
+                                RogerJournalIndexResult *result,
+                                GCancellable            *cancellable)
+{
+  g_clear_pointer (&search->rows, g_array_unref);
+  g_clear_pointer (&search->result, roger_journal_index_result_unref);
+
+  search->result = result ? roger_journal_index_result_ref (result) : NULL;
+  search->rows = roger_journal_model_search_rows (search->entries, search->base, result, cancellable);
+}
+
+void
+roger_journal_model_search_free (RogerJournalModelSearch *search)
+{
+  if (!search)
+    return;
+
+  g_ptr_array_unref (search->entries);
+  g_array_unref (search->base);
+  g_clear_pointer (&search->rows, g_array_unref);
+  g_clear_pointer (&search->result, roger_journal_index_result_unref);
+  g_free (search);
+}
+
+/**
+ * roger_journal_model_apply_search:
+ * @self: a #RogerJournalModel
+ * @search: a #RogerJournalModelSearch after roger_journal_model_search_run()
+ *
+ * Replaces the visible rows by the rows of the search result in one step. No
+ * row signals are emitted, so the model must not be attached to a view. If
+ * the model changed since the snapshot was taken, the rows are built again.
+ */
+void
+roger_journal_model_apply_search (RogerJournalModel       *self,
+                                  RogerJournalModelSearch *search)
+{
+  GArray *rows;
+
+  g_return_if_fail (ROGER_IS_JOURNAL_MODEL (self));
+
+  roger_journal_model_set_search_result (self, search->result);
+
+  if (search->rows && search->base == self->base && search->entries == self->entries)
+    rows = g_steal_pointer (&search->rows);
+  else
+    rows = roger_journal_model_search_rows (self->entries, roger_journal_model_get_base (self), self->search_result, NULL);
+
+  self->stamp++;
+  g_array_unref (self->rows);
+  self->rows = rows;
+
+  memset (self->positions->data, 0xff, self->positions->len * sizeof (guint));
+  roger_journal_model_update_positions (self);
+}
+
+/**
+ * roger_journal_model_refilter:
+ * @self: a #RogerJournalModel
+ *
+ * Rebuilds the visible rows by applying the filter function, search result
+ * and current sort order to the journal entries.
+ */
+void
+roger_journal_model_refilter (RogerJournalModel *self)
+{
+  GtkTreePath *path;
+  GtkTreeIter iter;
+  guint position;
+
+  g_return_if_fail (ROGER_IS_JOURNAL_MODEL (self));
+
+  roger_journal_model_remove_rows (self);
+  self->stamp++;
+
+  g_clear_pointer (&self->base, g_array_unref);
+  g_array_unref (self->rows);
+  self->rows = roger_journal_model_search_rows (self->entries, roger_journal_model_get_base (self), self->search_result, NULL);
+
+  roger_journal_model_update_positions (self);
+
+  path = gtk_tree_path_new_first ();
+  for (position = 0; position < self->rows->len; position++) {
+    roger_journal_model_set_iter (self, &iter, roger_journal_model_row (self, position));
+    gtk_tree_model_row_inserted (GTK_TREE_MODEL (self), path, &iter);
+    gtk_tree_path_next (path);
+  }
+  gtk_tree_path_free (path);
+}
+
+static GHashTable *
+roger_journal_model_get_indices (RogerJournalModel *self)
+{
+  guint index;
+
+  if (self->indices)
+    return self->indices;
+
+  self->indices = g_hash_table_new (g_direct_hash, g_direct_equal);
+  for (index = 0; index < self->entries->len; index++)
+    g_hash_table_insert (self->indices, roger_journal_model_entry (self, index), GUINT_TO_POINTER (index + 1));
+
+  return self->indices;
+}
+
+static gboolean
+roger_journal_model_is_in_order (RogerJournalModel *self,
+                                 guint              position)
+{
+  if (position > 0 && roger_journal_model_compare_rows (&g_array_index (self->rows, guint, position - 1),
+                                                        &g_array_index (self->rows, guint, position),
+                                                        self) > 0)
+    return FALSE;
+
+  if (position + 1 < self->rows->len && roger_journal_model_compare_rows (&g_array_index (self->rows, guint, position),
+                                                                          &g_array_index (self->rows, guint, position + 1),
+                                                                          self) > 0)
+    return FALSE;
+
+  return TRUE;
+}
+
+/**
+ * roger_journal_model_calls_changed:
+ * @self: a #RogerJournalModel
+ * @calls: array of changed #RmCallEntry
+ *
+ * Notifies the view about changed call entries. Only the rows of @calls are
+ * updated, the visible rows are only sorted again if a changed row is no
+ * longer in order.
+ */
+void
+roger_journal_model_calls_changed (RogerJournalModel *self,
+                                   GPtrArray         *calls)
+{
+  GHashTable *indices;
+  gboolean resort = FALSE;
+  guint idx;
+
+  g_return_if_fail (ROGER_IS_JOURNAL_MODEL (self));
+
+  indices = roger_journal_model_get_indices (self);
+
+  for (idx = 0; idx < calls->len; idx++) {
+    guint index = GPOINTER_TO_UINT (g_hash_table_lookup (indices, g_ptr_array_index (calls, idx)));
+    GtkTreePath *path;
+    GtkTreeIter iter;
+    guint position;
+
+    if (index == 0)
+      continue;
+
+    position = roger_journal_model_position (self, index - 1);
+    if (position == ROW_HIDDEN)
+      continue;
+
+    roger_journal_model_set_iter (self, &iter, index - 1);
+    path = gtk_tree_path_new_from_indices (position, -1);
+    gtk_tree_model_row_changed (GTK_TREE_MODEL (self), path, &iter);
+    gtk_tree_path_free (path);
+
+    if (!resort && roger_journal_model_is_sorted (self) && !roger_journal_model_is_in_order (self, position))
+      resort = TRUE;
+  }
+
+  if (resort)
+    roger_journal_model_sort (self);
+}
+
+static void
+roger_journal_model_update_positions_from (RogerJournalModel *self,
+                                           guint              start)
+{
+  guint position;
+
+  for (position = start; position < self->rows->len; position++)
+    g_array_index (self->positions, guint, roger_journal_model_row (self, position)) = position;
+}
+
+static guint
+roger_journal_model_find_position (RogerJournalModel *self,
+                                   guint              index)
+{
+  gboolean sorted = roger_journal_model_is_sorted (self);
+  guint lower = 0;
+  guint upper = self->rows->len;
+
+  while (lower < upper) {
+    guint mid = lower + (upper - lower) / 2;
+    guint row = roger_journal_model_row (self, mid);
+    gint cmp;
+
+    if (sorted)
+      cmp = roger_journal_model_compare_rows (&row, &index, self);
+    else
+      cmp = row < index ? -1 : 1;
+
+    if (cmp < 0)
+      lower = mid + 1;
+    else
+      upper = mid;
+  }
+
+  return lower;
+}
+
+/**
+ * roger_journal_model_merge_journal:
+ * @self: a #RogerJournalModel
+ * @journal: journal list of #RmCallEntry, owned by the caller
+ *
+ * Replaces the journal backing the model like
+ * roger_journal_model_set_journal(), but keeps the rows of entries which are
+ * part of the old and the new journal. Rows of removed entries are deleted and
+ * rows of new entries are inserted at their position, so the view keeps its
+ * selection.
+ *
+ * If there are too many new entries for single row updates, the model is left
+ * untouched. Use roger_journal_model_reset() with the view detached instead.
+ *
+ * Returns: %TRUE if the journal was merged
+ */
+gboolean
+roger_journal_model_merge_journal (RogerJournalModel *self,
+                                   GList             *journal)
+{
+  g_autoptr (GHashTable) known = g_hash_table_new (g_direct_hash, g_direct_equal);
+  GHashTable *indices;
+  GPtrArray *entries;
+  GArray *old_times;
+  GArray *old_durations;
+  GList *list;
+  guint inserts = 0;
+  guint position;
+  guint index;
+
+  g_return_val_if_fail (ROGER_IS_JOURNAL_MODEL (self), FALSE);
+
+  for (index = 0; index < self->entries->len; index++)
+    g_hash_table_insert (known, roger_journal_model_entry (self, index), GUINT_TO_POINTER (index + 1));
+
+  entries = g_ptr_array_new ();
+  indices = g_hash_table_new (g_direct_hash, g_direct_equal);
+  for (list = journal; list != NULL; list = list->next) {
+    g_ptr_array_add (entries, list->data);
+    g_hash_table_insert (indices, list->data, GUINT_TO_POINTER (entries->len));
+
+    if (!g_hash_table_contains (known, list->data))
+      inserts++;
+  }
+
+  if (inserts > MERGE_MAX_INSERTS) {
+    g_ptr_array_unref (entries);
+    g_hash_table_unref (indices);
+
+    return FALSE;
+  }
+
+  /* Delete rows of removed entries, back to front. Positions are rebuilt once below */
+  for (position = self->rows->len; position-- > 0;) {
+    GtkTreePath *path;
+
+    if (g_hash_table_contains (indices, roger_journal_model_entry (self, roger_journal_model_row (self, position))))
+      continue;
+
+    g_array_index (self->positions, guint, roger_journal_model_row (self, position)) = ROW_HIDDEN;
+    g_array_remove_index (self->rows, position);
+
+    path = gtk_tree_path_new_from_indices (position, -1);
+    gtk_tree_model_row_deleted (GTK_TREE_MODEL (self), path);
+    gtk_tree_path_free (path);
+  }
+
+  /* Remaining rows keep their position, only the entry indices change */
+  for (position = 0; position < self->rows->len; position++) {
+    RmCallEntry *call = roger_journal_model_entry (self, roger_journal_model_row (self, position));
+
+    g_array_index (self->rows, guint, position) = GPOINTER_TO_UINT (g_hash_table_lookup (indices, call)) - 1;
+  }
+
+  self->stamp++;
+  old_times = g_steal_pointer (&self->times);
+  old_durations = g_steal_pointer (&self->durations);
+  g_ptr_array_unref (self->entries);
+  self->entries = entries;
+  g_clear_pointer (&self->base, g_array_unref);
+  g_clear_pointer (&self->indices, g_hash_table_unref);
+  self->indices = indices;
+
+  self->times = g_array_new (FALSE, FALSE, sizeof (gint64));
+  self->durations = g_array_new (FALSE, FALSE, sizeof (gint));
+  roger_journal_model_parse_entries (self, known, old_times, old_durations);
+  g_array_unref (old_times);
+  g_array_unref (old_durations);
+
+  g_array_set_size (self->positions, self->entries->len);
+  memset (self->positions->data, 0xff, self->positions->len * sizeof (guint));
+  roger_journal_model_update_positions (self);
+
+  /* Insert rows of new entries */
+  for (index = 0; index < self->entries->len && inserts > 0; index++) {
+    RmCallEntry *call = roger_journal_model_entry (self, index);
+    GtkTreePath *path;
+    GtkTreeIter iter;
+
+    if (g_hash_table_contains (known, call))
+      continue;
+
+    inserts--;
+
+    if (self->filter_func && !self->filter_func (call, roger_journal_model_time (self, index), self->filter_data))
+      continue;
+
+    if (!roger_journal_index_result_contains (self->search_result, call))
+      continue;
+
+    position = roger_journal_model_find_position (self, index);
+    g_array_insert_val (self->rows, position, index);
+    roger_journal_model_update_positions_from (self, position);
+
+    roger_journal_model_set_iter (self, &iter, index);
+    path = gtk_tree_path_new_from_indices (position, -1);
+    gtk_tree_model_row_inserted (GTK_TREE_MODEL (self), path, &iter);
+    gtk_tree_path_free (path);
+  }
+
+  return TRUE;
+}
+
+/**
+ * roger_journal_model_reset:
+ * @self: a #RogerJournalModel
+ * @journal: journal list of #RmCallEntry, owned by the caller
+ *
+ * Replaces the journal backing the model and rebuilds the visible rows in one
+ * step. No row signals are emitted, so the model must not be attached to a
+ * view.
+ */
+void
+roger_journal_model_reset (RogerJournalModel *self,
+                           GList             *journal)
+{
+  GList *list;
+
+  g_return_if_fail (ROGER_IS_JOURNAL_MODEL (self));
+
+  self->stamp++;
+  g_ptr_array_unref (self->entries);
+  self->entries = g_ptr_array_new ();
+  g_clear_pointer (&self->base, g_array_unref);
+  g_clear_pointer (&self->indices, g_hash_table_unref);
+
+  for (list = journal; list != NULL; list = list->next)
+    g_ptr_array_add (self->entries, list->data);
+
+  roger_journal_model_parse_entries (self, NULL, NULL, NULL);
+
+  g_array_unref (self->rows);
+  self->rows = roger_journal_model_search_rows (self->entries, roger_journal_model_get_base (self), self->search_result, NULL);
+
+  g_array_set_size (self->positions, self->entries->len);
+  memset (self->positions->data, 0xff, self->positions->len * sizeof (guint));
+  roger_journal_model_update_positions (self);
+}
+
+/**
+ * roger_journal_model_get_row_for_call:
+ * @self: a #RogerJournalModel
+ * @call: a #RmCallEntry
+ *
+ * Returns: the visible row of @call, or -1 if it is not visible
+ */
+gint
+roger_journal_model_get_row_for_call (RogerJournalModel *self,
+                                      RmCallEntry       *call)
+{
+  guint index;
+  guint position;
+
+  g_return_val_if_fail (ROGER_IS_JOURNAL_MODEL (self), -1);
+
+  index = GPOINTER_TO_UINT (g_hash_table_lookup (roger_journal_model_get_indices (self), call));
+  if (index == 0)
+    return -1;
+
+  position = roger_journal_model_position (self, index - 1);
+
+  return position == ROW_HIDDEN ? -1 : (gint)position;
+}
+
+/**
+ * roger_journal_model_get_total_duration:
+ * @self: a #RogerJournalModel
+ *
+ * Returns: the summed duration of all visible rows in seconds
+ */
+gint
+roger_journal_model_get_total_duration (RogerJournalModel *self)
+{
+  const guint *rows;
+  const gint *durations;
+  gint total = 0;
+  guint position;
+
+  g_return_val_if_fail (ROGER_IS_JOURNAL_MODEL (self), 0);
+
+  rows = (const guint *)self->rows->data;
+  durations = (const gint *)self->durations->data;
+
+  for (position = 0; position < self->rows->len; position++)
+    total += durations[rows[position]];
+
+  return total;
+}
+
+guint
+roger_journal_model_get_n_rows (RogerJournalModel *self)
+{
+  g_return_val_if_fail (ROGER_IS_JOURNAL_MODEL (self), 0);
+
+  return self->rows->len;
+}
+
+RmCallEntry *
+roger_journal_model_get_call (RogerJournalModel *self,
+                              guint              row)
+{
+  g_return_val_if_fail (ROGER_IS_JOURNAL_MODEL (self), NULL);
+  g_return_val_if_fail (row < self->rows->len, NULL);
+
+  return roger_journal_model_entry (self, roger_journal_model_row (self, row));
+}
+
+static void
+roger_journal_model_finalize (GObject *object)
+{
+  RogerJournalModel *self = ROGER_JOURNAL_MODEL (object);
+  gint column;
+
+  for (column = 0; column < JOURNAL_N_COLUMNS; column++)
+    roger_journal_model_sort_header_clear (&self->sort_headers[column]);
+  roger_journal_model_sort_header_clear (&self->default_sort);
+
+  g_clear_pointer (&self->entries, g_ptr_array_unref);
+  g_clear_pointer (&self->base, g_array_unref);
+  g_clear_pointer (&self->rows, g_array_unref);
+  g_clear_pointer (&self->positions, g_array_unref);
+  g_clear_pointer (&self->indices, g_hash_table_unref);
+  g_clear_pointer (&self->times, g_array_unref);
+  g_clear_pointer (&self->durations, g_array_unref);
+  g_clear_pointer (&self->search_result, roger_journal_index_result_unref);
+
+  G_OBJECT_CLASS (roger_journal_model_parent_class)->finalize (object);
+}
+
+static void
+roger_journal_model_class_init (RogerJournalModelClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = roger_journal_model_finalize;
+}
+
+static void
+roger_journal_model_init (RogerJournalModel *self)
+{
+  self->entries = g_ptr_array_new ();
+  self->rows = g_array_new (FALSE, FALSE, sizeof (guint));
+  self->positions = g_array_new (FALSE, FALSE, sizeof (guint));
+  self->times = g_array_new (FALSE, FALSE, sizeof (gint64));
+  self->durations = g_array_new (FALSE, FALSE, sizeof (gint));
+  self->stamp = g_random_int ();
+  self->sort_column_id = GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
+  self->sort_order = GTK_SORT_ASCENDING;
+}
+
+RogerJournalModel *
+roger_journal_model_new (void)
+{
+  return g_object_new (ROGER_TYPE_JOURNAL_MODEL, NULL);
+}
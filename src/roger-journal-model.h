@@ -0,0 +1,66 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gtk/gtk.h>
+#include <rm/rm.h>
+
+#include "roger-journal-index.h"
+
+G_BEGIN_DECLS
+
+#define ROGER_TYPE_JOURNAL_MODEL (roger_journal_model_get_type ())
+
+G_DECLARE_FINAL_TYPE (RogerJournalModel, roger_journal_model, ROGER, JOURNAL_MODEL, GObject)
+
+typedef struct _RogerJournalModelSearch RogerJournalModelSearch;
+
+typedef gboolean (*RogerJournalModelFilterFunc) (RmCallEntry *call,
+                                                 gint64       time,
+                                                 gpointer     user_data);
+
+RogerJournalModel *roger_journal_model_new (void);
+
+void roger_journal_model_set_journal (RogerJournalModel *self,
+                                      GList             *journal);
+gboolean roger_journal_model_merge_journal (RogerJournalModel *self,
+                                            GList             *journal);
+void roger_journal_model_reset (RogerJournalModel *self,
+                                GList             *journal);
+void roger_journal_model_set_filter_func (RogerJournalModel           *self,
+                                          RogerJournalModelFilterFunc  func,
+                                          gpointer                     user_data);
+void roger_journal_model_refilter (RogerJournalModel *self);
+void roger_journal_model_set_search_result (RogerJournalModel       *self,
+                                            RogerJournalIndexResult *result);
+
+RogerJournalModelSearch *roger_journal_model_search_new (RogerJournalModel *self);
+void roger_journal_model_search_run (RogerJournalModelSearch *search,
+                                     RogerJournalIndexResult *result,
+                                     GCancellable            *cancellable);
+void roger_journal_model_search_free (RogerJournalModelSearch *search);
+void roger_journal_model_apply_search (RogerJournalModel       *self,
+                                       RogerJournalModelSearch *search);
+void roger_journal_model_calls_changed (RogerJournalModel *self,
+                                        GPtrArray         *calls);
+
+guint roger_journal_model_get_n_rows (RogerJournalModel *self);
+gint roger_journal_model_get_total_duration (RogerJournalModel *self);
+RmCallEntry *roger_journal_model_get_call (RogerJournalModel *self,
+                                           guint              row);
+gint roger_journal_model_get_row_for_call (RogerJournalModel *self,
+                                           RmCallEntry       *call);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (RogerJournalModelSearch, roger_journal_model_search_free)
+
+G_END_DECLS
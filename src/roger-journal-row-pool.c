@@ -0,0 +1,295 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "roger-journal-row-pool.h"
+
+#include "roger-journal.h"
+
+#include <glib/gi18n.h>
+
+/*
+ * Mobile journal row pool
+ *
+ * The mobile journal is a list box with one row per call. Instead of one
+ * widget tree per call, only the rows covering the visible part of the list
+ * plus a margin above and below are created. On scroll the rows are bound to
+ * other calls. Two spacer widgets above and below the list box stand in for
+ * the rows which are not instantiated, so the scrolled window keeps the full
+ * height. Their height is a size request, which unlike widget margins is not
+ * limited to 16 bit.
+ *
+ * All rows have the same height, it is measured once the first row exists.
+ */
+
+#define ROW_POOL_MARGIN 10
+#define ROW_POOL_MIN_ROWS 24
+
+typedef struct {
+  GtkWidget *row;
+  GtkWidget *icon;
+  GtkWidget *name;
+  GtkWidget *phone;
+  GtkWidget *date;
+  RmCallEntry *call;
+} RogerJournalPoolRow;
+
+struct _RogerJournalRowPool {
+  GtkListBox *box;
+  GtkWidget *top_spacer;
+  GtkWidget *bottom_spacer;
+  GtkAdjustment *vadjustment;
+  gulong value_changed_id;
+  gulong changed_id;
+
+  GPtrArray *calls;
+  GPtrArray *rows;
+  guint first;
+  gint row_height;
+  gboolean in_layout;
+};
+
+static void
+roger_journal_pool_row_free (RogerJournalPoolRow *row)
+{
+  gtk_widget_destroy (row->row);
+  g_free (row);
+}
+
+static RogerJournalPoolRow *
+roger_journal_pool_row_new (RogerJournalRowPool *self)
+{
+  RogerJournalPoolRow *row = g_new0 (RogerJournalPoolRow, 1);
+  GtkWidget *grid = gtk_grid_new ();
+  PangoAttrList *attrlist;
+
+  row->row = gtk_list_box_row_new ();
+
+  gtk_container_set_border_width (GTK_CONTAINER (grid), 6);
+  gtk_grid_set_row_spacing (GTK_GRID (grid), 6);
+  gtk_grid_set_column_spacing (GTK_GRID (grid), 12);
+
+  row->icon = gtk_image_new ();
+  gtk_grid_attach (GTK_GRID (grid), row->icon, 0, 0, 1, 2);
+
+  /* Labels do not wrap, so every row has the same height */
+  row->name = gtk_label_new (NULL);
+  gtk_widget_set_hexpand (row->name, TRUE);
+  gtk_label_set_ellipsize (GTK_LABEL (row->name), PANGO_ELLIPSIZE_END);
+  attrlist = pango_attr_list_new ();
+  pango_attr_list_insert (attrlist, pango_attr_weight_new (PANGO_WEIGHT_SEMIBOLD));
+  gtk_label_set_attributes (GTK_LABEL (row->name), attrlist);
+  pango_attr_list_unref (attrlist);
+  gtk_label_set_xalign (GTK_LABEL (row->name), 0.0f);
+  gtk_grid_attach (GTK_GRID (grid), row->name, 1, 0, 2, 1);
+
+  row->phone = gtk_label_new (NULL);
+  gtk_label_set_ellipsize (GTK_LABEL (row->phone), PANGO_ELLIPSIZE_END);
+  gtk_widget_set_sensitive (row->phone, FALSE);
+  gtk_label_set_xalign (GTK_LABEL (row->phone), 0.0f);
+  gtk_grid_attach (GTK_GRID (grid), row->phone, 1, 1, 1, 1);
+
+  row->date = gtk_label_new (NULL);
+  gtk_label_set_xalign (GTK_LABEL (row->date), 1.0f);
+  gtk_widget_set_sensitive (row->date, FALSE);
+  gtk_grid_attach (GTK_GRID (grid), row->date, 2, 1, 1, 1);
+
+  gtk_container_add (GTK_CONTAINER (row->row), grid);
+  gtk_widget_show_all (row->row);
+  gtk_list_box_insert (self->box, row->row, -1);
+
+  return row;
+}
+
+static void
+roger_journal_pool_row_bind (RogerJournalPoolRow *row,
+                             RmCallEntry         *call)
+{
+  row->call = call;
+
+  gtk_image_set_from_pixbuf (GTK_IMAGE (row->icon), roger_journal_get_call_icon (call->type));
+
+  if (!RM_EMPTY_STRING (call->remote->name)) {
+    gtk_label_set_text (GTK_LABEL (row->name), call->remote->name);
+    gtk_widget_set_sensitive (row->name, TRUE);
+  } else {
+    gtk_label_set_text (GTK_LABEL (row->name), _("Unknown"));
+    gtk_widget_set_sensitive (row->name, FALSE);
+  }
+
+  gtk_label_set_text (GTK_LABEL (row->phone), call->remote->number);
+  g_object_set_data (G_OBJECT (row->row), "number", call->remote->number);
+
+  gtk_label_set_text (GTK_LABEL (row->date), call->date_time);
+}
+
+/* Height of a row including the separator set by the list box header func */
+static gint
+roger_journal_row_pool_measure (RogerJournalRowPool *self)
+{
+  RogerJournalPoolRow *row;
+  GtkWidget *header;
+  gint height;
+  gint header_height = 0;
+
+  if (self->rows->len < 2)
+    return 0;
+
+  row = g_ptr_array_index (self->rows, 1);
+  gtk_widget_get_preferred_height (row->row, NULL, &height);
+
+  header = gtk_list_box_row_get_header (GTK_LIST_BOX_ROW (row->row));
+  if (header)
+    gtk_widget_get_preferred_height (header, NULL, &header_height);
+
+  return height + header_height;
+}
+
+static void
+roger_journal_row_pool_layout (RogerJournalRowPool *self,
+                               gboolean             rebind)
+{
+  guint n_calls = self->calls ? self->calls->len : 0;
+  guint n_rows;
+  guint first;
+  guint idx;
+
+  if (self->in_layout)
+    return;
+
+  self->in_layout = TRUE;
+
+  if (self->row_height > 0 && gtk_adjustment_get_page_size (self->vadjustment) > 0) {
+    gdouble page_size = gtk_adjustment_get_page_size (self->vadjustment);
+    gdouble value = gtk_adjustment_get_value (self->vadjustment);
+
+    n_rows = page_size / self->row_height + 1 + 2 * ROW_POOL_MARGIN;
+    first = value / self->row_height;
+    first = first > ROW_POOL_MARGIN ? first - ROW_POOL_MARGIN : 0;
+  } else {
+    n_rows = ROW_POOL_MIN_ROWS;
+    first = 0;
+  }
+
+  n_rows = MIN (n_rows, n_calls);
+  first = MIN (first, n_calls - n_rows);
+
+  if (self->rows->len > n_rows)
+    g_ptr_array_remove_range (self->rows, n_rows, self->rows->len - n_rows);
+
+  for (idx = 0; idx < n_rows; idx++) {
+    RogerJournalPoolRow *row;
+    RmCallEntry *call = g_ptr_array_index (self->calls, first + idx);
+
+    if (idx == self->rows->len)
+      g_ptr_array_add (self->rows, roger_journal_pool_row_new (self));
+
+    row = g_ptr_array_index (self->rows, idx);
+    if (rebind || row->call != call)
+      roger_journal_pool_row_bind (row, call);
+  }
+
+  self->first = first;
+
+  if (self->row_height == 0)
+    self->row_height = roger_journal_row_pool_measure (self);
+
+  gtk_widget_set_size_request (self->top_spacer, -1, first * self->row_height);
+  gtk_widget_set_size_request (self->bottom_spacer, -1, (n_calls - first - n_rows) * self->row_height);
+
+  self->in_layout = FALSE;
+}
+
+static void
+roger_journal_row_pool_adjustment_cb (GtkAdjustment *adjustment,
+                                      gpointer       user_data)
+{
+  RogerJournalRowPool *self = user_data;
+
+  roger_journal_row_pool_layout (self, FALSE);
+}
+
+/**
+ * roger_journal_row_pool_new:
+ * @box: the list box to fill
+ * @top_spacer: widget above @box standing in for the rows before the first
+ * @bottom_spacer: widget below @box standing in for the rows after the last
+ * @vadjustment: vertical adjustment of the scrolled window containing @box
+ *
+ * Returns: a new #RogerJournalRowPool
+ */
+RogerJournalRowPool *
+roger_journal_row_pool_new (GtkListBox    *box,
+                            GtkWidget     *top_spacer,
+                            GtkWidget     *bottom_spacer,
+                            GtkAdjustment *vadjustment)
+{
+  RogerJournalRowPool *self = g_new0 (RogerJournalRowPool, 1);
+
+  self->box = box;
+  self->top_spacer = top_spacer;
+  self->bottom_spacer = bottom_spacer;
+  self->vadjustment = g_object_ref (vadjustment);
+  self->rows = g_ptr_array_new_with_free_func ((GDestroyNotify)roger_journal_pool_row_free);
+
+  self->value_changed_id = g_signal_connect (vadjustment, "value-changed", G_CALLBACK (roger_journal_row_pool_adjustment_cb), self);
+  self->changed_id = g_signal_connect (vadjustment, "changed", G_CALLBACK (roger_journal_row_pool_adjustment_cb), self);
+
+  return self;
+}
+
+void
+roger_journal_row_pool_free (RogerJournalRowPool *self)
+{
+  if (!self)
+    return;
+
+  g_clear_signal_handler (&self->value_changed_id, self->vadjustment);
+  g_clear_signal_handler (&self->changed_id, self->vadjustment);
+  g_object_unref (self->vadjustment);
+
+  g_ptr_array_unref (self->rows);
+  g_clear_pointer (&self->calls, g_ptr_array_unref);
+  g_free (self);
+}
+
+/**
+ * roger_journal_row_pool_set_calls:
+ * @self: a #RogerJournalRowPool
+ * @calls: (nullable): calls to show, in list order
+ *
+ * Replaces the calls of the list. A reference on @calls is kept, the calls
+ * must stay valid until they are replaced.
+ */
+void
+roger_journal_row_pool_set_calls (RogerJournalRowPool *self,
+                                  GPtrArray           *calls)
+{
+  g_clear_pointer (&self->calls, g_ptr_array_unref);
+  if (calls)
+    self->calls = g_ptr_array_ref (calls);
+
+  roger_journal_row_pool_layout (self, TRUE);
+}
+
+/**
+ * roger_journal_row_pool_update:
+ * @self: a #RogerJournalRowPool
+ *
+ * Binds the instantiated rows again, e.g. after names have been looked up.
+ */
+void
+roger_journal_row_pool_update (RogerJournalRowPool *self)
+{
+  roger_journal_row_pool_layout (self, TRUE);
+}
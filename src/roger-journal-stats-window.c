@@ -0,0 +1,155 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "roger-journal-stats-window.h"
+
+#include <glib/gi18n.h>
+
+/*
+ * Journal statistics window
+ *
+ * Shows one page per statistics group. The pages are filled from the
+ * statistics when the window is opened.
+ */
+
+struct _RogerJournalStatsWindow {
+  HdyWindow parent_instance;
+
+  GtkWidget *stack;
+};
+
+G_DEFINE_TYPE (RogerJournalStatsWindow, roger_journal_stats_window, HDY_TYPE_WINDOW)
+
+enum {
+  STATS_COL_KEY,
+  STATS_COL_CALLS,
+  STATS_COL_MISSED,
+  STATS_COL_MISSED_RATIO,
+  STATS_COL_DURATION,
+  STATS_COL_DURATION_SECONDS,
+  STATS_COL_AVERAGE,
+  STATS_COL_AVERAGE_SECONDS,
+  STATS_N_COLUMNS
+};
+
+static void
+stats_window_add_column (GtkTreeView *view,
+                         const char  *title,
+                         gint         column,
+                         gint         sort_column,
+                         gfloat       xalign)
+{
+  GtkCellRenderer *renderer = gtk_cell_renderer_text_new ();
+  GtkTreeViewColumn *tree_column;
+
+  g_object_set (renderer, "xalign", xalign, NULL);
+  tree_column = gtk_tree_view_column_new_with_attributes (title, renderer, "text", column, NULL);
+  gtk_tree_view_column_set_sort_column_id (tree_column, sort_column);
+  gtk_tree_view_column_set_resizable (tree_column, TRUE);
+  gtk_tree_view_column_set_expand (tree_column, column == STATS_COL_KEY);
+  gtk_tree_view_append_column (view, tree_column);
+}
+
+static GtkWidget *
+stats_window_create_page (RogerJournalStats      *stats,
+                          RogerJournalStatsGroup  group)
+{
+  g_autoptr (GtkListStore) store = NULL;
+  g_autoptr (GPtrArray) entries = roger_journal_stats_get_entries (stats, group);
+  GtkWidget *scrolled;
+  GtkWidget *view;
+  guint idx;
+
+  store = gtk_list_store_new (STATS_N_COLUMNS,
+                              G_TYPE_STRING,
+                              G_TYPE_UINT,
+                              G_TYPE_STRING,
+                              G_TYPE_DOUBLE,
+                              G_TYPE_STRING,
+                              G_TYPE_INT64,
+                              G_TYPE_STRING,
+                              G_TYPE_INT64);
+
+  for (idx = 0; idx < entries->len; idx++) {
+    RogerJournalStatsEntry *entry = g_ptr_array_index (entries, idx);
+    gdouble ratio = (gdouble)entry->missed / entry->calls;
+    gint64 average = entry->duration / entry->calls;
+    g_autofree char *missed = g_strdup_printf ("%u (%.0f%%)", entry->missed, ratio * 100);
+    g_autofree char *duration = roger_journal_stats_format_duration (entry->duration);
+    g_autofree char *average_str = roger_journal_stats_format_duration (average);
+
+    gtk_list_store_insert_with_values (store, NULL, -1,
+                                       STATS_COL_KEY, *entry->key ? entry->key : _("Unknown"),
+                                       STATS_COL_CALLS, entry->calls,
+                                       STATS_COL_MISSED, missed,
+                                       STATS_COL_MISSED_RATIO, ratio,
+                                       STATS_COL_DURATION, duration,
+                                       STATS_COL_DURATION_SECONDS, entry->duration,
+                                       STATS_COL_AVERAGE, average_str,
+                                       STATS_COL_AVERAGE_SECONDS, average,
+                                       -1);
+  }
+
+  view = gtk_tree_view_new_with_model (GTK_TREE_MODEL (store));
+  stats_window_add_column (GTK_TREE_VIEW (view), roger_journal_stats_group_get_title (group), STATS_COL_KEY, STATS_COL_KEY, 0.0f);
+  stats_window_add_column (GTK_TREE_VIEW (view), _("Calls"), STATS_COL_CALLS, STATS_COL_CALLS, 1.0f);
+  stats_window_add_column (GTK_TREE_VIEW (view), _("Missed"), STATS_COL_MISSED, STATS_COL_MISSED_RATIO, 1.0f);
+  stats_window_add_column (GTK_TREE_VIEW (view), _("Duration"), STATS_COL_DURATION, STATS_COL_DURATION_SECONDS, 1.0f);
+  stats_window_add_column (GTK_TREE_VIEW (view), _("Average"), STATS_COL_AVERAGE, STATS_COL_AVERAGE_SECONDS, 1.0f);
+
+  scrolled = gtk_scrolled_window_new (NULL, NULL);
+  gtk_container_add (GTK_CONTAINER (scrolled), view);
+  gtk_widget_show_all (scrolled);
+
+  return scrolled;
+}
+
+static void
+roger_journal_stats_window_class_init (RogerJournalStatsWindowClass *klass)
+{
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+
+  gtk_widget_class_set_template_from_resource (widget_class, "/org/tabos/roger/ui/journal-stats.ui");
+
+  gtk_widget_class_bind_template_child (widget_class, RogerJournalStatsWindow, stack);
+}
+
+static void
+roger_journal_stats_window_init (RogerJournalStatsWindow *self)
+{
+  gtk_widget_init_template (GTK_WIDGET (self));
+}
+
+/**
+ * roger_journal_stats_window_new:
+ * @parent: transient parent
+ * @stats: journal statistics
+ *
+ * Returns: a new statistics window
+ */
+GtkWidget *
+roger_journal_stats_window_new (GtkWindow         *parent,
+                                RogerJournalStats *stats)
+{
+  RogerJournalStatsWindow *self = g_object_new (ROGER_TYPE_JOURNAL_STATS_WINDOW, "transient-for", parent, NULL);
+  gint group;
+
+  for (group = 0; group < ROGER_JOURNAL_STATS_N_GROUPS; group++) {
+    g_autofree char *name = g_strdup_printf ("group-%d", group);
+
+    gtk_stack_add_titled (GTK_STACK (self->stack), stats_window_create_page (stats, group), name, roger_journal_stats_group_get_title (group));
+  }
+
+  return GTK_WIDGET (self);
+}
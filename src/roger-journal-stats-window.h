@@ -0,0 +1,28 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <handy.h>
+
+#include "roger-journal-stats.h"
+
+G_BEGIN_DECLS
+
+#define ROGER_TYPE_JOURNAL_STATS_WINDOW (roger_journal_stats_window_get_type ())
+
+G_DECLARE_FINAL_TYPE (RogerJournalStatsWindow, roger_journal_stats_window, ROGER, JOURNAL_STATS_WINDOW, HdyWindow)
+
+GtkWidget *roger_journal_stats_window_new (GtkWindow         *parent,
+                                           RogerJournalStats *stats);
+
+G_END_DECLS
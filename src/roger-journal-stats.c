@@ -0,0 +1,343 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "roger-journal-stats.h"
+
+#include "roger-journal-export.h"
+
+#include "roger-journal-time.h"
+
+#include <glib/gi18n.h>
+#include <string.h>
+
+/*
+ * Journal statistics
+ *
+ * Calls are aggregated per remote number, per extension (local number), per
+ * day and per hour of day. Each group is a hash table of entries with call
+ * count, missed calls and total duration.
+ *
+ * The contribution of every counted call is remembered, so an update after a
+ * reload only adds the new calls and subtracts the ones which are gone
+ * without walking the unchanged journal entries again.
+ */
+
+typedef struct {
+  RogerJournalStatsEntry *entries[ROGER_JOURNAL_STATS_N_GROUPS];
+  gboolean missed;
+  gint duration;
+} RogerJournalStatsCall;
+
+struct _RogerJournalStats {
+  GHashTable *groups[ROGER_JOURNAL_STATS_N_GROUPS];
+  GHashTable *calls;
+};
+
+static void
+roger_journal_stats_entry_free (RogerJournalStatsEntry *entry)
+{
+  g_free (entry->key);
+  g_free (entry);
+}
+
+RogerJournalStats *
+roger_journal_stats_new (void)
+{
+  RogerJournalStats *self = g_new0 (RogerJournalStats, 1);
+  gint group;
+
+  /* Keys are owned by the entries */
+  for (group = 0; group < ROGER_JOURNAL_STATS_N_GROUPS; group++)
+    self->groups[group] = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify)roger_journal_stats_entry_free);
+
+  self->calls = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+
+  return self;
+}
+
+void
+roger_journal_stats_free (RogerJournalStats *self)
+{
+  gint group;
+
+  if (!self)
+    return;
+
+  g_hash_table_unref (self->calls);
+  for (group = 0; group < ROGER_JOURNAL_STATS_N_GROUPS; group++)
+    g_hash_table_unref (self->groups[group]);
+
+  g_free (self);
+}
+
+static RogerJournalStatsEntry *
+roger_journal_stats_add (RogerJournalStats      *self,
+                         RogerJournalStatsGroup  group,
+                         const char             *key,
+                         RogerJournalStatsCall  *stats_call)
+{
+  RogerJournalStatsEntry *entry = g_hash_table_lookup (self->groups[group], key);
+
+  if (!entry) {
+    entry = g_new0 (RogerJournalStatsEntry, 1);
+    entry->key = g_strdup (key);
+    g_hash_table_insert (self->groups[group], entry->key, entry);
+  }
+
+  entry->calls++;
+  entry->missed += stats_call->missed;
+  entry->duration += stats_call->duration;
+
+  return entry;
+}
+
+static void
+roger_journal_stats_add_call (RogerJournalStats *self,
+                              RmCallEntry       *call)
+{
+  RogerJournalStatsCall *stats_call = g_new0 (RogerJournalStatsCall, 1);
+  gint64 time = roger_journal_time_parse_date (call->date_time);
+
+  stats_call->missed = call->type == RM_CALL_ENTRY_TYPE_MISSED;
+  stats_call->duration = roger_journal_time_parse_duration (call->duration);
+
+  stats_call->entries[ROGER_JOURNAL_STATS_BY_NUMBER] = roger_journal_stats_add (self, ROGER_JOURNAL_STATS_BY_NUMBER, call->remote->number ? call->remote->number : "", stats_call);
+  stats_call->entries[ROGER_JOURNAL_STATS_BY_EXTENSION] = roger_journal_stats_add (self, ROGER_JOURNAL_STATS_BY_EXTENSION, call->local->number ? call->local->number : "", stats_call);
+
+  if (time) {
+    g_autoptr (GDateTime) date_time = g_date_time_new_from_unix_local (time);
+    g_autofree char *day = g_date_time_format (date_time, "%Y-%m-%d");
+    g_autofree char *hour = g_date_time_format (date_time, "%H:00");
+
+    stats_call->entries[ROGER_JOURNAL_STATS_BY_DAY] = roger_journal_stats_add (self, ROGER_JOURNAL_STATS_BY_DAY, day, stats_call);
+    stats_call->entries[ROGER_JOURNAL_STATS_BY_HOUR] = roger_journal_stats_add (self, ROGER_JOURNAL_STATS_BY_HOUR, hour, stats_call);
+  }
+
+  g_hash_table_insert (self->calls, call, stats_call);
+}
+
+static void
+roger_journal_stats_remove_call (RogerJournalStats     *self,
+                                 RogerJournalStatsCall *stats_call)
+{
+  gint group;
+
+  for (group = 0; group < ROGER_JOURNAL_STATS_N_GROUPS; group++) {
+    RogerJournalStatsEntry *entry = stats_call->entries[group];
+
+    if (!entry)
+      continue;
+
+    entry->calls--;
+    entry->missed -= stats_call->missed;
+    entry->duration -= stats_call->duration;
+
+    if (entry->calls == 0)
+      g_hash_table_remove (self->groups[group], entry->key);
+  }
+}
+
+/**
+ * roger_journal_stats_update:
+ * @self: a #RogerJournalStats
+ * @journal: journal list of #RmCallEntry
+ *
+ * Brings the statistics in line with @journal. Calls are identified by their
+ * entry, so this must be called whenever the journal list is replaced, before
+ * new entries could reuse the memory of freed ones.
+ */
+void
+roger_journal_stats_update (RogerJournalStats *self,
+                            GList             *journal)
+{
+  g_autoptr (GHashTable) current = g_hash_table_new (g_direct_hash, g_direct_equal);
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+  GList *list;
+  guint added = 0;
+  guint removed = 0;
+
+  for (list = journal; list != NULL; list = list->next)
+    g_hash_table_add (current, list->data);
+
+  g_hash_table_iter_init (&iter, self->calls);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    if (g_hash_table_contains (current, key))
+      continue;
+
+    roger_journal_stats_remove_call (self, value);
+    g_hash_table_iter_remove (&iter);
+    removed++;
+  }
+
+  for (list = journal; list != NULL; list = list->next) {
+    if (g_hash_table_contains (self->calls, list->data))
+      continue;
+
+    roger_journal_stats_add_call (self, list->data);
+    added++;
+  }
+
+  g_debug ("%s(): %u calls added, %u removed", __FUNCTION__, added, removed);
+}
+
+static gint
+roger_journal_stats_compare_by_calls (gconstpointer a,
+                                      gconstpointer b)
+{
+  const RogerJournalStatsEntry *entry_a = *(const RogerJournalStatsEntry **)a;
+  const RogerJournalStatsEntry *entry_b = *(const RogerJournalStatsEntry **)b;
+
+  if (entry_a->calls != entry_b->calls)
+    return entry_a->calls > entry_b->calls ? -1 : 1;
+
+  return strcmp (entry_a->key, entry_b->key);
+}
+
+static gint
+roger_journal_stats_compare_by_key (gconstpointer a,
+                                    gconstpointer b)
+{
+  const RogerJournalStatsEntry *entry_a = *(const RogerJournalStatsEntry **)a;
+  const RogerJournalStatsEntry *entry_b = *(const RogerJournalStatsEntry **)b;
+
+  return strcmp (entry_a->key, entry_b->key);
+}
+
+/**
+ * roger_journal_stats_get_entries:
+ * @self: a #RogerJournalStats
+ * @group: a #RogerJournalStatsGroup
+ *
+ * Numbers and extensions are sorted by call count, days and hours by time.
+ *
+ * Returns: (transfer container): the #RogerJournalStatsEntry of @group, valid
+ * until the next update
+ */
+GPtrArray *
+roger_journal_stats_get_entries (RogerJournalStats      *self,
+                                 RogerJournalStatsGroup  group)
+{
+  GPtrArray *entries = g_ptr_array_sized_new (g_hash_table_size (self->groups[group]));
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, self->groups[group]);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    g_ptr_array_add (entries, value);
+
+  if (group == ROGER_JOURNAL_STATS_BY_NUMBER || group == ROGER_JOURNAL_STATS_BY_EXTENSION)
+    g_ptr_array_sort (entries, roger_journal_stats_compare_by_calls);
+  else
+    g_ptr_array_sort (entries, roger_journal_stats_compare_by_key);
+
+  return entries;
+}
+
+const char *
+roger_journal_stats_group_get_title (RogerJournalStatsGroup group)
+{
+  switch (group) {
+    case ROGER_JOURNAL_STATS_BY_NUMBER:
+      return _("Number");
+    case ROGER_JOURNAL_STATS_BY_EXTENSION:
+      return _("Extension");
+    case ROGER_JOURNAL_STATS_BY_DAY:
+      return _("Day");
+    case ROGER_JOURNAL_STATS_BY_HOUR:
+      return _("Hour");
+    case ROGER_JOURNAL_STATS_N_GROUPS:
+    default:
+      break;
+  }
+
+  return NULL;
+}
+
+/* Untranslated group names for files, the titles are for display only */
+static const char *
+roger_journal_stats_group_get_id (RogerJournalStatsGroup group)
+{
+  switch (group) {
+    case ROGER_JOURNAL_STATS_BY_NUMBER:
+      return "number";
+    case ROGER_JOURNAL_STATS_BY_EXTENSION:
+      return "extension";
+    case ROGER_JOURNAL_STATS_BY_DAY:
+      return "day";
+    case ROGER_JOURNAL_STATS_BY_HOUR:
+      return "hour";
+    case ROGER_JOURNAL_STATS_N_GROUPS:
+    default:
+      break;
+  }
+
+  return NULL;
+}
+
+/**
+ * roger_journal_stats_format_duration:
+ * @duration: duration in seconds
+ *
+ * Returns: (transfer full): @duration in the "h:mm" format of the journal
+ */
+char *
+roger_journal_stats_format_duration (gint64 duration)
+{
+  return g_strdup_printf ("%" G_GINT64_FORMAT ":%2.2d", duration / 3600, (gint)(duration / 60 % 60));
+}
+
+/**
+ * roger_journal_stats_save_as:
+ * @self: a #RogerJournalStats
+ * @file: file name
+ * @error: return location for a #GError
+ *
+ * Writes all groups to @file as CSV, one line per entry. The group column
+ * holds an untranslated id: number, extension, day or hour.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+roger_journal_stats_save_as (RogerJournalStats  *self,
+                             const char         *file,
+                             GError            **error)
+{
+  g_autoptr (GString) csv = g_string_new ("Group;Key;Calls;Missed;Missed ratio;Duration;Average duration\n");
+  gint group;
+
+  for (group = 0; group < ROGER_JOURNAL_STATS_N_GROUPS; group++) {
+    g_autoptr (GPtrArray) entries = roger_journal_stats_get_entries (self, group);
+    guint idx;
+
+    for (idx = 0; idx < entries->len; idx++) {
+      RogerJournalStatsEntry *entry = g_ptr_array_index (entries, idx);
+      g_autofree char *duration = roger_journal_stats_format_duration (entry->duration);
+      g_autofree char *average = roger_journal_stats_format_duration (entry->duration / entry->calls);
+      char ratio[G_ASCII_DTOSTR_BUF_SIZE];
+
+      /* Keys are names and numbers from the journal and need quoting */
+      roger_journal_export_append_csv (csv, roger_journal_stats_group_get_id (group), FALSE);
+      roger_journal_export_append_csv (csv, entry->key, FALSE);
+      g_string_append_printf (csv, "%u;%u;", entry->calls, entry->missed);
+      g_ascii_formatd (ratio, sizeof (ratio), "%.2f", (gdouble)entry->missed / entry->calls);
+      roger_journal_export_append_csv (csv, ratio, FALSE);
+      roger_journal_export_append_csv (csv, duration, FALSE);
+      roger_journal_export_append_csv (csv, average, TRUE);
+    }
+  }
+
+  return g_file_set_contents (file, csv->str, csv->len, error);
+}
@@ -0,0 +1,51 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <rm/rm.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+  ROGER_JOURNAL_STATS_BY_NUMBER,
+  ROGER_JOURNAL_STATS_BY_EXTENSION,
+  ROGER_JOURNAL_STATS_BY_DAY,
+  ROGER_JOURNAL_STATS_BY_HOUR,
+  ROGER_JOURNAL_STATS_N_GROUPS
+} RogerJournalStatsGroup;
+
+typedef struct {
+  char *key;
+  guint calls;
+  guint missed;
+  gint64 duration;
+} RogerJournalStatsEntry;
+
+typedef struct _RogerJournalStats RogerJournalStats;
+
+RogerJournalStats *roger_journal_stats_new (void);
+void roger_journal_stats_free (RogerJournalStats *self);
+
+void roger_journal_stats_update (RogerJournalStats *self,
+                                 GList             *journal);
+GPtrArray *roger_journal_stats_get_entries (RogerJournalStats      *self,
+                                           RogerJournalStatsGroup  group);
+const char *roger_journal_stats_group_get_title (RogerJournalStatsGroup group);
+char *roger_journal_stats_format_duration (gint64 duration);
+
+gboolean roger_journal_stats_save_as (RogerJournalStats  *self,
+                                      const char         *file,
+                                      GError            **error);
+
+G_END_DECLS
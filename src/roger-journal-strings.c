@@ -0,0 +1,190 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "roger-journal-strings.h"
+
+#include <string.h>
+
+/*
+ * Journal string interning
+ *
+ * Journal entries repeat the same local names, local numbers, remote numbers
+ * and durations many times. Those fields are replaced by a reference counted
+ * canonical copy, so equal values share storage and compare by pointer.
+ *
+ * Call entries are still freed by librm, which frees every field. Interned
+ * fields must therefore be released before, roger_journal_strings_call_free()
+ * takes care of that. A field is interned if it is the canonical pointer of
+ * the table, strings set by librm afterwards are left alone.
+ *
+ * The memory saved depends on the journal, it is logged with g_debug () by
+ * roger_journal_strings_intern_journal () whenever a journal is installed.
+ *
+ * Only used from the main thread.
+ */
+
+static GHashTable *journal_strings = NULL;
+
+static void
+roger_journal_strings_intern (char **field)
+{
+  gpointer key;
+  gpointer value;
+
+  if (!*field)
+    return;
+
+  if (!journal_strings)
+    journal_strings = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  if (!g_hash_table_lookup_extended (journal_strings, *field, &key, &value)) {
+    guint *ref_count = g_new (guint, 1);
+
+    *ref_count = 1;
+    g_hash_table_insert (journal_strings, *field, ref_count);
+    return;
+  }
+
+  /* Already the canonical copy */
+  if (key == *field)
+    return;
+
+  (*(guint *)value)++;
+
+  g_free (*field);
+  *field = key;
+}
+
+static void
+roger_journal_strings_release (char **field)
+{
+  gpointer key;
+  gpointer value;
+
+  if (!*field || !journal_strings)
+    return;
+
+  if (!g_hash_table_lookup_extended (journal_strings, *field, &key, &value) || key != *field)
+    return;
+
+  if (--(*(guint *)value) == 0)
+    g_hash_table_remove (journal_strings, key);
+
+  *field = NULL;
+}
+
+void
+roger_journal_strings_intern_contact (RmContact *contact)
+{
+  roger_journal_strings_intern (&contact->name);
+  roger_journal_strings_intern (&contact->number);
+  roger_journal_strings_intern (&contact->city);
+}
+
+/**
+ * roger_journal_strings_release_contact:
+ * @contact: a #RmContact of a journal entry
+ *
+ * Releases the interned fields of @contact and sets them to %NULL. Must be
+ * called before librm frees or overwrites the contact fields.
+ */
+void
+roger_journal_strings_release_contact (RmContact *contact)
+{
+  roger_journal_strings_release (&contact->name);
+  roger_journal_strings_release (&contact->number);
+  roger_journal_strings_release (&contact->city);
+}
+
+/*
+ * Current usage of the table. Every reference but the first would otherwise
+ * be a copy of its own, that is the memory saved.
+ */
+static void
+roger_journal_strings_get_usage (guint *references,
+                                 gsize *stored,
+                                 gsize *saved)
+{
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+
+  *references = 0;
+  *stored = 0;
+  *saved = 0;
+
+  if (!journal_strings)
+    return;
+
+  g_hash_table_iter_init (&iter, journal_strings);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    guint ref_count = *(guint *)value;
+    gsize size = strlen (key) + 1;
+
+    *references += ref_count;
+    *stored += size;
+    *saved += (ref_count - 1) * size;
+  }
+}
+
+/**
+ * roger_journal_strings_intern_journal:
+ * @journal: journal list of #RmCallEntry
+ *
+ * Interns the remote name, number and city, the local name and number and
+ * the duration of all calls in @journal, and logs the memory currently saved
+ * by interning.
+ */
+void
+roger_journal_strings_intern_journal (GList *journal)
+{
+  GList *list;
+  guint references;
+  gsize stored;
+  gsize saved;
+
+  for (list = journal; list != NULL; list = list->next) {
+    RmCallEntry *call = list->data;
+
+    roger_journal_strings_intern_contact (call->remote);
+    roger_journal_strings_intern_contact (call->local);
+    roger_journal_strings_intern (&call->duration);
+  }
+
+  roger_journal_strings_get_usage (&references, &stored, &saved);
+  g_debug ("%s(): %u references to %u distinct strings, %" G_GSIZE_FORMAT " bytes stored, %" G_GSIZE_FORMAT " bytes saved",
+           __FUNCTION__,
+           references,
+           journal_strings ? g_hash_table_size (journal_strings) : 0,
+           stored,
+           saved);
+}
+
+/**
+ * roger_journal_strings_call_free:
+ * @data: a #RmCallEntry
+ *
+ * Releases the interned fields and frees the call entry.
+ */
+void
+roger_journal_strings_call_free (gpointer data)
+{
+  RmCallEntry *call = data;
+
+  roger_journal_strings_release_contact (call->remote);
+  roger_journal_strings_release_contact (call->local);
+  roger_journal_strings_release (&call->duration);
+
+  rm_call_entry_free (call);
+}
@@ -0,0 +1,26 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <rm/rm.h>
+
+G_BEGIN_DECLS
+
+void roger_journal_strings_intern_journal (GList *journal);
+void roger_journal_strings_intern_contact (RmContact *contact);
+void roger_journal_strings_release_contact (RmContact *contact);
+
+void roger_journal_strings_call_free (gpointer data);
+
+G_END_DECLS
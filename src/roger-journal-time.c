@@ -0,0 +1,107 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "roger-journal-time.h"
+
+#include <string.h>
+
+static inline gint
+roger_journal_time_parse_number (const char **str,
+                                 gint         max_digits)
+{
+  gint value = 0;
+  gint digits;
+
+  for (digits = 0; digits < max_digits && g_ascii_isdigit (**str); digits++, (*str)++)
+    value = value * 10 + (**str - '0');
+
+  return digits ? value : -1;
+}
+
+/**
+ * roger_journal_time_parse_date:
+ * @date_time: journal date in "dd.mm.yy hh:mm" format
+ *
+ * Returns: local time of @date_time as unix time, 0 if it cannot be parsed
+ */
+gint64
+roger_journal_time_parse_date (const char *date_time)
+{
+  g_autoptr (GDateTime) time = NULL;
+  const char *str = date_time;
+  gint day;
+  gint month;
+  gint year;
+  gint hour;
+  gint minute;
+
+  if (!str)
+    return 0;
+
+  day = roger_journal_time_parse_number (&str, 2);
+  if (day < 0 || *str++ != '.')
+    return 0;
+
+  month = roger_journal_time_parse_number (&str, 2);
+  if (month < 0 || *str++ != '.')
+    return 0;
+
+  year = roger_journal_time_parse_number (&str, 4);
+  if (year < 0 || *str++ != ' ')
+    return 0;
+
+  hour = roger_journal_time_parse_number (&str, 2);
+  if (hour < 0 || *str++ != ':')
+    return 0;
+
+  minute = roger_journal_time_parse_number (&str, 2);
+  if (minute < 0)
+    return 0;
+
+  if (year < 100)
+    year += 2000;
+
+  time = g_date_time_new_local (year, month, day, hour, minute, 0);
+
+  return time ? g_date_time_to_unix (time) : 0;
+}
+
+/**
+ * roger_journal_time_parse_duration:
+ * @duration: journal duration in "h:mm" format
+ *
+ * Voicebox durations are given in seconds and are ignored.
+ *
+ * Returns: duration in seconds, 0 if it cannot be parsed
+ */
+gint
+roger_journal_time_parse_duration (const char *duration)
+{
+  const char *str = duration;
+  gint hours;
+  gint minutes;
+
+  if (!str || strchr (str, 's') != NULL)
+    return 0;
+
+  hours = roger_journal_time_parse_number (&str, 6);
+  if (hours < 0 || *str++ != ':')
+    return 0;
+
+  minutes = roger_journal_time_parse_number (&str, 2);
+  if (minutes < 0)
+    return 0;
+
+  return hours * 60 * 60 + minutes * 60;
+}
@@ -15,6 +15,17 @@
 #include "roger-journal.h"
 
 #include "contacts.h"
+#include "roger-journal-archive.h"
+#include "roger-journal-export.h"
+#include "roger-journal-filter.h"
+#include "roger-journal-index.h"
+#include "roger-journal-lookup.h"
+#include "roger-journal-model.h"
+#include "roger-journal-row-pool.h"
+#include "roger-journal-stats.h"
+#include "roger-journal-stats-window.h"
+#include "roger-journal-strings.h"
+#include "roger-journal-time.h"
 #include "roger-phone.h"
 #include "roger-print.h"
 #include "roger-settings.h"
@@ -45,14 +56,23 @@ struct _RogerJournal {
   GtkWidget *headerbar;
   GtkWidget *content_stack;
   GtkWidget *journal_listbox;
+  GtkWidget *journal_top_spacer;
+  GtkWidget *journal_bottom_spacer;
   GtkWidget *menu_button;
   GtkWidget *filter_combobox;
   GtkWidget *view;
   GtkWidget *spinner;
-  GtkListStore *list_store;
+  RogerJournalModel *model;
+  RogerJournalRowPool *row_pool;
   RmFilter *filter;
-  RmFilter *search_filter;
+  RogerJournalFilter *filter_program;
+  RogerJournalIndex *index;
+  RogerJournalIndexResult *search_result;
+  RogerJournalLookup *lookup;
+  RogerJournalArchive *archive;
+  RogerJournalStats *stats;
   GList *list;
+  RmProfile *list_profile;
   GtkWidget *search_bar;
   GtkWidget *search_entry;
 
@@ -72,11 +92,22 @@ struct _RogerJournal {
 
   gboolean mobile;
   gboolean active;
+  gboolean lookup_found;
+  gboolean loading;
   guint update_id;
+  guint search_id;
+  gboolean search_full;
+  GCancellable *search_cancellable;
+  GCancellable *export_cancellable;
+  char *export_subtitle;
+  GCancellable *print_cancellable;
 };
 
 G_DEFINE_TYPE (RogerJournal, roger_journal, HDY_TYPE_WINDOW)
 
+/* Keystrokes within this interval are coalesced into one search */
+#define SEARCH_DELAY_MS 150
+
 static GdkPixbuf *icon_call_in = NULL;
 static GdkPixbuf *icon_call_missed = NULL;
 static GdkPixbuf *icon_call_out = NULL;
@@ -88,20 +119,16 @@ static GdkPixbuf *icon_blocked = NULL;
 
 static GSettings *journal_window_state = NULL;
 
-static void
-clear_listbox (GtkWidget *widget,
-               gpointer   data)
-{
-  gtk_widget_destroy (widget);
-}
-
 void
 journal_clear (RogerJournal *journal)
 {
-  if (journal->mobile)
-    gtk_container_foreach (GTK_CONTAINER (journal->journal_listbox), clear_listbox, NULL);
-  else
-    gtk_list_store_clear (journal->list_store);
+  if (journal->mobile) {
+    roger_journal_row_pool_set_calls (journal->row_pool, NULL);
+  } else {
+    /* Detach model while rows are rebuilt, it is attached again in journal_redraw () */
+    gtk_tree_view_set_model (GTK_TREE_VIEW (journal->view), NULL);
+    roger_journal_model_set_journal (journal->model, NULL);
+  }
 }
 
 static void
@@ -167,149 +194,217 @@ box_header_func (GtkListBoxRow *row,
   }
 }
 
+/* The model applies the search result itself */
+static gboolean
+journal_model_filter_func (RmCallEntry *call,
+                           gint64       time,
+                           gpointer     user_data)
+{
+  RogerJournal *self = ROGER_JOURNAL (user_data);
+
+  g_assert (call != NULL);
+
+  return roger_journal_filter_match (self->filter_program, call, time);
+}
+
+static gboolean
+journal_filter_func (RmCallEntry *call,
+                     gpointer     user_data)
+{
+  RogerJournal *self = ROGER_JOURNAL (user_data);
+
+  if (journal_model_filter_func (call, 0, user_data) == FALSE)
+    return FALSE;
+
+  return roger_journal_index_result_contains (self->search_result, call);
+}
+
+static void
+journal_update_title (RogerJournal *self,
+                      gint          count,
+                      gint          duration)
+{
+  RmProfile *profile = rm_profile_get_active ();
+
+  hdy_header_bar_set_title (HDY_HEADER_BAR (self->headerbar), profile ? profile->name : _("<No profile>"));
+  g_autofree char *markup = g_strdup_printf (_("%d calls, %d:%2.2dh"), count, duration / 3600, duration / 60 % 60);
+  hdy_header_bar_set_subtitle (HDY_HEADER_BAR (self->headerbar), markup);
+}
+
+static void
+journal_update_model_title (RogerJournal *self)
+{
+  gint count = roger_journal_model_get_n_rows (self->model);
+  gint duration = roger_journal_model_get_total_duration (self->model);
+
+  journal_update_title (self, count, duration);
+}
+
 void
 journal_redraw (RogerJournal *self)
 {
+  g_autoptr (GPtrArray) calls = NULL;
   GList *list;
   gint duration = 0;
-  char *text = NULL;
-  gint count = 0;
-  RmProfile *profile;
 
-  /* Update liststore */
-  for (list = self->list; list != NULL; list = list->next) {
-    RmCallEntry *call = list->data;
+  if (!self->mobile) {
+    /* Only the row index is rebuilt, values are read on demand by the view */
+    roger_journal_model_set_journal (self->model, self->list);
+    roger_journal_model_refilter (self->model);
+    gtk_tree_view_set_model (GTK_TREE_VIEW (self->view), GTK_TREE_MODEL (self->model));
 
-    g_assert (call != NULL);
+    journal_update_model_title (self);
+    return;
+  }
 
-    if (rm_filter_rule_match (self->filter, call) == FALSE) {
-      continue;
-    }
+  /* Only the rows in view are instantiated by the row pool */
+  calls = g_ptr_array_new ();
+  for (list = self->list; list != NULL; list = list->next) {
+    RmCallEntry *call = list->data;
 
-    if (rm_filter_rule_match (self->search_filter, call) == FALSE) {
+    if (!journal_filter_func (call, self))
       continue;
-    }
 
-    if (!self->mobile) {
-      GtkTreeIter iter;
-
-      gtk_list_store_insert_with_values (self->list_store, &iter, -1,
-                                         JOURNAL_COL_TYPE, roger_journal_get_call_icon (call->type),
-                                         JOURNAL_COL_DATETIME, call->date_time,
-                                         JOURNAL_COL_NAME, call->remote->name,
-                                         JOURNAL_COL_COMPANY, call->remote->company,
-                                         JOURNAL_COL_NUMBER, call->remote->number,
-                                         JOURNAL_COL_CITY, call->remote->city,
-                                         JOURNAL_COL_EXTENSION, call->local->name,
-                                         JOURNAL_COL_LINE, call->local->number,
-                                         JOURNAL_COL_DURATION, call->duration,
-                                         JOURNAL_COL_CALL_PTR, call,
-                                         -1);
-    } else {
-      GtkWidget *row = gtk_list_box_row_new ();
-      GtkWidget *grid = gtk_grid_new ();
-      GtkWidget *icon;
-      GtkWidget *name;
-      GtkWidget *date;
-      GtkWidget *phone;
-      g_autofree char *tmp = NULL;
-
-      gtk_container_set_border_width (GTK_CONTAINER (grid), 6);
-
-      icon = gtk_image_new_from_pixbuf (roger_journal_get_call_icon (call->type));
-      gtk_grid_attach (GTK_GRID (grid), icon, 0, 0, 1, 2);
-      gtk_grid_set_row_spacing (GTK_GRID (grid), 6);
-      gtk_grid_set_column_spacing (GTK_GRID (grid), 12);
-
-      if (!RM_EMPTY_STRING (call->remote->name)) {
-        name = gtk_label_new (call->remote->name);
-      } else {
-        name = gtk_label_new (_("Unknown"));
-        gtk_widget_set_sensitive (name, FALSE);
-      }
-      gtk_label_set_line_wrap (GTK_LABEL (name), TRUE);
-      gtk_widget_set_hexpand (name, TRUE);
-      gtk_label_set_ellipsize (GTK_LABEL (name), PANGO_ELLIPSIZE_END);
-      PangoAttrList *attrlist = pango_attr_list_new ();
-      PangoAttribute *attr = pango_attr_weight_new (PANGO_WEIGHT_SEMIBOLD);
-      pango_attr_list_insert (attrlist, attr);
-      gtk_label_set_attributes (GTK_LABEL (name), attrlist);
-      pango_attr_list_unref (attrlist);
-
-      gtk_label_set_xalign (GTK_LABEL (name), 0.0f);
-      gtk_grid_attach (GTK_GRID (grid), name, 1, 0, 2, 1);
-
-      phone = gtk_label_new (call->remote->number);
-      gtk_label_set_line_wrap (GTK_LABEL (phone), TRUE);
-      gtk_widget_set_sensitive (phone, FALSE);
-      gtk_label_set_xalign (GTK_LABEL (phone), 0.0f);
-      gtk_grid_attach (GTK_GRID (grid), phone, 1, 1, 1, 1);
-      g_object_set_data (G_OBJECT (row), "number", call->remote->number);
-
-      tmp = g_strdup (call->date_time);
-      date = gtk_label_new (tmp);
-      gtk_label_set_line_wrap (GTK_LABEL (date), TRUE);
-      gtk_label_set_xalign (GTK_LABEL (date), 1.0f);
-      gtk_widget_set_sensitive (date, FALSE);
-      gtk_grid_attach (GTK_GRID (grid), date, 2, 1, 1, 1);
-
-      /*duration = gtk_label_new(call->duration);
-       *  gtk_label_set_xalign (GTK_LABEL(duration), 1.0f);
-       *  gtk_grid_attach (GTK_GRID (grid), duration, 2, 0, 1, 3);*/
-
-      gtk_widget_show_all (grid);
-
-      gtk_container_add (GTK_CONTAINER (row), grid);
-      gtk_widget_show_all (row);
-      gtk_list_box_insert (GTK_LIST_BOX (self->journal_listbox), row, -1);
-    }
-    if (call->duration && strchr (call->duration, 's') != NULL) {
-      /* Ignore voicebox duration */
-    } else {
-      if (call->duration != NULL && strlen (call->duration) > 0) {
-        duration += (call->duration[0] - '0') * 60;
-        duration += (call->duration[2] - '0') * 10;
-        duration += call->duration[3] - '0';
-      }
-    }
-    count++;
+    g_ptr_array_add (calls, call);
+    duration += roger_journal_time_parse_duration (call->duration);
   }
 
-  profile = rm_profile_get_active ();
+  roger_journal_row_pool_set_calls (self->row_pool, calls);
+  journal_update_title (self, calls->len, duration);
+}
 
-  hdy_header_bar_set_title (HDY_HEADER_BAR (self->headerbar), profile ? profile->name : _("<No profile>"));
-  g_autofree char *markup = g_strdup_printf (_("%d calls, %d:%2.2dh"), count, duration / 60, duration % 60);
-  hdy_header_bar_set_subtitle (HDY_HEADER_BAR (self->headerbar), markup);
+typedef struct {
+  RogerJournalIndex *index;
+  RogerJournalIndexResult *previous;
+  RogerJournalModelSearch *rows;
+  char *text;
+} JournalSearchData;
 
-  g_free (text);
+static void
+journal_search_data_free (JournalSearchData *data)
+{
+  roger_journal_index_unref (data->index);
+  g_clear_pointer (&data->previous, roger_journal_index_result_unref);
+  g_clear_pointer (&data->rows, roger_journal_model_search_free);
+  g_free (data->text);
+  g_free (data);
 }
 
 static void
-lookup_journal_thread_cb (GTask        *task,
+journal_search_thread_cb (GTask        *task,
                           gpointer      source_object,
                           gpointer      task_data,
                           GCancellable *cancellable)
 {
-  RogerJournal *self = ROGER_JOURNAL (task_data);
-  GList *list;
-  gboolean retval = FALSE;
+  JournalSearchData *data = task_data;
+  RogerJournalIndexResult *result;
+
+  result = roger_journal_index_search (data->index, data->text, data->previous, cancellable);
+
+  /* The visible rows are built here as well, the main thread only swaps them in */
+  if (data->rows && !g_cancellable_is_cancelled (cancellable))
+    roger_journal_model_search_run (data->rows, result, cancellable);
 
-  if (g_task_return_error_if_cancelled (task))
+  if (g_task_return_error_if_cancelled (task)) {
+    g_clear_pointer (&result, roger_journal_index_result_unref);
     return;
+  }
 
-  for (list = self->list; list; list = list->next) {
-    RmCallEntry *call = list->data;
+  g_task_return_pointer (task, result, (GDestroyNotify)roger_journal_index_result_unref);
+}
 
-    if (!RM_EMPTY_STRING (call->remote->name))
-      continue;
+static void
+journal_search_cb (GObject      *source_object,
+                   GAsyncResult *res,
+                   gpointer      user_data)
+{
+  g_autoptr (GError) error = NULL;
+  RogerJournalIndexResult *result = g_task_propagate_pointer (G_TASK (res), &error);
+  JournalSearchData *data = g_task_get_task_data (G_TASK (res));
+  RogerJournal *self;
 
-    if (rm_lookup_search (call->remote->number, call->remote)) {
-      call->remote->lookup = TRUE;
-      retval = TRUE;
-    }
+  /* Stale queries are cancelled, the journal might already be gone */
+  if (error)
+    return;
+
+  self = ROGER_JOURNAL (user_data);
+  g_clear_object (&self->search_cancellable);
+
+  g_clear_pointer (&self->search_result, roger_journal_index_result_unref);
+  self->search_result = result;
+
+  if (self->mobile || !data->rows) {
+    roger_journal_model_set_search_result (self->model, result);
+    journal_redraw (self);
+    return;
   }
 
-  g_task_return_boolean (task, retval);
+  /* Swap in the rows built by the worker while the view is detached */
+  gtk_tree_view_set_model (GTK_TREE_VIEW (self->view), NULL);
+  roger_journal_model_apply_search (self->model, data->rows);
+  gtk_tree_view_set_model (GTK_TREE_VIEW (self->view), GTK_TREE_MODEL (self->model));
+
+  journal_update_model_title (self);
+}
+
+static gboolean
+journal_search_timeout_cb (gpointer user_data)
+{
+  RogerJournal *self = ROGER_JOURNAL (user_data);
+  g_autoptr (GTask) task = NULL;
+  JournalSearchData *data;
+
+  self->search_id = 0;
+
+  g_cancellable_cancel (self->search_cancellable);
+  g_clear_object (&self->search_cancellable);
+
+  if (!self->index) {
+    g_clear_pointer (&self->search_result, roger_journal_index_result_unref);
+    roger_journal_model_set_search_result (self->model, NULL);
+    journal_clear (self);
+    journal_redraw (self);
+    return G_SOURCE_REMOVE;
+  }
+
+  self->search_cancellable = g_cancellable_new ();
+
+  data = g_new0 (JournalSearchData, 1);
+  data->index = roger_journal_index_ref (self->index);
+  /* Only a narrowed query may start from the previous matches */
+  if (self->search_result && !self->search_full)
+    data->previous = roger_journal_index_result_ref (self->search_result);
+  self->search_full = FALSE;
+  data->text = g_strdup (gtk_entry_get_text (GTK_ENTRY (self->search_entry)));
+  if (!self->mobile)
+    data->rows = roger_journal_model_search_new (self->model);
+
+  task = g_task_new (NULL, self->search_cancellable, journal_search_cb, self);
+  g_task_set_source_tag (task, journal_search_timeout_cb);
+  g_task_set_task_data (task, data, (GDestroyNotify)journal_search_data_free);
+  g_task_run_in_thread (task, journal_search_thread_cb);
+
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Runs the current query again on the worker after the journal, its index or
+ * looked up names changed. Until the new rows are swapped in, the model keeps
+ * the previous result: it only matches calls which were part of the old index,
+ * so new calls are hidden meanwhile.
+ */
+static void
+journal_queue_search (RogerJournal *self)
+{
+  if (!self->search_result && RM_EMPTY_STRING (gtk_entry_get_text (GTK_ENTRY (self->search_entry))))
+    return;
+
+  self->search_full = TRUE;
+
+  g_clear_handle_id (&self->search_id, g_source_remove);
+  g_cancellable_cancel (self->search_cancellable);
+
+  self->search_id = g_timeout_add (SEARCH_DELAY_MS, journal_search_timeout_cb, self);
 }
 
 void journal_filter_box_changed (GtkComboBox *box,
@@ -339,73 +434,185 @@ journal_update_content (RogerJournal *self)
 }
 
 static void
-journal_reverse_lookup_async (GCancellable        *cancellable,
-                              GAsyncReadyCallback  callback,
-                              gpointer             user_data)
+journal_lookup_batch_cb (GPtrArray *calls,
+                         gpointer   user_data)
+{
+  RogerJournal *self = ROGER_JOURNAL (user_data);
+  guint idx;
+
+  for (idx = 0; idx < calls->len; idx++)
+    roger_journal_index_update (self->index, g_ptr_array_index (calls, idx));
+
+  /* Values are read from the call entries, so only the changed rows are notified */
+  roger_journal_model_calls_changed (self->model, calls);
+  if (self->mobile)
+    roger_journal_row_pool_update (self->row_pool);
+
+  self->lookup_found = TRUE;
+}
+
+static void
+journal_lookup_done_cb (gpointer user_data)
 {
-  g_autoptr (GTask) task = NULL;
   RogerJournal *self = ROGER_JOURNAL (user_data);
 
-  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+  g_clear_pointer (&self->lookup, roger_journal_lookup_free);
 
-  task = g_task_new (NULL, cancellable, callback, user_data);
-  g_task_set_source_tag (task, journal_reverse_lookup_async);
+  /* Looked up names may now match the search text */
+  if (self->lookup_found)
+    journal_queue_search (self);
 
-  g_task_set_return_on_cancel (task, FALSE);
+  /* The router journal is still loading if the archived one is shown */
+  if (!self->loading) {
+    gtk_spinner_stop (GTK_SPINNER (self->spinner));
+    gtk_widget_hide (self->spinner);
+  }
+}
 
-  g_task_set_task_data (task, g_object_ref (self), g_object_unref);
-  g_task_run_in_thread (task, lookup_journal_thread_cb);
+static char *
+journal_get_call_key (RmCallEntry *call)
+{
+  return g_strdup_printf ("%d|%s|%s|%s",
+                          call->type,
+                          call->date_time ? call->date_time : "",
+                          call->remote->number ? call->remote->number : "",
+                          call->duration ? call->duration : "");
 }
 
-static gboolean
-journal_reverse_lookup_finished (GObject       *source,
-                                 GAsyncResult  *result,
-                                 GError       **error)
+/*
+ * Updates the model to the current journal. If the journal changed too much
+ * for single row updates, the rows are rebuilt with the view detached and the
+ * selected calls are selected again afterwards.
+ */
+static void
+journal_merge_model (RogerJournal *self)
 {
-  g_return_val_if_fail (g_task_is_valid (result, source), FALSE);
-  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+  GtkTreeSelection *selection;
+  g_autoptr (GPtrArray) selected = g_ptr_array_new ();
+  GList *rows;
+  GList *row;
+  guint idx;
+
+  if (roger_journal_model_merge_journal (self->model, self->list))
+    return;
+
+  selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (self->view));
+  rows = gtk_tree_selection_get_selected_rows (selection, NULL);
+  for (row = rows; row != NULL; row = row->next)
+    g_ptr_array_add (selected, roger_journal_model_get_call (self->model, gtk_tree_path_get_indices (row->data)[0]));
+  g_list_free_full (rows, (GDestroyNotify)gtk_tree_path_free);
+
+  gtk_tree_view_set_model (GTK_TREE_VIEW (self->view), NULL);
+  roger_journal_model_reset (self->model, self->list);
+  gtk_tree_view_set_model (GTK_TREE_VIEW (self->view), GTK_TREE_MODEL (self->model));
+
+  for (idx = 0; idx < selected->len; idx++) {
+    gint position = roger_journal_model_get_row_for_call (self->model, g_ptr_array_index (selected, idx));
+    GtkTreePath *path;
 
-  return g_task_propagate_boolean (G_TASK (result), error);
+    if (position < 0)
+      continue;
+
+    path = gtk_tree_path_new_from_indices (position, -1);
+    gtk_tree_selection_select_path (selection, path);
+    gtk_tree_path_free (path);
+  }
 }
 
+/*
+ * Merges a freshly loaded journal into the current one. Calls which are part
+ * of both are identified by type, date, number and duration. For those the
+ * current entry is kept with its lookup result and the loaded duplicate is
+ * freed. The view only receives the inserted and deleted rows, so scroll
+ * position and selection are kept.
+ */
 static void
-journal_reverse_lookup_cb (GObject      *source_object,
-                           GAsyncResult *res,
-                           gpointer      user_data)
+journal_merge (RogerJournal *self,
+               GList        *list)
 {
-  g_autoptr (GError) error = NULL;
-  gboolean lookup_found = journal_reverse_lookup_finished (source_object, res, &error);
-  RogerJournal *self = ROGER_JOURNAL (user_data);
-  GtkTreeIter iter;
-  gboolean valid;
-  RmCallEntry *call;
+  g_autoptr (GHashTable) known = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_queue_free);
+  GtkAdjustment *vadjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (self->view));
+  GtkTreePath *start = NULL;
+  RmCallEntry *anchor = NULL;
+  GList *removed = NULL;
+  GHashTableIter hash_iter;
+  gpointer value;
+  GList *iter;
+  guint added = 0;
+
+  for (iter = self->list; iter != NULL; iter = iter->next) {
+    char *key = journal_get_call_key (iter->data);
+    GQueue *queue = g_hash_table_lookup (known, key);
+
+    if (!queue) {
+      queue = g_queue_new ();
+      g_hash_table_insert (known, key, queue);
+    } else {
+      g_free (key);
+    }
 
-  if (lookup_found) {
-    valid = gtk_tree_model_get_iter_first (GTK_TREE_MODEL (self->list_store), &iter);
-    while (valid) {
-      gtk_tree_model_get (GTK_TREE_MODEL (self->list_store), &iter, JOURNAL_COL_CALL_PTR, &call, -1);
+    g_queue_push_tail (queue, iter->data);
+  }
 
-      if (call->remote->lookup) {
-        gtk_list_store_set (self->list_store, &iter, JOURNAL_COL_NAME, call->remote->name, -1);
-        gtk_list_store_set (self->list_store, &iter, JOURNAL_COL_CITY, call->remote->city, -1);
-      }
+  for (iter = list; iter != NULL; iter = iter->next) {
+    g_autofree char *key = journal_get_call_key (iter->data);
+    GQueue *queue = g_hash_table_lookup (known, key);
+
+    if (queue && !g_queue_is_empty (queue)) {
+      roger_journal_strings_call_free (iter->data);
+      iter->data = g_queue_pop_head (queue);
+    } else {
+      added++;
+    }
+  }
+
+  /* Everything left over is no longer part of the router journal */
+  g_hash_table_iter_init (&hash_iter, known);
+  while (g_hash_table_iter_next (&hash_iter, NULL, &value)) {
+    GQueue *queue = value;
+
+    while (!g_queue_is_empty (queue))
+      removed = g_list_prepend (removed, g_queue_pop_head (queue));
+  }
 
-      valid = gtk_tree_model_iter_next (GTK_TREE_MODEL (self->list_store), &iter);
+  g_debug ("%s(): %u new, %u removed calls", __FUNCTION__, added, g_list_length (removed));
+
+  /* Remember the first visible call unless the view is scrolled to the top */
+  if (gtk_adjustment_get_value (vadjustment) > gtk_adjustment_get_lower (vadjustment) &&
+      gtk_tree_view_get_visible_range (GTK_TREE_VIEW (self->view), &start, NULL)) {
+    anchor = roger_journal_model_get_call (self->model, gtk_tree_path_get_indices (start)[0]);
+    gtk_tree_path_free (start);
+  }
+
+  g_list_free (self->list);
+  self->list = list;
+
+  g_clear_pointer (&self->index, roger_journal_index_unref);
+  self->index = roger_journal_index_new (self->list);
+
+  journal_merge_model (self);
+  journal_queue_search (self);
+
+  if (anchor && !g_list_find (removed, anchor)) {
+    gint row = roger_journal_model_get_row_for_call (self->model, anchor);
+
+    if (row >= 0) {
+      GtkTreePath *path = gtk_tree_path_new_from_indices (row, -1);
+
+      gtk_tree_view_scroll_to_cell (GTK_TREE_VIEW (self->view), path, NULL, TRUE, 0.0, 0.0);
+      gtk_tree_path_free (path);
     }
   }
 
-  gtk_spinner_stop (GTK_SPINNER (self->spinner));
-  gtk_widget_hide (self->spinner);
+  g_list_free_full (removed, roger_journal_strings_call_free);
+
+  journal_update_model_title (self);
 }
 
 static void
-roger_journal_loaded_cb (GObject      *source_object,
-                         GAsyncResult *res,
-                         gpointer      user_data)
+journal_set_list (RogerJournal *self,
+                  GList        *list)
 {
-  RogerJournal *self = ROGER_JOURNAL (user_data);
-  g_autoptr (GError) error = NULL;
-  GList *list = rm_router_load_journal_finish (source_object, res, &error);
   GList *old;
 
   if (!self->active) {
@@ -413,6 +620,23 @@ roger_journal_loaded_cb (GObject      *source_object,
     journal_update_content (self);
   }
 
+  /* Lookups and a running export refer to the old entries */
+  g_clear_pointer (&self->lookup, roger_journal_lookup_free);
+  g_cancellable_cancel (self->export_cancellable);
+  self->lookup_found = FALSE;
+
+  roger_journal_strings_intern_journal (list);
+
+  /* A reload of the same profile only needs the difference */
+  if (self->list && list && !self->mobile && self->list_profile == rm_profile_get_active ()) {
+    journal_merge (self, list);
+    roger_journal_stats_update (self->stats, self->list);
+    self->lookup = roger_journal_lookup_new (self->list, journal_lookup_batch_cb, journal_lookup_done_cb, self);
+    return;
+  }
+
+  self->list_profile = rm_profile_get_active ();
+
   if (!self->list && list)
     journal_update_filter_box (self);
 
@@ -425,14 +649,47 @@ roger_journal_loaded_cb (GObject      *source_object,
   old = self->list;
   self->list = list;
 
-  if (old) {
-    rm_journal_free (old);
-  }
+  /* The index refers to the call entries, so replace it before the old list is freed */
+  g_clear_pointer (&self->index, roger_journal_index_unref);
+  self->index = roger_journal_index_new (self->list);
+
+  if (old)
+    g_list_free_full (old, roger_journal_strings_call_free);
+
+  roger_journal_stats_update (self->stats, self->list);
 
   journal_redraw (self);
-  if (self->list) {
-    journal_reverse_lookup_async (self->cancellable, journal_reverse_lookup_cb, self);
+  journal_queue_search (self);
+  if (self->list)
+    self->lookup = roger_journal_lookup_new (self->list, journal_lookup_batch_cb, journal_lookup_done_cb, self);
+}
+
+static void
+roger_journal_loaded_cb (GObject      *source_object,
+                         GAsyncResult *res,
+                         gpointer      user_data)
+{
+  g_autoptr (GError) error = NULL;
+  GList *list = rm_router_load_journal_finish (source_object, res, &error);
+  RogerJournal *self;
+
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return;
+
+  self = ROGER_JOURNAL (user_data);
+  self->loading = FALSE;
+
+  if (error && self->list) {
+    /* Keep showing the archived journal */
+    g_warning ("%s(): Could not load journal: %s", __FUNCTION__, error->message);
   } else {
+    journal_set_list (self, list);
+
+    if (self->archive && roger_journal_archive_get_profile (self->archive) == self->list_profile)
+      roger_journal_archive_store (self->archive, self->list);
+  }
+
+  if (!self->lookup) {
     gtk_spinner_stop (GTK_SPINNER (self->spinner));
     gtk_widget_hide (self->spinner);
   }
@@ -451,6 +708,19 @@ roger_journal_reload (RogerJournal *self)
   gtk_spinner_start (GTK_SPINNER (self->spinner));
   gtk_widget_show (self->spinner);
 
+  if (!self->archive || roger_journal_archive_get_profile (self->archive) != profile) {
+    GList *list;
+
+    g_clear_pointer (&self->archive, roger_journal_archive_free);
+    self->archive = roger_journal_archive_new (profile);
+
+    /* Show the last known journal until the router answers */
+    list = roger_journal_archive_load (self->archive);
+    if (list)
+      journal_set_list (self, list);
+  }
+
+  self->loading = TRUE;
   rm_router_load_journal_async (profile, self->cancellable, roger_journal_loaded_cb, self);
 }
 
@@ -489,39 +759,179 @@ clear_journal (RogerJournal *self)
   rm_router_clear_journal (rm_profile_get_active ());
 }
 
-void
-delete_foreach (GtkTreeModel *model,
-                GtkTreePath  *path,
-                GtkTreeIter  *iter,
-                gpointer      user_data)
+typedef struct {
+  RogerJournal *journal;
+  RmProfile *profile;
+  GQueue jobs;
+} JournalDeleteBatch;
+
+typedef struct {
+  RmProfile *profile;
+  RmCallEntryTypes type;
+  char *priv;
+} JournalDeleteJob;
+
+static void
+journal_delete_job_free (JournalDeleteJob *job)
 {
-  RogerJournal *self = ROGER_JOURNAL (user_data);
-  RmCallEntry *call = NULL;
-  GValue ptr = { 0 };
+  g_free (job->priv);
+  g_free (job);
+}
 
-  gtk_tree_model_get_value (model, iter, JOURNAL_COL_CALL_PTR, &ptr);
+static void
+journal_delete_batch_free (JournalDeleteBatch *batch)
+{
+  g_queue_foreach (&batch->jobs, (GFunc)journal_delete_job_free, NULL);
+  g_queue_clear (&batch->jobs);
+  g_object_unref (batch->journal);
+  g_free (batch);
+}
 
-  call = g_value_get_pointer (&ptr);
+static void
+journal_delete_thread_cb (GTask        *task,
+                          gpointer      source_object,
+                          gpointer      task_data,
+                          GCancellable *cancellable)
+{
+  JournalDeleteJob *job = task_data;
 
-  switch (call->type) {
-    case RM_CALL_ENTRY_TYPE_RECORD:
-      g_unlink (call->priv);
-      break;
-    case RM_CALL_ENTRY_TYPE_VOICE:
-      rm_router_delete_voice (rm_profile_get_active (), call->priv);
-      break;
-    case RM_CALL_ENTRY_TYPE_FAX:
-      rm_router_delete_fax (rm_profile_get_active (), call->priv);
-      break;
-    case RM_CALL_ENTRY_TYPE_FAX_REPORT:
-      g_unlink (call->priv);
-      break;
-    default:
-      self->list = g_list_remove (self->list, call);
-      g_debug ("Deleting: '%s'", call->date_time);
-      rm_journal_save (self->list);
-      break;
+  if (job->type == RM_CALL_ENTRY_TYPE_VOICE)
+    rm_router_delete_voice (job->profile, job->priv);
+  else
+    rm_router_delete_fax (job->profile, job->priv);
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static void journal_delete_next (JournalDeleteBatch *batch);
+
+static void
+journal_delete_cb (GObject      *source_object,
+                   GAsyncResult *res,
+                   gpointer      user_data)
+{
+  journal_delete_next (user_data);
+}
+
+/*
+ * Sends the deletions of a batch to the router one after another. librm makes
+ * no promise about concurrent calls on one router session, so only one
+ * request is in flight. Profiles are not reference counted: the profile is
+ * checked on the main thread before each request and the rest of the batch
+ * is dropped once it is not the active one anymore.
+ */
+static void
+journal_delete_next (JournalDeleteBatch *batch)
+{
+  g_autoptr (GTask) task = NULL;
+  JournalDeleteJob *job;
+
+  if (rm_profile_get_active () != batch->profile) {
+    g_debug ("%s(): Profile changed, dropping %u deletions", __FUNCTION__, g_queue_get_length (&batch->jobs));
+    journal_delete_batch_free (batch);
+    return;
+  }
+
+  job = g_queue_pop_head (&batch->jobs);
+  if (!job) {
+    /* Voice box and fax entries are listed by the router, reload once all are gone */
+    roger_journal_reload (batch->journal);
+    journal_delete_batch_free (batch);
+    return;
+  }
+
+  job->profile = batch->profile;
+
+  task = g_task_new (NULL, NULL, journal_delete_cb, batch);
+  g_task_set_task_data (task, job, (GDestroyNotify)journal_delete_job_free);
+  g_task_run_in_thread (task, journal_delete_thread_cb);
+}
+
+/*
+ * Deletes @calls. Recordings and fax reports are removed locally, voice box
+ * and fax deletions are sent to the router off the main thread, one at a
+ * time. Plain calls are
+ * removed from the journal in one pass, which is saved once.
+ */
+static void
+journal_delete_calls (RogerJournal *self,
+                      GPtrArray    *calls)
+{
+  g_autoptr (GHashTable) deleted = g_hash_table_new (g_direct_hash, g_direct_equal);
+  RmProfile *profile = rm_profile_get_active ();
+  JournalDeleteBatch *batch = NULL;
+  GList *removed = NULL;
+  GList *list;
+  guint idx;
+
+  for (idx = 0; idx < calls->len; idx++) {
+    RmCallEntry *call = g_ptr_array_index (calls, idx);
+    JournalDeleteJob *job;
+
+    switch (call->type) {
+      case RM_CALL_ENTRY_TYPE_RECORD:
+      case RM_CALL_ENTRY_TYPE_FAX_REPORT:
+        g_unlink (call->priv);
+        break;
+      case RM_CALL_ENTRY_TYPE_VOICE:
+      case RM_CALL_ENTRY_TYPE_FAX:
+        if (!batch) {
+          batch = g_new0 (JournalDeleteBatch, 1);
+          batch->journal = g_object_ref (self);
+          batch->profile = profile;
+          g_queue_init (&batch->jobs);
+        }
+
+        job = g_new0 (JournalDeleteJob, 1);
+        job->type = call->type;
+        job->priv = g_strdup (call->priv);
+        g_queue_push_tail (&batch->jobs, job);
+        break;
+      default:
+        g_hash_table_add (deleted, call);
+        break;
+    }
+  }
+
+  if (batch)
+    journal_delete_next (batch);
+
+  if (g_hash_table_size (deleted) == 0)
+    return;
+
+  /* Lookups and a running export refer to the entries about to be freed */
+  g_clear_pointer (&self->lookup, roger_journal_lookup_free);
+  g_cancellable_cancel (self->export_cancellable);
+
+  list = self->list;
+  while (list != NULL) {
+    GList *next = list->next;
+
+    if (g_hash_table_contains (deleted, list->data)) {
+      self->list = g_list_remove_link (self->list, list);
+      removed = g_list_concat (list, removed);
+    }
+
+    list = next;
   }
+
+  g_debug ("%s(): Deleting %u calls", __FUNCTION__, g_hash_table_size (deleted));
+  rm_journal_save (self->list);
+  if (self->archive)
+    roger_journal_archive_store (self->archive, self->list);
+
+  journal_merge_model (self);
+
+  g_clear_pointer (&self->index, roger_journal_index_unref);
+  self->index = roger_journal_index_new (self->list);
+  journal_queue_search (self);
+  roger_journal_stats_update (self->stats, self->list);
+
+  g_list_free_full (removed, roger_journal_strings_call_free);
+
+  journal_update_model_title (self);
+  if (self->list)
+    self->lookup = roger_journal_lookup_new (self->list, journal_lookup_batch_cb, journal_lookup_done_cb, self);
 }
 
 void
@@ -529,6 +939,10 @@ journal_button_delete_clicked_cb (GtkWidget *button,
                                   gpointer   user_data)
 {
   RogerJournal *self = ROGER_JOURNAL (user_data);
+  g_autoptr (GPtrArray) calls = g_ptr_array_new ();
+  GtkTreeSelection *selection;
+  GList *rows;
+  GList *row;
   GtkWidget *dialog;
   GtkWidget *delete;
   gint flags = GTK_DIALOG_MODAL | GTK_DIALOG_USE_HEADER_BAR;
@@ -547,9 +961,14 @@ journal_button_delete_clicked_cb (GtkWidget *button,
     return;
   }
 
-  GtkTreeSelection *selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (self->view));
+  /* Collect the selection first, deleting changes the rows */
+  selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (self->view));
+  rows = gtk_tree_selection_get_selected_rows (selection, NULL);
+  for (row = rows; row != NULL; row = row->next)
+    g_ptr_array_add (calls, roger_journal_model_get_call (self->model, gtk_tree_path_get_indices (row->data)[0]));
+  g_list_free_full (rows, (GDestroyNotify)gtk_tree_path_free);
 
-  gtk_tree_selection_selected_foreach (selection, delete_foreach, NULL);
+  journal_delete_calls (self, calls);
 }
 
 void
@@ -588,26 +1007,12 @@ on_search_entry_changed (GtkEditable *entry,
                          gpointer     user_data)
 {
   RogerJournal *self = ROGER_JOURNAL (user_data);
-  RmProfile *profile = rm_profile_get_active ();
-  const char *text = gtk_entry_get_text (GTK_ENTRY (entry));
-
-  if (self->search_filter != NULL) {
-    rm_filter_remove (profile, self->search_filter);
-    self->search_filter = NULL;
-  }
 
-  if (strlen (text) > 0) {
-    self->search_filter = rm_filter_new (profile, "internal_search");
+  /* Restart the delay on every keystroke and drop the query in flight */
+  g_clear_handle_id (&self->search_id, g_source_remove);
+  g_cancellable_cancel (self->search_cancellable);
 
-    if (g_ascii_isdigit (text[0])) {
-      rm_filter_rule_add (self->search_filter, RM_FILTER_REMOTE_NUMBER, RM_FILTER_CONTAINS, (char *)text);
-    } else {
-      rm_filter_rule_add (self->search_filter, RM_FILTER_REMOTE_NAME, RM_FILTER_CONTAINS, (char *)text);
-    }
-  }
-
-  journal_clear (self);
-  journal_redraw (self);
+  self->search_id = g_timeout_add (SEARCH_DELAY_MS, journal_search_timeout_cb, self);
 }
 
 void
@@ -620,6 +1025,7 @@ journal_filter_box_changed (GtkComboBox *box,
   const char *text = gtk_combo_box_text_get_active_text (GTK_COMBO_BOX_TEXT (box));
 
   self->filter = NULL;
+  g_clear_pointer (&self->filter_program, roger_journal_filter_free);
   journal_clear (self);
 
   if (text == NULL || profile == NULL) {
@@ -635,6 +1041,8 @@ journal_filter_box_changed (GtkComboBox *box,
     }
   }
 
+  self->filter_program = roger_journal_filter_compile (self->filter);
+
   journal_redraw (self);
 }
 
@@ -768,21 +1176,6 @@ on_delete_event (GtkWidget *widget,
   return FALSE;
 }
 
-static gint
-journal_sort_by_date (GtkTreeModel *model,
-                      GtkTreeIter  *a,
-                      GtkTreeIter  *b,
-                      gpointer      data)
-{
-  RmCallEntry *call_a;
-  RmCallEntry *call_b;
-
-  gtk_tree_model_get (model, a, JOURNAL_COL_CALL_PTR, &call_a, -1);
-  gtk_tree_model_get (model, b, JOURNAL_COL_CALL_PTR, &call_b, -1);
-
-  return rm_journal_sort_by_date (call_a, call_b);
-}
-
 static gint
 journal_sort_by_type (GtkTreeModel *model,
                       GtkTreeIter  *a,
@@ -956,6 +1349,54 @@ window_cmd_clear (GSimpleAction *action,
   clear_journal (self);
 }
 
+static void
+journal_export_progress_cb (guint    done,
+                            guint    total,
+                            gpointer user_data)
+{
+  RogerJournal *self = ROGER_JOURNAL (user_data);
+  g_autofree char *subtitle = NULL;
+
+  if (g_cancellable_is_cancelled (self->export_cancellable))
+    return;
+
+  subtitle = g_strdup_printf (_("Exporting journal… %u%%"), total ? done * 100 / total : 100);
+  hdy_header_bar_set_subtitle (HDY_HEADER_BAR (self->headerbar), subtitle);
+}
+
+static void
+journal_export_cb (GObject      *source,
+                   GAsyncResult *res,
+                   gpointer      user_data)
+{
+  g_autoptr (RogerJournal) self = ROGER_JOURNAL (user_data);
+  g_autoptr (GError) error = NULL;
+
+  if (!roger_journal_export_finish (res, &error) && !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    g_warning ("%s(): Could not export journal: %s", __FUNCTION__, error->message);
+
+  /* A cancelled export was replaced by a new journal, which set its own title */
+  if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    hdy_header_bar_set_subtitle (HDY_HEADER_BAR (self->headerbar), self->export_subtitle);
+
+  g_clear_object (&self->export_cancellable);
+  g_clear_pointer (&self->export_subtitle, g_free);
+}
+
+static void
+journal_print_pdf_cb (GObject      *source,
+                      GAsyncResult *res,
+                      gpointer      user_data)
+{
+  g_autoptr (RogerJournal) self = ROGER_JOURNAL (user_data);
+  g_autoptr (GError) error = NULL;
+
+  if (!roger_print_journal_to_pdf_finish (res, &error) && !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    g_warning ("%s(): Could not export journal: %s", __FUNCTION__, error->message);
+
+  g_clear_object (&self->print_cancellable);
+}
+
 static void
 window_cmd_export (GSimpleAction *action,
                    GVariant      *parameter,
@@ -964,20 +1405,75 @@ window_cmd_export (GSimpleAction *action,
   RogerJournal *self = ROGER_JOURNAL (user_data);
   g_autoptr (GtkFileChooserNative) native = NULL;
   GtkFileChooser *chooser;
+  const char *content_ids[] = { "journal", "journal-table", "journal-jsonl", "journal-pdf", "statistics", NULL };
+  const char *content_labels[] = { _("Journal (CSV)"), _("Filtered Journal (CSV)"), _("Filtered Journal (JSON Lines)"), _("Journal (PDF)"), _("Statistics (CSV)"), NULL };
   gint res;
 
+  /* A running export keeps going, a new one needs the journal to itself */
+  if (self->export_cancellable || self->print_cancellable)
+    return;
+
   native = gtk_file_chooser_native_new (_("Export journal"), GTK_WINDOW (self), GTK_FILE_CHOOSER_ACTION_SAVE, _("Save"), _("Cancel"));
   chooser = GTK_FILE_CHOOSER (native);
   gtk_file_chooser_set_current_name (chooser, "journal.csv");
+  gtk_file_chooser_add_choice (chooser, "content", _("Export"), content_ids, content_labels);
+  gtk_file_chooser_set_choice (chooser, "content", "journal");
 
   res = gtk_native_dialog_run (GTK_NATIVE_DIALOG (native));
   if (res == GTK_RESPONSE_ACCEPT) {
     g_autofree char *file = gtk_file_chooser_get_filename (chooser);
-
-    rm_journal_save_as (self->list, file);
+    const char *content = gtk_file_chooser_get_choice (chooser, "content");
+
+    if (!g_strcmp0 (content, "journal")) {
+      /* The librm format, which can be imported again */
+      rm_journal_save_as (self->list, file);
+    } else if (!g_strcmp0 (content, "statistics")) {
+      g_autoptr (GError) error = NULL;
+
+      if (!roger_journal_stats_save_as (self->stats, file, &error))
+        g_warning ("%s(): Could not export statistics: %s", __FUNCTION__, error->message);
+    } else if (!g_strcmp0 (content, "journal-pdf")) {
+      /* The rows are copied up front, so a reloaded journal does not stop it */
+      self->print_cancellable = g_cancellable_new ();
+      roger_print_journal_to_pdf_async (self->list,
+                                        file,
+                                        self->print_cancellable,
+                                        journal_print_pdf_cb,
+                                        g_object_ref (self));
+    } else {
+      g_autoptr (GFile) export_file = g_file_new_for_path (file);
+      RogerJournalExportFormat format = ROGER_JOURNAL_EXPORT_FORMAT_CSV;
+
+      if (!g_strcmp0 (content, "journal-jsonl"))
+        format = ROGER_JOURNAL_EXPORT_FORMAT_JSONL;
+
+      self->export_cancellable = g_cancellable_new ();
+      self->export_subtitle = g_strdup (hdy_header_bar_get_subtitle (HDY_HEADER_BAR (self->headerbar)));
+
+      roger_journal_export_async (self->list,
+                                  export_file,
+                                  format,
+                                  journal_filter_func,
+                                  journal_export_progress_cb,
+                                  self,
+                                  self->export_cancellable,
+                                  journal_export_cb,
+                                  g_object_ref (self));
+    }
   }
 }
 
+static void
+window_cmd_statistics (GSimpleAction *action,
+                       GVariant      *parameter,
+                       gpointer       user_data)
+{
+  RogerJournal *self = ROGER_JOURNAL (user_data);
+  GtkWidget *window = roger_journal_stats_window_new (GTK_WINDOW (self), self->stats);
+
+  gtk_window_present (GTK_WINDOW (window));
+}
+
 static void
 on_contacts_changed (RmObject *object,
                      gpointer  user_data)
@@ -1037,6 +1533,7 @@ static const GActionEntry window_entries [] = {
   { "print", window_cmd_print },
   { "clear", window_cmd_clear },
   { "export", window_cmd_export },
+  { "statistics", window_cmd_statistics },
   /*
    *  { "contacts-edit-phone-home", contacts_add_detail_activated },
    *  { "contacts-edit-phone-work", contacts_add_detail_activated },
@@ -1101,9 +1598,26 @@ roger_journal_dispose (GObject *self)
   g_clear_handle_id (&journal->update_id, g_source_remove);
 
   g_cancellable_cancel (journal->cancellable);
+  g_clear_pointer (&journal->lookup, roger_journal_lookup_free);
+  g_clear_pointer (&journal->archive, roger_journal_archive_free);
+  g_clear_pointer (&journal->row_pool, roger_journal_row_pool_free);
+  g_clear_pointer (&journal->stats, roger_journal_stats_free);
+
+  if (journal->model)
+    roger_journal_model_set_journal (journal->model, NULL);
+  g_clear_object (&journal->model);
+
+  g_clear_pointer (&journal->filter_program, roger_journal_filter_free);
+  g_clear_handle_id (&journal->search_id, g_source_remove);
+  g_cancellable_cancel (journal->search_cancellable);
+  g_clear_object (&journal->search_cancellable);
+  g_cancellable_cancel (journal->export_cancellable);
+  g_cancellable_cancel (journal->print_cancellable);
+  g_clear_pointer (&journal->search_result, roger_journal_index_result_unref);
+  g_clear_pointer (&journal->index, roger_journal_index_unref);
 
   if (journal->list) {
-    g_list_free_full (g_steal_pointer (&journal->list), rm_call_entry_free);
+    g_list_free_full (g_steal_pointer (&journal->list), roger_journal_strings_call_free);
   }
 
   G_OBJECT_CLASS (roger_journal_parent_class)->dispose (self);
@@ -1168,10 +1682,11 @@ roger_journal_class_init (RogerJournalClass *klass)
   gtk_widget_class_bind_template_child (widget_class, RogerJournal, content_stack);
 
   gtk_widget_class_bind_template_child (widget_class, RogerJournal, journal_listbox);
+  gtk_widget_class_bind_template_child (widget_class, RogerJournal, journal_top_spacer);
+  gtk_widget_class_bind_template_child (widget_class, RogerJournal, journal_bottom_spacer);
   gtk_widget_class_bind_template_child (widget_class, RogerJournal, menu_button);
   gtk_widget_class_bind_template_child (widget_class, RogerJournal, filter_combobox);
   gtk_widget_class_bind_template_child (widget_class, RogerJournal, view);
-  gtk_widget_class_bind_template_child (widget_class, RogerJournal, list_store);
   gtk_widget_class_bind_template_child (widget_class, RogerJournal, spinner);
   gtk_widget_class_bind_template_child (widget_class, RogerJournal, search_bar);
   gtk_widget_class_bind_template_child (widget_class, RogerJournal, search_entry);
@@ -1217,6 +1732,7 @@ static void
 roger_journal_init (RogerJournal *self)
 {
   GtkTreeSortable *sortable;
+  GtkAdjustment *vadjustment;
   GSimpleActionGroup *simple_action_group;
   GtkWidget *header_menu = gtk_menu_new ();
   GtkWidget *column_item;
@@ -1238,6 +1754,11 @@ roger_journal_init (RogerJournal *self)
 
   init_call_icons ();
   self->list = NULL;
+  self->stats = roger_journal_stats_new ();
+
+  self->model = roger_journal_model_new ();
+  roger_journal_model_set_filter_func (self->model, journal_model_filter_func, self);
+  gtk_tree_view_set_model (GTK_TREE_VIEW (self->view), GTK_TREE_MODEL (self->model));
 
   g_type_ensure (G_TYPE_THEMED_ICON);
   GtkBuilder *builder = gtk_builder_new_from_resource ("/org/tabos/roger/ui/journal-popover.ui");
@@ -1247,12 +1768,17 @@ roger_journal_init (RogerJournal *self)
 
   hdy_search_bar_connect_entry (HDY_SEARCH_BAR (self->search_bar), GTK_ENTRY (self->search_entry));
   gtk_list_box_set_header_func (GTK_LIST_BOX (self->journal_listbox), box_header_func, NULL, NULL);
+  vadjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (gtk_widget_get_ancestor (self->journal_listbox, GTK_TYPE_VIEWPORT)));
+  self->row_pool = roger_journal_row_pool_new (GTK_LIST_BOX (self->journal_listbox),
+                                               self->journal_top_spacer,
+                                               self->journal_bottom_spacer,
+                                               vadjustment);
 
   journal_update_filter_box (self);
 
   journal_filter_box_changed (GTK_COMBO_BOX (self->filter_combobox), self);
 
-  sortable = GTK_TREE_SORTABLE (self->list_store);
+  sortable = GTK_TREE_SORTABLE (self->model);
 
   add_col_to_header_menu (header_menu, self->col0);
   add_col_to_header_menu (header_menu, self->col1);
@@ -1276,7 +1802,6 @@ roger_journal_init (RogerJournal *self)
 
   g_settings_bind (ROGER_SETTINGS_MAIN, "col-1-width", self->col1, "fixed-width", G_SETTINGS_BIND_DEFAULT);
   g_settings_bind (ROGER_SETTINGS_MAIN, "col-1-visible", self->col1, "visible", G_SETTINGS_BIND_DEFAULT);
-  gtk_tree_sortable_set_sort_func (sortable, JOURNAL_COL_DATETIME, journal_sort_by_date, 0, NULL);
 
   g_settings_bind (ROGER_SETTINGS_MAIN, "col-2-width", self->col2, "fixed-width", G_SETTINGS_BIND_DEFAULT);
   g_settings_bind (ROGER_SETTINGS_MAIN, "col-2-visible", self->col2, "visible", G_SETTINGS_BIND_DEFAULT);
@@ -28,6 +28,7 @@ enum {
   JOURNAL_COL_LINE,
   JOURNAL_COL_DURATION,
   JOURNAL_COL_CALL_PTR,
+  JOURNAL_N_COLUMNS
 };
 
 #define ROGER_TYPE_JOURNAL (roger_journal_get_type ())
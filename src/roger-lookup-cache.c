@@ -0,0 +1,331 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "roger-lookup-cache.h"
+
+#include "roger-settings.h"
+
+#include <rm/rm.h>
+#include <string.h>
+
+/*
+ * Reverse lookup cache
+ *
+ * Lookup results are stored per normalized number in a line based file:
+ *
+ *   number TAB timestamp TAB name TAB city NEWLINE
+ *
+ * An empty name marks a number without lookup result. librm does not tell
+ * a number without entry from a failed lookup, e.g. while offline, so such
+ * entries expire after a few hours instead of the configured days. The file
+ * is mapped
+ * privately and terminated in place, so entries loaded from disk point
+ * directly into the mapping. Entries added at runtime live in a string chunk.
+ * The whole cache is rewritten once new results were added.
+ */
+
+#define LOOKUP_CACHE_FILE "lookup-cache"
+#define LOOKUP_CACHE_HEADER "roger-lookup-cache 1\n"
+#define LOOKUP_CACHE_NUMBER_MAX 64
+#define LOOKUP_CACHE_NEGATIVE_TTL (6 * 60 * 60)
+
+typedef struct {
+  const char *name;
+  const char *city;
+  gint64 timestamp;
+} RogerLookupCacheEntry;
+
+struct _RogerLookupCache {
+  char *path;
+  gint64 ttl;
+
+  GMappedFile *mapped;
+  RogerLookupCacheEntry *mapped_entries;
+
+  GStringChunk *strings;
+  GPtrArray *added;
+
+  GHashTable *entries;
+  gboolean dirty;
+};
+
+static RogerLookupCache *default_cache = NULL;
+
+static gboolean
+roger_lookup_cache_normalize (const char *number,
+                              char       *buf)
+{
+  gsize len = 0;
+
+  if (!number)
+    return FALSE;
+
+  if (number[0] == '0' && number[1] == '0') {
+    buf[len++] = '+';
+    number += 2;
+  } else if (number[0] == '+') {
+    buf[len++] = '+';
+    number++;
+  }
+
+  for (; *number != '\0'; number++) {
+    if (!g_ascii_isdigit (*number))
+      continue;
+
+    if (len == LOOKUP_CACHE_NUMBER_MAX - 1)
+      return FALSE;
+
+    buf[len++] = *number;
+  }
+
+  buf[len] = '\0';
+
+  return len > 0;
+}
+
+static inline gboolean
+roger_lookup_cache_is_expired (RogerLookupCache      *self,
+                               RogerLookupCacheEntry *entry,
+                               gint64                 now)
+{
+  gint64 ttl = *entry->name ? self->ttl : MIN (self->ttl, LOOKUP_CACHE_NEGATIVE_TTL);
+
+  return entry->timestamp + ttl < now;
+}
+
+static void
+roger_lookup_cache_load (RogerLookupCache *self)
+{
+  g_autoptr (GError) error = NULL;
+  gint64 now = g_get_real_time () / G_USEC_PER_SEC;
+  gsize header_len = strlen (LOOKUP_CACHE_HEADER);
+  char *data;
+  char *end;
+  char *line;
+  gsize len;
+  guint lines = 0;
+  guint count = 0;
+
+  /* Writable maps are private, terminating fields never touches the file */
+  self->mapped = g_mapped_file_new (self->path, TRUE, &error);
+  if (!self->mapped) {
+    if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+      g_warning ("%s(): Could not map lookup cache: %s", __FUNCTION__, error->message);
+    return;
+  }
+
+  data = g_mapped_file_get_contents (self->mapped);
+  len = g_mapped_file_get_length (self->mapped);
+  if (!data || len < header_len || strncmp (data, LOOKUP_CACHE_HEADER, header_len) != 0) {
+    g_debug ("%s(): Ignoring invalid lookup cache", __FUNCTION__);
+    g_clear_pointer (&self->mapped, g_mapped_file_unref);
+    return;
+  }
+
+  end = data + len;
+  for (line = data; (line = memchr (line, '\n', end - line)) != NULL; line++)
+    lines++;
+
+  self->mapped_entries = g_new0 (RogerLookupCacheEntry, lines);
+
+  for (line = data + header_len; line < end;) {
+    char *eol = memchr (line, '\n', end - line);
+    char *fields[4];
+    guint n_fields = 0;
+    char *pos;
+
+    if (!eol)
+      break;
+
+    *eol = '\0';
+
+    fields[n_fields++] = line;
+    for (pos = line; *pos != '\0'; pos++) {
+      if (*pos == '\t' && n_fields < G_N_ELEMENTS (fields)) {
+        *pos = '\0';
+        fields[n_fields++] = pos + 1;
+      }
+    }
+
+    if (n_fields == G_N_ELEMENTS (fields)) {
+      RogerLookupCacheEntry *entry = &self->mapped_entries[count++];
+
+      entry->timestamp = g_ascii_strtoll (fields[1], NULL, 10);
+      entry->name = fields[2];
+      entry->city = fields[3];
+
+      if (!roger_lookup_cache_is_expired (self, entry, now))
+        g_hash_table_replace (self->entries, fields[0], entry);
+    }
+
+    line = eol + 1;
+  }
+
+  g_debug ("%s(): Loaded %u cached lookups", __FUNCTION__, g_hash_table_size (self->entries));
+}
+
+static void
+roger_lookup_cache_ttl_changed (GSettings  *settings,
+                                const char *key,
+                                gpointer    user_data)
+{
+  RogerLookupCache *self = user_data;
+
+  self->ttl = (gint64)g_settings_get_uint (settings, key) * 24 * 60 * 60;
+}
+
+/**
+ * roger_lookup_cache_get_default:
+ *
+ * Returns the lookup cache, loading it on first use.
+ *
+ * Returns: (transfer none): the default #RogerLookupCache
+ */
+RogerLookupCache *
+roger_lookup_cache_get_default (void)
+{
+  RogerLookupCache *self;
+
+  if (default_cache)
+    return default_cache;
+
+  self = g_new0 (RogerLookupCache, 1);
+  self->path = g_build_filename (rm_get_user_cache_dir (), LOOKUP_CACHE_FILE, NULL);
+  self->strings = g_string_chunk_new (4096);
+  self->added = g_ptr_array_new_with_free_func (g_free);
+  self->entries = g_hash_table_new (g_str_hash, g_str_equal);
+
+  roger_lookup_cache_ttl_changed (ROGER_SETTINGS_MAIN, ROGER_PREFS_LOOKUP_CACHE_TTL, self);
+  g_signal_connect (ROGER_SETTINGS_MAIN, "changed::" ROGER_PREFS_LOOKUP_CACHE_TTL, G_CALLBACK (roger_lookup_cache_ttl_changed), self);
+
+  roger_lookup_cache_load (self);
+
+  default_cache = self;
+
+  return self;
+}
+
+/**
+ * roger_lookup_cache_lookup:
+ * @self: a #RogerLookupCache
+ * @number: phone number
+ * @name: (out): cached name, empty if the number had no lookup result
+ * @city: (out): cached city
+ *
+ * Returns: %TRUE if a valid cache entry exists for @number
+ */
+gboolean
+roger_lookup_cache_lookup (RogerLookupCache  *self,
+                           const char        *number,
+                           const char       **name,
+                           const char       **city)
+{
+  char key[LOOKUP_CACHE_NUMBER_MAX];
+  RogerLookupCacheEntry *entry;
+
+  if (self->ttl == 0 || !roger_lookup_cache_normalize (number, key))
+    return FALSE;
+
+  entry = g_hash_table_lookup (self->entries, key);
+  if (!entry || roger_lookup_cache_is_expired (self, entry, g_get_real_time () / G_USEC_PER_SEC))
+    return FALSE;
+
+  *name = entry->name;
+  *city = entry->city;
+
+  return TRUE;
+}
+
+/**
+ * roger_lookup_cache_insert:
+ * @self: a #RogerLookupCache
+ * @number: phone number
+ * @name: (nullable): looked up name, %NULL if the lookup had no result
+ * @city: (nullable): looked up city
+ *
+ * Stores a lookup result. Call roger_lookup_cache_save() to write it to disk.
+ */
+void
+roger_lookup_cache_insert (RogerLookupCache *self,
+                           const char       *number,
+                           const char       *name,
+                           const char       *city)
+{
+  char key[LOOKUP_CACHE_NUMBER_MAX];
+  RogerLookupCacheEntry *entry;
+
+  if (self->ttl == 0 || !roger_lookup_cache_normalize (number, key))
+    return;
+
+  entry = g_new0 (RogerLookupCacheEntry, 1);
+  entry->name = g_string_chunk_insert_const (self->strings, name ? name : "");
+  entry->city = g_string_chunk_insert_const (self->strings, city ? city : "");
+  entry->timestamp = g_get_real_time () / G_USEC_PER_SEC;
+  g_ptr_array_add (self->added, entry);
+
+  g_hash_table_replace (self->entries, g_string_chunk_insert_const (self->strings, key), entry);
+  self->dirty = TRUE;
+}
+
+static void
+roger_lookup_cache_append_field (GString    *out,
+                                 const char *str)
+{
+  for (; *str != '\0'; str++)
+    g_string_append_c (out, (*str == '\t' || *str == '\n' || *str == '\r') ? ' ' : *str);
+}
+
+/**
+ * roger_lookup_cache_save:
+ * @self: a #RogerLookupCache
+ *
+ * Writes all valid entries to disk if new results were added.
+ */
+void
+roger_lookup_cache_save (RogerLookupCache *self)
+{
+  g_autoptr (GError) error = NULL;
+  g_autoptr (GString) out = NULL;
+  gint64 now = g_get_real_time () / G_USEC_PER_SEC;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+
+  if (!self->dirty)
+    return;
+
+  out = g_string_new (LOOKUP_CACHE_HEADER);
+
+  g_hash_table_iter_init (&iter, self->entries);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    RogerLookupCacheEntry *entry = value;
+
+    if (roger_lookup_cache_is_expired (self, entry, now))
+      continue;
+
+    g_string_append_printf (out, "%s\t%" G_GINT64_FORMAT "\t", (char *)key, entry->timestamp);
+    roger_lookup_cache_append_field (out, entry->name);
+    g_string_append_c (out, '\t');
+    roger_lookup_cache_append_field (out, entry->city);
+    g_string_append_c (out, '\n');
+  }
+
+  /* The file is replaced atomically, the current mapping stays valid */
+  if (!g_file_set_contents (self->path, out->str, out->len, &error)) {
+    g_warning ("%s(): Could not save lookup cache: %s", __FUNCTION__, error->message);
+    return;
+  }
+
+  self->dirty = FALSE;
+}
@@ -0,0 +1,33 @@
+/*
+ * Roger Router Copyright (c) 2012-2021 Jan-Michael Brummer
+ *
+ * This file is part of Roger Router.
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; version 2 only.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _RogerLookupCache RogerLookupCache;
+
+RogerLookupCache *roger_lookup_cache_get_default (void);
+
+gboolean roger_lookup_cache_lookup (RogerLookupCache  *self,
+                                    const char        *number,
+                                    const char       **name,
+                                    const char       **city);
+void roger_lookup_cache_insert (RogerLookupCache *self,
+                                const char       *number,
+                                const char       *name,
+                                const char       *city);
+void roger_lookup_cache_save (RogerLookupCache *self);
+
+G_END_DECLS
@@ -15,6 +15,7 @@
 #include "roger-phone.h"
 
 #include "contacts.h"
+#include "roger-connection-monitor.h"
 #include "roger-contactsearch.h"
 #include "roger-journal.h"
 #include "roger-shell.h"
@@ -39,7 +40,8 @@ struct _RogerPhone {
   GtkWidget *menu_button;
   GtkWidget *phone_box;
 
-  gint status_timer_id;
+  char *duration;
+  guint tick_id;
 
   RmConnection *connection;
 } PhoneState;
@@ -47,15 +49,35 @@ struct _RogerPhone {
 G_DEFINE_TYPE (RogerPhone, roger_phone, HDY_TYPE_WINDOW)
 
 static gboolean
-roger_phone_status_timer_cb (gpointer user_data)
+roger_phone_tick_cb (GtkWidget     *widget,
+                     GdkFrameClock *frame_clock,
+                     gpointer       user_data)
+{
+  RogerPhone *self = ROGER_PHONE (widget);
+
+  self->tick_id = 0;
+  hdy_header_bar_set_subtitle (HDY_HEADER_BAR (self->header_bar), self->duration ? self->duration : "");
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+roger_phone_duration_changed_cb (RogerConnectionMonitor *monitor,
+                                 RmConnection           *connection,
+                                 const char             *duration,
+                                 gpointer                user_data)
 {
   RogerPhone *self = ROGER_PHONE (user_data);
-  g_autofree char *duration = NULL;
 
-  duration = rm_connection_get_duration_time (self->connection);
-  hdy_header_bar_set_subtitle (HDY_HEADER_BAR (self->header_bar), duration);
+  if (self->connection != connection)
+    return;
+
+  g_free (self->duration);
+  self->duration = g_strdup (duration);
 
-  return G_SOURCE_CONTINUE;
+  /* Applied with the next frame */
+  if (!self->tick_id)
+    self->tick_id = gtk_widget_add_tick_callback (GTK_WIDGET (self), roger_phone_tick_cb, NULL, NULL);
 }
 
 static void
@@ -85,16 +107,18 @@ roger_phone_update_buttons (RogerPhone *self)
 }
 
 static void
-roger_phone_start_status_timer (RogerPhone *self)
+roger_phone_watch (RogerPhone *self)
 {
-  g_clear_handle_id (&self->status_timer_id, g_source_remove);
-  self->status_timer_id = g_timeout_add (250, roger_phone_status_timer_cb, self);
+  roger_connection_monitor_watch_call (roger_connection_monitor_get_default (), self->connection);
 }
 
 static void
-roger_phone_remove_status_timer (RogerPhone *self)
+roger_phone_unwatch (RogerPhone *self)
 {
-  g_clear_handle_id (&self->status_timer_id, g_source_remove);
+  if (self->connection)
+    roger_connection_monitor_unwatch (roger_connection_monitor_get_default (), self->connection);
+
+  g_clear_pointer (&self->duration, g_free);
 }
 
 static void
@@ -112,7 +136,7 @@ roger_phone_connection_changed_cb (RmObject     *obj,
   if (!(type & RM_CONNECTION_TYPE_DISCONNECT))
     return;
 
-  roger_phone_remove_status_timer (self);
+  roger_phone_unwatch (self);
   self->connection = NULL;
   roger_phone_update_buttons (self);
 }
@@ -157,7 +181,7 @@ roger_phone_dial_button_clicked_cb (GtkWidget *button,
   self->connection = rm_phone_dial (phone, number, rm_router_get_suppress_state (profile));
   if (self->connection) {
     roger_phone_update_buttons (self);
-    roger_phone_start_status_timer (self);
+    roger_phone_watch (self);
   }
 }
 
@@ -272,7 +296,12 @@ roger_phone_dispose (GObject *object)
 {
   RogerPhone *self = ROGER_PHONE (object);
 
-  roger_phone_remove_status_timer (self);
+  if (self->tick_id) {
+    gtk_widget_remove_tick_callback (GTK_WIDGET (self), self->tick_id);
+    self->tick_id = 0;
+  }
+
+  roger_phone_unwatch (self);
 
   G_OBJECT_CLASS (roger_phone_parent_class)->dispose (object);
 }
@@ -360,6 +389,7 @@ roger_phone_init (RogerPhone *self)
   hdy_header_bar_set_subtitle (HDY_HEADER_BAR (self->header_bar), "");
 
   g_signal_connect_object (rm_object, "connection-changed", G_CALLBACK (roger_phone_connection_changed_cb), self, 0);
+  g_signal_connect_object (roger_connection_monitor_get_default (), "duration-changed", G_CALLBACK (roger_phone_duration_changed_cb), self, 0);
 
   roger_phone_update_buttons (self);
 }
@@ -391,6 +421,6 @@ roger_phone_pickup_connection (RogerPhone   *self,
     self->connection = connection;
 
     roger_phone_update_buttons (self);
-    roger_phone_start_status_timer (self);
+    roger_phone_watch (self);
   }
 }
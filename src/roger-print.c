@@ -34,6 +34,17 @@
 
 #define MM_TO_POINTS(mm) ((mm) / 25.4 * 72.0)
 
+/* Copy of the printed fields of a call, pages may be drawn after the journal changed */
+typedef struct {
+  RmCallEntryTypes type;
+  const char *date_time;
+  const char *name;
+  const char *number;
+  const char *local_name;
+  const char *local_number;
+  const char *duration;
+} RogerPrintRow;
+
 /** Structure holds information about the page and start positions of columns */
 typedef struct {
   /*< private >*/
@@ -42,7 +53,11 @@ typedef struct {
   gdouble char_width;
   PangoLayout *layout;
 
-  GList *journal;
+  GArray *rows;
+  GStringChunk *strings;
+  GHashTable *icons;
+  GHashTable *text_widths;
+  char *date;
   gint lines_per_page;
   gint num_lines;
   gint num_pages;
@@ -56,16 +71,20 @@ typedef struct {
   gint duration_pos;
 } RogerPrintData;
 
+/* A4 with a margin of 10mm, used when printing straight to a PDF file */
+#define PDF_PAGE_WIDTH MM_TO_POINTS (210)
+#define PDF_PAGE_HEIGHT MM_TO_POINTS (297)
+#define PDF_PAGE_MARGIN MM_TO_POINTS (10)
+
+static char *roger_print_journal_get_date_time (const char *format);
+
 static gint
-roger_print_journal_get_font_width (GtkPrintContext      *context,
+roger_print_journal_get_font_width (PangoContext         *pc,
                                     PangoFontDescription *desc)
 {
-  PangoContext *pc;
   PangoFontMetrics *metrics;
   gint width;
 
-  pc = gtk_print_context_create_pango_context (context);
-
   metrics = pango_context_get_metrics (pc, desc, pango_context_get_language (pc));
   width = pango_font_metrics_get_approximate_digit_width (metrics) / PANGO_SCALE;
   if (!width) {
@@ -75,25 +94,21 @@ roger_print_journal_get_font_width (GtkPrintContext      *context,
   }
 
   pango_font_metrics_unref (metrics);
-  g_object_unref (pc);
 
   return width;
 }
 
 static int
-roger_print_journal_get_page_count (GtkPrintContext *context,
-                                    RogerPrintData  *print_data)
+roger_print_journal_get_page_count (RogerPrintData *print_data,
+                                    gdouble         width,
+                                    gdouble         height)
 {
-  gdouble width, height;
   gint layout_h;
   gint layout_v;
 
   if (print_data == NULL)
     return -1;
 
-  width = gtk_print_context_get_width (context);
-  height = gtk_print_context_get_height (context);
-
   pango_layout_set_width (print_data->layout, width * PANGO_SCALE);
 
   pango_layout_set_text (print_data->layout, "Z", -1);
@@ -118,50 +133,144 @@ roger_print_journal_get_page_count (GtkPrintContext *context,
 }
 
 static void
-roger_print_journal_begin_print_cb (GtkPrintOperation *operation,
-                                    GtkPrintContext   *context,
-                                    gpointer           user_data)
+roger_print_journal_setup_layout (PangoLayout *layout)
 {
-  RogerPrintData *print_data = (RogerPrintData *)user_data;
   PangoFontDescription *desc = pango_font_description_from_string (FONT);
 
-  print_data->num_lines = g_list_length (print_data->journal);
+  pango_layout_set_wrap (layout, PANGO_WRAP_WORD_CHAR);
+  pango_layout_set_spacing (layout, 0);
+  pango_layout_set_attributes (layout, NULL);
+  pango_layout_set_font_description (layout, desc);
 
-  print_data->layout = gtk_print_context_create_pango_layout (context);
-  pango_layout_set_wrap (print_data->layout, PANGO_WRAP_WORD_CHAR);
-  pango_layout_set_spacing (print_data->layout, 0);
-  pango_layout_set_attributes (print_data->layout, NULL);
-  pango_layout_set_font_description (print_data->layout, desc);
+  pango_font_description_free (desc);
+}
+
+/* Widths of cell texts are measured once per distinct text, all cells use FONT */
+static gint
+roger_print_journal_measure (RogerPrintData *print_data,
+                             const char     *text)
+{
+  gpointer width;
+  gint text_width;
+  gint text_height;
+
+  if (!text)
+    return 0;
+
+  width = g_hash_table_lookup (print_data->text_widths, text);
+  if (width)
+    return GPOINTER_TO_INT (width) - 1;
+
+  pango_layout_set_text (print_data->layout, text, -1);
+  pango_layout_get_pixel_size (print_data->layout, &text_width, &text_height);
+  g_hash_table_insert (print_data->text_widths, (gpointer)text, GINT_TO_POINTER (text_width + 1));
+
+  return text_width;
+}
+
+/*
+ * Prepares everything pages are drawn from: page count, column positions,
+ * text widths and the print date. Afterwards pages only read the print data
+ * and can be drawn from several threads.
+ */
+static void
+roger_print_journal_setup (RogerPrintData *print_data,
+                           PangoContext   *pc,
+                           gdouble         width,
+                           gdouble         height)
+{
+  PangoFontDescription *desc = pango_font_description_from_string (FONT);
+  g_autofree char *date = NULL;
+  gint date_time_width;
+  gint number_width;
+  gint local_name_width;
+  gint local_number_width;
+  gint duration_width;
+  gint spare;
+  guint idx;
+
+  roger_print_journal_setup_layout (print_data->layout);
+  pango_layout_set_width (print_data->layout, -1);
+
+  /* Columns are at least as wide as their (translated) header label */
+  date_time_width = roger_print_journal_measure (print_data, _("Date/Time"));
+  number_width = roger_print_journal_measure (print_data, _("Number"));
+  local_name_width = roger_print_journal_measure (print_data, _("Local Name"));
+  local_number_width = roger_print_journal_measure (print_data, _("Local Number"));
+  duration_width = roger_print_journal_measure (print_data, _("Duration"));
+
+  /* One pass over the rows to measure the cells */
+  for (idx = 0; idx < print_data->rows->len; idx++) {
+    RogerPrintRow *row = &g_array_index (print_data->rows, RogerPrintRow, idx);
+
+    date_time_width = MAX (date_time_width, roger_print_journal_measure (print_data, row->date_time));
+    roger_print_journal_measure (print_data, row->name);
+    number_width = MAX (number_width, roger_print_journal_measure (print_data, row->number));
+    local_name_width = MAX (local_name_width, roger_print_journal_measure (print_data, row->local_name));
+    local_number_width = MAX (local_number_width, roger_print_journal_measure (print_data, row->local_number));
+    duration_width = MAX (duration_width, roger_print_journal_measure (print_data, row->duration));
+  }
+  print_data->num_lines = print_data->rows->len;
+
+  date = roger_print_journal_get_date_time ("%d.%m.%Y %H:%M:%S");
+  print_data->date = g_strdup_printf ("<small>%s</small>", date);
 
-  print_data->num_pages = roger_print_journal_get_page_count (context, print_data);
-  print_data->font_width = roger_print_journal_get_font_width (context, desc) + 1;
+  print_data->num_pages = roger_print_journal_get_page_count (print_data, width, height);
+  print_data->font_width = roger_print_journal_get_font_width (pc, desc) + 1;
   if (print_data->font_width == 0)
     print_data->font_width = print_data->char_width;
 
+  /* Columns shrink to their widest text, the name column gets the space saved */
+  date_time_width = MIN (date_time_width + print_data->font_width, print_data->font_width * 12);
+  number_width = MIN (number_width + print_data->font_width, print_data->font_width * 14);
+  local_name_width = MIN (local_name_width + print_data->font_width, print_data->font_width * 11);
+  local_number_width = MIN (local_number_width + print_data->font_width, print_data->font_width * 14);
+  spare = print_data->font_width * (12 + 14 + 11 + 14) - date_time_width - number_width - local_name_width - local_number_width;
+
   print_data->logo_pos = 4;
   print_data->date_time_pos = print_data->logo_pos + print_data->font_width * 4;
-  print_data->name_pos = print_data->date_time_pos + print_data->font_width * 12;
-  print_data->number_pos = print_data->name_pos + print_data->font_width * 19;
-  print_data->local_name_pos = print_data->number_pos + print_data->font_width * 14;
-  print_data->local_number_pos = print_data->local_name_pos + print_data->font_width * 11;
-  print_data->duration_pos = print_data->local_number_pos + print_data->font_width * 14;
+  print_data->name_pos = print_data->date_time_pos + date_time_width;
+  print_data->number_pos = print_data->name_pos + print_data->font_width * 19 + spare;
+  print_data->local_name_pos = print_data->number_pos + number_width;
+  print_data->local_number_pos = print_data->local_name_pos + local_name_width;
+  print_data->duration_pos = print_data->local_number_pos + local_number_width;
+
+  pango_font_description_free (desc);
+}
+
+static void
+roger_print_journal_begin_print_cb (GtkPrintOperation *operation,
+                                    GtkPrintContext   *context,
+                                    gpointer           user_data)
+{
+  RogerPrintData *print_data = (RogerPrintData *)user_data;
+  PangoContext *pc = gtk_print_context_create_pango_context (context);
+
+  print_data->layout = gtk_print_context_create_pango_layout (context);
+  roger_print_journal_setup (print_data, pc, gtk_print_context_get_width (context), gtk_print_context_get_height (context));
 
   if (print_data->num_pages >= 0)
     gtk_print_operation_set_n_pages (operation, print_data->num_pages);
 
-  pango_font_description_free (desc);
+  g_object_unref (pc);
 }
 
 static void
-roger_print_journal_show_text (cairo_t     *cairo,
-                               PangoLayout *layout,
-                               char        *text,
-                               gint         width)
+roger_print_journal_show_text (RogerPrintData *print_data,
+                               cairo_t        *cairo,
+                               PangoLayout    *layout,
+                               const char     *text,
+                               gint            width)
 {
-  gint text_width, text_height;
+  gint text_width;
+
+  if (!text)
+    return;
+
+  /* Measured during setup, the table is only read here */
+  text_width = GPOINTER_TO_INT (g_hash_table_lookup (print_data->text_widths, text)) - 1;
 
   pango_layout_set_text (layout, text, -1);
-  pango_layout_get_pixel_size (layout, &text_width, &text_height);
 
   if (text_width > width) {
     pango_layout_set_width (layout, width * PANGO_SCALE);
@@ -204,61 +313,53 @@ roger_print_journal_get_date_time (const char *format)
 }
 
 static void
-roger_print_journal_draw_page_cb (GtkPrintOperation *operation,
-                                  GtkPrintContext   *context,
-                                  gint               page_nr,
-                                  gpointer           user_data)
+roger_print_journal_draw_page (RogerPrintData *print_data,
+                               cairo_t        *cairo,
+                               PangoLayout    *layout,
+                               gdouble         width,
+                               gint            page_nr)
 {
-  RogerPrintData *print_data = (RogerPrintData *)user_data;
   g_autofree char *title = NULL;
   g_autofree char *page = NULL;
-  g_autofree char *date = NULL;
-  g_autofree char *tmp = NULL;
-  cairo_t *cairo;
   gint line, i = 0;
   gint line_height = 0;
 
-  cairo = gtk_print_context_get_cairo_context (context);
-  gdouble width = gtk_print_context_get_width (context);
-
   cairo_set_source_rgb (cairo, 0, 0, 0);
   cairo_move_to (cairo, 0, 0);
-  pango_layout_set_width (print_data->layout, width * PANGO_SCALE);
-  pango_layout_set_alignment (print_data->layout, PANGO_ALIGN_LEFT);
-  pango_layout_set_ellipsize (print_data->layout, FALSE);
-  pango_layout_set_justify (print_data->layout, FALSE);
+  pango_layout_set_width (layout, width * PANGO_SCALE);
+  pango_layout_set_alignment (layout, PANGO_ALIGN_LEFT);
+  pango_layout_set_ellipsize (layout, FALSE);
+  pango_layout_set_justify (layout, FALSE);
 
-  pango_layout_set_width (print_data->layout, (width - 8) * PANGO_SCALE);
+  pango_layout_set_width (layout, (width - 8) * PANGO_SCALE);
 
   /* Title */
   title = g_strdup_printf ("<b>%s - %s</b>", PACKAGE_NAME, _("Journal"));
-  pango_layout_set_markup (print_data->layout, title, -1);
-  pango_layout_set_alignment (print_data->layout, PANGO_ALIGN_CENTER);
+  pango_layout_set_markup (layout, title, -1);
+  pango_layout_set_alignment (layout, PANGO_ALIGN_CENTER);
   cairo_move_to (cairo, 3, print_data->line_height * 0.5);
-  pango_cairo_show_layout (cairo, print_data->layout);
+  pango_cairo_show_layout (cairo, layout);
 
   /* Page */
   page = g_strdup_printf (_("<small>Page %d of %d</small>"), page_nr + 1, print_data->num_pages);
-  pango_layout_set_markup (print_data->layout, page, -1);
-  pango_layout_set_alignment (print_data->layout, PANGO_ALIGN_LEFT);
+  pango_layout_set_markup (layout, page, -1);
+  pango_layout_set_alignment (layout, PANGO_ALIGN_LEFT);
   cairo_move_to (cairo, 4, print_data->line_height * 1.5);
-  pango_cairo_show_layout (cairo, print_data->layout);
+  pango_cairo_show_layout (cairo, layout);
 
   /* Date */
-  tmp = roger_print_journal_get_date_time ("%d.%m.%Y %H:%M:%S");
-  date = g_strdup_printf ("<small>%s</small>", tmp);
-  pango_layout_set_markup (print_data->layout, date, -1);
-  pango_layout_set_alignment (print_data->layout, PANGO_ALIGN_RIGHT);
+  pango_layout_set_markup (layout, print_data->date, -1);
+  pango_layout_set_alignment (layout, PANGO_ALIGN_RIGHT);
   cairo_move_to (cairo, 2, print_data->line_height * 1.5);
-  pango_cairo_show_layout (cairo, print_data->layout);
+  pango_cairo_show_layout (cairo, layout);
 
   /* Reset */
   cairo_move_to (cairo, 0, 0);
-  pango_layout_set_width (print_data->layout, width * PANGO_SCALE);
-  pango_layout_set_ellipsize (print_data->layout, FALSE);
-  pango_layout_set_justify (print_data->layout, FALSE);
-  pango_layout_set_attributes (print_data->layout, NULL);
-  pango_layout_set_alignment (print_data->layout, PANGO_ALIGN_LEFT);
+  pango_layout_set_width (layout, width * PANGO_SCALE);
+  pango_layout_set_ellipsize (layout, FALSE);
+  pango_layout_set_justify (layout, FALSE);
+  pango_layout_set_attributes (layout, NULL);
+  pango_layout_set_alignment (layout, PANGO_ALIGN_LEFT);
 
   line = page_nr * print_data->lines_per_page;
 
@@ -272,37 +373,36 @@ roger_print_journal_draw_page_cb (GtkPrintOperation *operation,
   cairo_set_source_rgb (cairo, 0.0, 0.0, 0.0);
 
   cairo_move_to (cairo, print_data->logo_pos, print_data->line_height * 3 + 1);
-  pango_layout_set_text (print_data->layout, _("Type"), -1);
-  pango_cairo_show_layout (cairo, print_data->layout);
+  pango_layout_set_text (layout, _("Type"), -1);
+  pango_cairo_show_layout (cairo, layout);
 
   cairo_move_to (cairo, print_data->date_time_pos, print_data->line_height * 3 + 1);
-  pango_layout_set_text (print_data->layout, _("Date/Time"), -1);
-  pango_cairo_show_layout (cairo, print_data->layout);
+  pango_layout_set_text (layout, _("Date/Time"), -1);
+  pango_cairo_show_layout (cairo, layout);
 
   cairo_move_to (cairo, print_data->name_pos, print_data->line_height * 3 + 1);
-  pango_layout_set_text (print_data->layout, _("Name"), -1);
-  pango_cairo_show_layout (cairo, print_data->layout);
+  pango_layout_set_text (layout, _("Name"), -1);
+  pango_cairo_show_layout (cairo, layout);
 
   cairo_move_to (cairo, print_data->number_pos, print_data->line_height * 3 + 1);
-  pango_layout_set_text (print_data->layout, _("Number"), -1);
-  pango_cairo_show_layout (cairo, print_data->layout);
+  pango_layout_set_text (layout, _("Number"), -1);
+  pango_cairo_show_layout (cairo, layout);
 
   cairo_move_to (cairo, print_data->local_name_pos, print_data->line_height * 3 + 1);
-  pango_layout_set_text (print_data->layout, _("Local Name"), -1);
-  pango_cairo_show_layout (cairo, print_data->layout);
+  pango_layout_set_text (layout, _("Local Name"), -1);
+  pango_cairo_show_layout (cairo, layout);
 
   cairo_move_to (cairo, print_data->local_number_pos, print_data->line_height * 3 + 1);
-  pango_layout_set_text (print_data->layout, _("Local Number"), -1);
-  pango_cairo_show_layout (cairo, print_data->layout);
+  pango_layout_set_text (layout, _("Local Number"), -1);
+  pango_cairo_show_layout (cairo, layout);
 
   cairo_move_to (cairo, print_data->duration_pos, print_data->line_height * 3 + 1);
-  pango_layout_set_text (print_data->layout, _("Duration"), -1);
-  pango_cairo_show_layout (cairo, print_data->layout);
+  pango_layout_set_text (layout, _("Duration"), -1);
+  pango_cairo_show_layout (cairo, layout);
 
-  /* print caller rows */
+  /* print caller rows, the icons are drawn by roger_print_journal_draw_icons () */
   for (i = 1; i <= print_data->lines_per_page && line < print_data->num_lines; i++) {
-    RmCallEntry *entry = g_list_nth_data (print_data->journal, line);
-    g_autoptr (GdkPixbuf) dst_pix = NULL;
+    RogerPrintRow *entry = &g_array_index (print_data->rows, RogerPrintRow, line);
 
     cairo_rectangle (cairo, 2, (3 + i) * print_data->line_height, width - 4, print_data->line_height);
     if (!(i & 1)) {
@@ -313,51 +413,127 @@ roger_print_journal_draw_page_cb (GtkPrintOperation *operation,
     }
     cairo_stroke (cairo);
 
-    dst_pix = gdk_pixbuf_scale_simple (roger_journal_get_call_icon (entry->type), 8, 8, GDK_INTERP_BILINEAR);
-
-    cairo_save (cairo);
-    gdk_cairo_set_source_pixbuf (cairo, dst_pix, print_data->logo_pos, (3 + i) * print_data->line_height + 2);
-    cairo_paint (cairo);
-    cairo_restore (cairo);
-
     cairo_move_to (cairo, print_data->date_time_pos, (3 + i) * print_data->line_height + 1);
-    pango_layout_set_text (print_data->layout, entry->date_time, -1);
-    pango_cairo_show_layout (cairo, print_data->layout);
+    pango_layout_set_text (layout, entry->date_time, -1);
+    pango_cairo_show_layout (cairo, layout);
 
     cairo_move_to (cairo, print_data->name_pos, (3 + i) * print_data->line_height + 1);
-    roger_print_journal_show_text (cairo, print_data->layout, entry->remote->name, print_data->number_pos - print_data->name_pos);
+    roger_print_journal_show_text (print_data, cairo, layout, entry->name, print_data->number_pos - print_data->name_pos);
 
     cairo_move_to (cairo, print_data->number_pos, (3 + i) * print_data->line_height + 1);
-    roger_print_journal_show_text (cairo, print_data->layout, entry->remote->number, print_data->local_name_pos - print_data->number_pos);
+    roger_print_journal_show_text (print_data, cairo, layout, entry->number, print_data->local_name_pos - print_data->number_pos);
 
     cairo_move_to (cairo, print_data->local_name_pos, (3 + i) * print_data->line_height + 1);
-    if (entry->local->name != NULL && strlen (entry->local->name) > 0)
-      roger_print_journal_show_text (cairo, print_data->layout, entry->local->name, print_data->local_number_pos - print_data->local_name_pos);
+    if (entry->local_name != NULL && strlen (entry->local_name) > 0)
+      roger_print_journal_show_text (print_data, cairo, layout, entry->local_name, print_data->local_number_pos - print_data->local_name_pos);
 
     cairo_move_to (cairo, print_data->local_number_pos, (3 + i) * print_data->line_height + 1);
-    if (entry->local->number != NULL && strlen (entry->local->number) > 0)
-      roger_print_journal_show_text (cairo, print_data->layout, entry->local->number, print_data->duration_pos - print_data->local_number_pos);
+    if (entry->local_number != NULL && strlen (entry->local_number) > 0)
+      roger_print_journal_show_text (print_data, cairo, layout, entry->local_number, print_data->duration_pos - print_data->local_number_pos);
 
     cairo_move_to (cairo, print_data->duration_pos, (3 + i) * print_data->line_height + 1);
     if (entry->duration != NULL && strlen (entry->duration) > 0)
-      roger_print_journal_show_text (cairo, print_data->layout, entry->duration, width - print_data->duration_pos);
+      roger_print_journal_show_text (print_data, cairo, layout, entry->duration, width - print_data->duration_pos);
 
     cairo_rel_move_to (cairo, 2, line_height);
     line++;
   }
 }
 
+/*
+ * Call icons are image surfaces shared by all pages. Painting a surface into a
+ * recording surface attaches a snapshot to it, which is not thread safe, so
+ * they are only ever drawn from one thread.
+ */
 static void
-roger_print_journal_end_print_cb (GtkPrintOperation *operation,
+roger_print_journal_draw_icons (RogerPrintData *print_data,
+                                cairo_t        *cairo,
+                                gint            page_nr)
+{
+  gint line = page_nr * print_data->lines_per_page;
+  gint i;
+
+  for (i = 1; i <= print_data->lines_per_page && line < print_data->num_lines; i++, line++) {
+    RogerPrintRow *entry = &g_array_index (print_data->rows, RogerPrintRow, line);
+
+    cairo_set_source_surface (cairo, g_hash_table_lookup (print_data->icons, GINT_TO_POINTER (entry->type)), print_data->logo_pos, (3 + i) * print_data->line_height + 2);
+    cairo_paint (cairo);
+  }
+}
+
+static void
+roger_print_journal_draw_page_cb (GtkPrintOperation *operation,
                                   GtkPrintContext   *context,
+                                  gint               page_nr,
                                   gpointer           user_data)
 {
   RogerPrintData *print_data = (RogerPrintData *)user_data;
 
+  roger_print_journal_draw_page (print_data,
+                                 gtk_print_context_get_cairo_context (context),
+                                 print_data->layout,
+                                 gtk_print_context_get_width (context),
+                                 page_nr);
+  roger_print_journal_draw_icons (print_data, gtk_print_context_get_cairo_context (context), page_nr);
+}
+
+/* Must be called on the main thread, where the call entries and icons are owned */
+static RogerPrintData *
+roger_print_data_new (GList *journal)
+{
+  RogerPrintData *print_data = g_new0 (RogerPrintData, 1);
+  GList *list;
+
+  print_data->rows = g_array_new (FALSE, FALSE, sizeof (RogerPrintRow));
+  print_data->strings = g_string_chunk_new (64 * 1024);
+  print_data->icons = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)cairo_surface_destroy);
+  print_data->text_widths = g_hash_table_new (g_str_hash, g_str_equal);
+
+  for (list = journal; list != NULL; list = list->next) {
+    RmCallEntry *call = list->data;
+    RogerPrintRow row;
+
+    /* Equal strings share one copy, so they are measured once */
+    row.type = call->type;
+    row.date_time = call->date_time ? g_string_chunk_insert_const (print_data->strings, call->date_time) : NULL;
+    row.name = call->remote->name ? g_string_chunk_insert_const (print_data->strings, call->remote->name) : NULL;
+    row.number = call->remote->number ? g_string_chunk_insert_const (print_data->strings, call->remote->number) : NULL;
+    row.local_name = call->local->name ? g_string_chunk_insert_const (print_data->strings, call->local->name) : NULL;
+    row.local_number = call->local->number ? g_string_chunk_insert_const (print_data->strings, call->local->number) : NULL;
+    row.duration = call->duration ? g_string_chunk_insert_const (print_data->strings, call->duration) : NULL;
+    g_array_append_val (print_data->rows, row);
+
+    /* Call icons are scaled to the row size once per type */
+    if (!g_hash_table_contains (print_data->icons, GINT_TO_POINTER (call->type))) {
+      g_autoptr (GdkPixbuf) pixbuf = gdk_pixbuf_scale_simple (roger_journal_get_call_icon (call->type), 8, 8, GDK_INTERP_BILINEAR);
+
+      g_hash_table_insert (print_data->icons, GINT_TO_POINTER (call->type), gdk_cairo_surface_create_from_pixbuf (pixbuf, 1, NULL));
+    }
+  }
+
+  return print_data;
+}
+
+static void
+roger_print_data_free (RogerPrintData *print_data)
+{
   g_clear_pointer (&print_data->layout, g_object_unref);
+  g_array_unref (print_data->rows);
+  g_string_chunk_free (print_data->strings);
+  g_hash_table_unref (print_data->icons);
+  g_hash_table_unref (print_data->text_widths);
+  g_free (print_data->date);
   g_free (print_data);
 }
 
+static void
+roger_print_journal_end_print_cb (GtkPrintOperation *operation,
+                                  GtkPrintContext   *context,
+                                  gpointer           user_data)
+{
+  roger_print_data_free (user_data);
+}
+
 void
 roger_print_journal (GList *journal)
 {
@@ -367,10 +543,8 @@ roger_print_journal (GList *journal)
   RogerPrintData *print_data;
 
   operation = gtk_print_operation_new ();
-  g_object_ref (journal);
 
-  print_data = g_new0 (RogerPrintData, 1);
-  print_data->journal = journal;
+  print_data = roger_print_data_new (journal);
 
   settings = gtk_print_settings_new ();
   gtk_print_settings_set (settings, GTK_PRINT_SETTINGS_OUTPUT_BASENAME, _("Roger Router-Journal"));
@@ -394,36 +568,298 @@ roger_print_journal (GList *journal)
   }
 }
 
-static GdkPixbuf *
-roger_print_load_tiff_page (TIFF *tiff_file)
+typedef struct {
+  RogerPrintData *print_data;
+  GFile *file;
+  gdouble width;
+  gdouble height;
+  cairo_surface_t **pages;
+  GCancellable *cancellable;
+} RogerPrintPdfJob;
+
+static void
+roger_print_pdf_job_free (RogerPrintPdfJob *job)
+{
+  roger_print_data_free (job->print_data);
+  g_object_unref (job->file);
+  g_free (job);
+}
+
+static void
+roger_print_journal_pdf_page_cb (gpointer data,
+                                 gpointer user_data)
+{
+  RogerPrintPdfJob *job = user_data;
+  gint page_nr = GPOINTER_TO_INT (data) - 1;
+  cairo_rectangle_t extents = { 0, 0, job->width, job->height };
+  cairo_surface_t *surface;
+  cairo_t *cairo;
+  PangoLayout *layout;
+
+  if (g_cancellable_is_cancelled (job->cancellable))
+    return;
+
+  surface = cairo_recording_surface_create (CAIRO_CONTENT_COLOR_ALPHA, &extents);
+  cairo = cairo_create (surface);
+
+  /* Every page gets its own layout, the default font map is per thread */
+  layout = pango_cairo_create_layout (cairo);
+  pango_cairo_context_set_resolution (pango_layout_get_context (layout), 72);
+  pango_layout_context_changed (layout);
+  roger_print_journal_setup_layout (layout);
+
+  roger_print_journal_draw_page (job->print_data, cairo, layout, job->width, page_nr);
+
+  g_object_unref (layout);
+  cairo_destroy (cairo);
+
+  job->pages[page_nr] = surface;
+}
+
+static cairo_status_t
+roger_print_journal_pdf_write_cb (void                *closure,
+                                  const unsigned char *data,
+                                  unsigned int         length)
 {
-  TIFFRGBAImage img;
-  gint row, col;
-  gint width, height;
-  guint32 *raster;
-
-  /* discover image height, width */
-  TIFFGetField (tiff_file, TIFFTAG_IMAGEWIDTH, &width);
-  TIFFGetField (tiff_file, TIFFTAG_IMAGELENGTH, &height);
-
-  /* allocate and fill raster from file. */
-  raster = (guint32 *)_TIFFmalloc (width * height * sizeof (guint32));
-  TIFFRGBAImageBegin (&img, tiff_file, FALSE, NULL);
-  TIFFRGBAImageGet (&img, raster, width, height);
-  TIFFRGBAImageEnd (&img);
-
-  /* vertically flip the raster */
-  for (row = 0; row <= height / 2; row++) {
-    for (col = 0; col < width; col++) {
-      guint32 tmp;
-
-      tmp = raster[row * width + col];
-      raster[row * width + col] = raster[(height - row - 1) * width + col];
-      raster[(height - row - 1) * width + col] = tmp;
+  GOutputStream *stream = closure;
+
+  if (!g_output_stream_write_all (stream, data, length, NULL, NULL, NULL))
+    return CAIRO_STATUS_WRITE_ERROR;
+
+  return CAIRO_STATUS_SUCCESS;
+}
+
+static void
+roger_print_journal_pdf_thread_cb (GTask        *task,
+                                   gpointer      source_object,
+                                   gpointer      task_data,
+                                   GCancellable *cancellable)
+{
+  RogerPrintPdfJob *job = task_data;
+  RogerPrintData *print_data = job->print_data;
+  g_autoptr (GFileOutputStream) stream = NULL;
+  g_autoptr (PangoContext) pc = NULL;
+  g_autoptr (GCancellable) cancelled = g_cancellable_new ();
+  g_autofree cairo_surface_t **pages = NULL;
+  GThreadPool *pool;
+  GError *error = NULL;
+  cairo_surface_t *out;
+  cairo_status_t status;
+  cairo_t *cairo;
+  gint page_nr;
+
+  pc = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  pango_cairo_context_set_resolution (pc, 72);
+  print_data->layout = pango_layout_new (pc);
+  roger_print_journal_setup (print_data, pc, job->width, job->height);
+
+  pages = g_new0 (cairo_surface_t *, print_data->num_pages);
+  job->pages = pages;
+  job->cancellable = cancellable;
+
+  pool = g_thread_pool_new (roger_print_journal_pdf_page_cb, job, g_get_num_processors (), TRUE, NULL);
+  for (page_nr = 0; page_nr < print_data->num_pages; page_nr++)
+    g_thread_pool_push (pool, GINT_TO_POINTER (page_nr + 1), NULL);
+  g_thread_pool_free (pool, FALSE, TRUE);
+
+  /* The destination is only replaced once the PDF is complete */
+  if (!g_cancellable_is_cancelled (cancellable))
+    stream = g_file_replace (job->file, NULL, FALSE, G_FILE_CREATE_REPLACE_DESTINATION, cancellable, &error);
+
+  if (stream) {
+    out = cairo_pdf_surface_create_for_stream (roger_print_journal_pdf_write_cb, stream, PDF_PAGE_WIDTH, PDF_PAGE_HEIGHT);
+    cairo = cairo_create (out);
+
+    /* Icons are drawn here on a single thread, see roger_print_journal_draw_icons () */
+    for (page_nr = 0; page_nr < print_data->num_pages && !g_cancellable_is_cancelled (cancellable); page_nr++) {
+      cairo_set_source_surface (cairo, pages[page_nr], PDF_PAGE_MARGIN, PDF_PAGE_MARGIN);
+      cairo_paint (cairo);
+
+      cairo_save (cairo);
+      cairo_translate (cairo, PDF_PAGE_MARGIN, PDF_PAGE_MARGIN);
+      roger_print_journal_draw_icons (print_data, cairo, page_nr);
+      cairo_restore (cairo);
+
+      cairo_show_page (cairo);
+    }
+
+    cairo_destroy (cairo);
+    cairo_surface_finish (out);
+    status = cairo_surface_status (out);
+    cairo_surface_destroy (out);
+
+    if (status != CAIRO_STATUS_SUCCESS)
+      g_set_error (&error, G_IO_ERROR, G_IO_ERROR_FAILED, _("Could not write PDF file: %s"), cairo_status_to_string (status));
+
+    if (!error)
+      g_cancellable_set_error_if_cancelled (cancellable, &error);
+
+    if (!error) {
+      g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, &error);
+    } else {
+      /* Closing with a cancelled cancellable discards the new file */
+      g_cancellable_cancel (cancelled);
+      g_output_stream_close (G_OUTPUT_STREAM (stream), cancelled, NULL);
     }
+  } else if (!error) {
+    g_cancellable_set_error_if_cancelled (cancellable, &error);
   }
 
-  return gdk_pixbuf_new_from_data ((const guchar *)raster, GDK_COLORSPACE_RGB, TRUE, 8, width, height, width * 4, NULL, NULL);
+  for (page_nr = 0; page_nr < print_data->num_pages; page_nr++)
+    g_clear_pointer (&pages[page_nr], cairo_surface_destroy);
+
+  if (error) {
+    g_task_return_error (task, error);
+    return;
+  }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+/**
+ * roger_print_journal_to_pdf_async:
+ * @journal: journal list of #RmCallEntry
+ * @file: PDF file name
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: called when the PDF is written
+ * @user_data: user data for @callback
+ *
+ * Prints @journal to an A4 PDF file without a print dialog. The printed fields
+ * are copied first, so @journal may change afterwards. Pages are laid out in
+ * parallel into recording surfaces in a worker thread, which are then replayed
+ * in order.
+ */
+void
+roger_print_journal_to_pdf_async (GList               *journal,
+                                  const char          *file,
+                                  GCancellable        *cancellable,
+                                  GAsyncReadyCallback  callback,
+                                  gpointer             user_data)
+{
+  g_autoptr (GTask) task = g_task_new (NULL, cancellable, callback, user_data);
+  RogerPrintPdfJob *job = g_new0 (RogerPrintPdfJob, 1);
+
+  job->print_data = roger_print_data_new (journal);
+  job->file = g_file_new_for_path (file);
+  job->width = PDF_PAGE_WIDTH - 2 * PDF_PAGE_MARGIN;
+  job->height = PDF_PAGE_HEIGHT - 2 * PDF_PAGE_MARGIN;
+
+  g_task_set_source_tag (task, roger_print_journal_to_pdf_async);
+  g_task_set_task_data (task, job, (GDestroyNotify)roger_print_pdf_job_free);
+  g_task_run_in_thread (task, roger_print_journal_pdf_thread_cb);
+}
+
+gboolean
+roger_print_journal_to_pdf_finish (GAsyncResult  *result,
+                                   GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, NULL), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/*
+ * Decodes the current directory of @tiff, a bilevel fax page, strip by strip
+ * into an A8 mask of @width x @height. Each mask pixel gets the share of
+ * black page pixels in the area it covers, so no full colour raster of the
+ * page is ever built.
+ */
+static cairo_surface_t *
+roger_print_load_tiff_page (TIFF *tiff,
+                            gint  width,
+                            gint  height)
+{
+  cairo_surface_t *surface;
+  g_autofree guint8 *strip_data = NULL;
+  g_autofree guint32 *x_start = NULL;
+  g_autofree guint32 *sums = NULL;
+  guint32 page_width = 0;
+  guint32 page_height = 0;
+  guint32 rows_per_strip;
+  guint16 bits_per_sample;
+  guint16 samples_per_pixel;
+  guint16 photometric = PHOTOMETRIC_MINISWHITE;
+  tstrip_t current_strip = (tstrip_t)-1;
+  tmsize_t line_size;
+  guint8 *data;
+  guint8 black;
+  gint stride;
+  gint tx;
+  gint ty;
+
+  TIFFGetField (tiff, TIFFTAG_IMAGEWIDTH, &page_width);
+  TIFFGetField (tiff, TIFFTAG_IMAGELENGTH, &page_height);
+  TIFFGetField (tiff, TIFFTAG_PHOTOMETRIC, &photometric);
+  TIFFGetFieldDefaulted (tiff, TIFFTAG_BITSPERSAMPLE, &bits_per_sample);
+  TIFFGetFieldDefaulted (tiff, TIFFTAG_SAMPLESPERPIXEL, &samples_per_pixel);
+  TIFFGetFieldDefaulted (tiff, TIFFTAG_ROWSPERSTRIP, &rows_per_strip);
+
+  if (bits_per_sample != 1 || samples_per_pixel != 1 || TIFFIsTiled (tiff) || !page_width || !page_height) {
+    g_warning ("%s(): Unsupported fax page format", __FUNCTION__);
+    return NULL;
+  }
+
+  rows_per_strip = MIN (rows_per_strip, page_height);
+  line_size = TIFFScanlineSize (tiff);
+  strip_data = g_malloc (TIFFStripSize (tiff));
+  black = photometric == PHOTOMETRIC_MINISBLACK ? 0 : 1;
+
+  /* Page columns covered by each mask column, at least one */
+  x_start = g_new (guint32, width + 1);
+  for (tx = 0; tx <= width; tx++)
+    x_start[tx] = (guint64)tx * page_width / width;
+  sums = g_new (guint32, width);
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_A8, width, height);
+  cairo_surface_flush (surface);
+  data = cairo_image_surface_get_data (surface);
+  stride = cairo_image_surface_get_stride (surface);
+
+  for (ty = 0; ty < height; ty++) {
+    guint32 y_start = (guint64)ty * page_height / height;
+    guint32 y_end = MAX (y_start + 1, (guint64)(ty + 1) * page_height / height);
+    guint32 y;
+
+    memset (sums, 0, width * sizeof (guint32));
+
+    for (y = y_start; y < y_end; y++) {
+      tstrip_t strip = y / rows_per_strip;
+      const guint8 *line;
+
+      /* Rows are visited in order, every strip is decoded once */
+      if (strip != current_strip) {
+        if (TIFFReadEncodedStrip (tiff, strip, strip_data, -1) < 0) {
+          g_warning ("%s(): Could not decode strip %u", __FUNCTION__, strip);
+          cairo_surface_destroy (surface);
+          return NULL;
+        }
+
+        current_strip = strip;
+      }
+
+      line = strip_data + (y - strip * rows_per_strip) * line_size;
+
+      for (tx = 0; tx < width; tx++) {
+        guint32 x_end = MAX (x_start[tx] + 1, x_start[tx + 1]);
+        guint32 x;
+
+        for (x = x_start[tx]; x < x_end; x++) {
+          if (((line[x >> 3] >> (7 - (x & 7))) & 1) == black)
+            sums[tx]++;
+        }
+      }
+    }
+
+    for (tx = 0; tx < width; tx++) {
+      guint32 area = (y_end - y_start) * (MAX (x_start[tx] + 1, x_start[tx + 1]) - x_start[tx]);
+
+      data[ty * stride + tx] = sums[tx] * 255 / area;
+    }
+  }
+
+  cairo_surface_mark_dirty (surface);
+
+  return surface;
 }
 
 void
@@ -436,8 +872,7 @@ print_fax_report (RmFaxStatus *status,
   cairo_t *cairo;
   cairo_surface_t *out;
   time_t time_s = time (NULL);
-  g_autoptr (GdkPixbuf) pixbuf = NULL;
-  g_autoptr (GdkPixbuf) scaled_pixbuf = NULL;
+  cairo_surface_t *page;
   TIFF *tiff;
   struct tm *time_ptr = localtime (&time_s);
   g_autofree char *buffer = NULL;
@@ -457,15 +892,17 @@ print_fax_report (RmFaxStatus *status,
   }
 
   tiff = TIFFOpen (file, "r");
-
-  pixbuf = roger_print_load_tiff_page (tiff);
-  if (!pixbuf) {
-    g_warning ("pixbuf is null (file '%s')\n", file);
+  if (!tiff) {
+    g_warning ("%s: Could not open '%s'\n", __FUNCTION__, file);
     return;
   }
 
-  scaled_pixbuf = gdk_pixbuf_scale_simple (pixbuf, MM_TO_POINTS (594) - 140, MM_TO_POINTS (841) - 200, GDK_INTERP_BILINEAR);
-  g_clear_object (&pixbuf);
+  page = roger_print_load_tiff_page (tiff, MM_TO_POINTS (594) - 140, MM_TO_POINTS (841) - 200);
+  if (!page) {
+    g_warning ("%s: Could not load first page (file '%s')\n", __FUNCTION__, file);
+    TIFFClose (tiff);
+    return;
+  }
 
   buffer = g_strdup_printf ("%s/fax-report_%s_%s_%02d_%02d_%d_%02d_%02d_%02d.pdf",
                             report_dir, local, remote,
@@ -474,15 +911,16 @@ print_fax_report (RmFaxStatus *status,
   out = cairo_pdf_surface_create (buffer, MM_TO_POINTS (594), MM_TO_POINTS (841));
   if (!out) {
     g_warning ("%s: Could not create pdf surface - is report directory writeable?\n", __FUNCTION__);
+    cairo_surface_destroy (page);
+    TIFFClose (tiff);
     return;
   }
 
   cairo = cairo_create (out);
-  gdk_cairo_set_source_pixbuf (cairo, scaled_pixbuf, 70, 200);
-  g_clear_object (&scaled_pixbuf);
-  cairo_paint (cairo);
-
   cairo_set_source_rgb (cairo, 0, 0, 0);
+  cairo_mask_surface (cairo, page, 70, 200);
+  cairo_surface_destroy (page);
+
   cairo_select_font_face (cairo, "cairo:monospace", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
   cairo_set_font_size (cairo, 20);
 
@@ -564,19 +1002,17 @@ print_fax_report (RmFaxStatus *status,
 
   cairo_show_page (cairo);
   while (TIFFReadDirectory (tiff)) {
-    pixbuf = roger_print_load_tiff_page (tiff);
-
-    scaled_pixbuf = gdk_pixbuf_scale_simple (pixbuf, MM_TO_POINTS (594), MM_TO_POINTS (841), GDK_INTERP_BILINEAR);
-    g_clear_object (&pixbuf);
+    page = roger_print_load_tiff_page (tiff, MM_TO_POINTS (594), MM_TO_POINTS (841));
+    if (!page)
+      continue;
 
-    gdk_cairo_set_source_pixbuf (cairo, scaled_pixbuf, 0, 0);
-    g_clear_object (&scaled_pixbuf);
-
-    cairo_paint (cairo);
+    cairo_mask_surface (cairo, page, 0, 0);
+    cairo_surface_destroy (page);
     cairo_show_page (cairo);
   }
 
   cairo_destroy (cairo);
+  TIFFClose (tiff);
 
   cairo_surface_flush (out);
   cairo_surface_destroy (out);
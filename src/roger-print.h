@@ -18,6 +18,13 @@
 G_BEGIN_DECLS
 
 void roger_print_journal (GList *journal);
+void roger_print_journal_to_pdf_async (GList               *journal,
+                                       const char          *file,
+                                       GCancellable        *cancellable,
+                                       GAsyncReadyCallback  callback,
+                                       gpointer             user_data);
+gboolean roger_print_journal_to_pdf_finish (GAsyncResult  *result,
+                                            GError       **error);
 void print_fax_report (RmFaxStatus *status,
                        char        *file,
                        const char  *report_dir);
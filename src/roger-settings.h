@@ -20,6 +20,10 @@ G_BEGIN_DECLS
 #define ROGER_SETTINGS_MAIN   roger_settings_get (ROGER_PREFS_SCHEMA)
 
 #define ROGER_PREFS_RUN_IN_BACKGROUND       "run-in-background"
+#define ROGER_PREFS_LOOKUP_CACHE_TTL        "lookup-cache-ttl"
+#define ROGER_PREFS_FAX_CACHE_SIZE          "fax-cache-size"
+#define ROGER_PREFS_FAX_QUEUE_CONCURRENCY   "fax-queue-concurrency"
+#define ROGER_PREFS_FAX_QUEUE_RETRIES       "fax-queue-retries"
 
 GSettings *roger_settings_get (const char *schema);
 
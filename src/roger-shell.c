@@ -18,6 +18,7 @@
 #include "preferences.h"
 #include "roger-assistant.h"
 #include "roger-fax.h"
+#include "roger-fax-queue-window.h"
 #include "roger-journal.h"
 #include "roger-phone.h"
 #include "roger-settings.h"
@@ -350,6 +351,22 @@ hangup_activated (GSimpleAction *action,
   app_hangup (connection);
 }
 
+static void
+fax_queue_activated (GSimpleAction *action,
+                     GVariant      *parameter,
+                     gpointer       user_data)
+{
+  RogerShell *self = ROGER_SHELL (user_data);
+  static GtkWidget *fax_queue_window;
+
+  if (!fax_queue_window) {
+    fax_queue_window = roger_fax_queue_window_new (GTK_WINDOW (roger_shell_get_journal (self)));
+    g_signal_connect (fax_queue_window, "destroy", G_CALLBACK (gtk_widget_destroyed), &fax_queue_window);
+  }
+
+  gtk_window_present_with_time (GTK_WINDOW (fax_queue_window), gtk_get_current_event_time ());
+}
+
 static void
 journal_activated (GSimpleAction *action,
                    GVariant      *parameter,
@@ -372,6 +389,7 @@ static GActionEntry apps_entries[] = {
   { "pickup", pickup_activated, "i", NULL, NULL },
   { "hangup", hangup_activated, "i", NULL, NULL },
   { "journal", journal_activated, NULL, NULL, NULL },
+  { "fax-queue", fax_queue_activated, NULL, NULL, NULL },
   { "shortcuts", shortcuts_activated, NULL, NULL, NULL },
   { "run-in-background", NULL, NULL, "false", NULL},
 };